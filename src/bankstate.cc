@@ -33,8 +33,17 @@ Command BankState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
                 case CommandType::REFRESH:
                 case CommandType::REFRESH_BANK:
                 case CommandType::SREF_ENTER:
+                case CommandType::CLONE_FPM:
                     required_type = cmd.cmd_type;
                     break;
+                case CommandType::CLONE_PSM:
+                    required_type = CommandType::ACTIVATE;
+                    break;
+                case CommandType::PIM_ACTIVATE:
+                case CommandType::PIM_COMPUTE:
+                case CommandType::PIM_WRITEBACK:
+                    required_type = CommandType::PIM_ACTIVATE;
+                    break;
                 default:
                     std::cerr << "Unknown type!" << std::endl;
                     AbruptExit(__FILE__, __LINE__);
@@ -56,8 +65,22 @@ Command BankState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
                 case CommandType::REFRESH:
                 case CommandType::REFRESH_BANK:
                 case CommandType::SREF_ENTER:
+                // all banks are activated together, so an open bank is
+                // closed first even if it has the row
+                case CommandType::PIM_ACTIVATE:
+                // starts with the activation of the source row
+                case CommandType::CLONE_FPM:
                     required_type = CommandType::PRECHARGE;
                     break;
+                case CommandType::PIM_COMPUTE:
+                case CommandType::PIM_WRITEBACK:
+                case CommandType::CLONE_PSM:
+                    if (cmd.Row() == open_row_) {
+                        required_type = cmd.cmd_type;
+                    } else {
+                        required_type = CommandType::PRECHARGE;
+                    }
+                    break;
                 default:
                     std::cerr << "Unknown type!" << std::endl;
                     AbruptExit(__FILE__, __LINE__);
@@ -70,6 +93,11 @@ Command BankState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
                 case CommandType::READ_PRECHARGE:
                 case CommandType::WRITE:
                 case CommandType::WRITE_PRECHARGE:
+                case CommandType::PIM_ACTIVATE:
+                case CommandType::PIM_COMPUTE:
+                case CommandType::PIM_WRITEBACK:
+                case CommandType::CLONE_FPM:
+                case CommandType::CLONE_PSM:
                     required_type = CommandType::SREF_EXIT;
                     break;
                 default:
@@ -86,7 +114,7 @@ Command BankState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
     }
 
     if (required_type != CommandType::SIZE) {
-        if (clk >= cmd_timing_[static_cast<int>(required_type)]) {
+        if (clk >= cmd_timing_[static_cast<int>(TimingType(required_type))]) {
             return Command(required_type, cmd.addr, cmd.hex_addr);
         }
     }
@@ -101,6 +129,10 @@ void BankState::UpdateState(const Command& cmd) {
                 case CommandType::WRITE:
                     row_hit_count_++;
                     break;
+                case CommandType::PIM_COMPUTE:
+                case CommandType::PIM_WRITEBACK:
+                case CommandType::CLONE_PSM:
+                    break;
                 case CommandType::READ_PRECHARGE:
                 case CommandType::WRITE_PRECHARGE:
                 case CommandType::PRECHARGE:
@@ -121,8 +153,11 @@ void BankState::UpdateState(const Command& cmd) {
             switch (cmd.cmd_type) {
                 case CommandType::REFRESH:
                 case CommandType::REFRESH_BANK:
+                // precharged again once the destination row is written
+                case CommandType::CLONE_FPM:
                     break;
                 case CommandType::ACTIVATE:
+                case CommandType::PIM_ACTIVATE:
                     state_ = State::OPEN;
                     open_row_ = cmd.Row();
                     break;
@@ -164,10 +199,43 @@ void BankState::UpdateState(const Command& cmd) {
     return;
 }
 
+CommandType BankState::TimingType(CommandType cmd_type) {
+    // in each bank an all-bank command is bound by the same constraints as
+    // its single bank counterpart, and so are RowClone commands in the banks
+    // they use; CLONE_PSM reads its source bank, ChannelState checks the
+    // destination bank as a WRITE
+    switch (cmd_type) {
+        case CommandType::PIM_ACTIVATE:
+        case CommandType::CLONE_FPM:
+            return CommandType::ACTIVATE;
+        case CommandType::PIM_COMPUTE:
+        case CommandType::CLONE_PSM:
+            return CommandType::READ;
+        case CommandType::PIM_WRITEBACK:
+            return CommandType::WRITE;
+        default:
+            return cmd_type;
+    }
+}
+
 void BankState::UpdateTiming(CommandType cmd_type, uint64_t time) {
     cmd_timing_[static_cast<int>(cmd_type)] =
         std::max(cmd_timing_[static_cast<int>(cmd_type)], time);
     return;
 }
 
+void BankState::SaveState(CheckpointWriter& ckpt) const {
+    ckpt.Write(state_);
+    ckpt.Write(cmd_timing_);
+    ckpt.Write(open_row_);
+    ckpt.Write(row_hit_count_);
+}
+
+void BankState::LoadState(CheckpointReader& ckpt) {
+    ckpt.Read(state_);
+    ckpt.Read(cmd_timing_);
+    ckpt.Read(open_row_);
+    ckpt.Read(row_hit_count_);
+}
+
 }  // namespace dramsim3
@@ -2,6 +2,7 @@
 #define __BANKSTATE_H
 
 #include <vector>
+#include "checkpoint.h"
 #include "common.h"
 
 namespace dramsim3 {
@@ -19,10 +20,16 @@ class BankState {
     // Update the existing timing constraints for the command
     void UpdateTiming(const CommandType cmd_type, uint64_t time);
 
+    // Command whose timing constraint applies to cmd_type
+    static CommandType TimingType(CommandType cmd_type);
+
     bool IsRowOpen() const { return state_ == State::OPEN; }
     int OpenRow() const { return open_row_; }
     int RowHitCount() const { return row_hit_count_; }
 
+    void SaveState(CheckpointWriter& ckpt) const;
+    void LoadState(CheckpointReader& ckpt);
+
    private:
     // Current state of the Bank
     // Apriori or instantaneously transitions on a command.
@@ -0,0 +1,309 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "./../ext/headers/args.hxx"
+#include "fmt/format.h"
+#include "json.hpp"
+#include "memory_system.h"
+
+// Simulator throughput benchmark
+// Runs a fixed matrix of (config, traffic pattern) cases for a fixed number
+// of cycles and reports how fast the simulator itself is. Each case runs in
+// a forked child so that peak RSS can be reported per case.
+
+using namespace dramsim3;
+using Json = nlohmann::json;
+
+namespace {
+
+const std::vector<std::string> kBenchConfigs = {
+    "DDR3_8Gb_x8_1600.ini", "DDR4_8Gb_x8_3200.ini", "GDDR5_8Gb_x32.ini",
+    "HBM2_8Gb_x128.ini", "HMC_2GB_4Lx16.ini"};
+
+const std::vector<std::string> kBenchPatterns = {"random", "stream",
+                                                 "row_hit"};
+
+struct BenchResult {
+    std::string name;
+    uint64_t cycles;
+    uint64_t transactions;
+    double seconds;
+    long peak_rss_kb;
+
+    double CyclesPerSec() const { return cycles / seconds; }
+    double TransPerSec() const { return transactions / seconds; }
+};
+
+// Simple traffic generator, one request attempt per cycle like RandomCPU
+class BenchDriver {
+   public:
+    BenchDriver(const std::string& config_file, const std::string& output_dir,
+                const std::string& pattern)
+        : memory_system_(
+              config_file, output_dir,
+              std::bind(&BenchDriver::Callback, this, std::placeholders::_1),
+              std::bind(&BenchDriver::Callback, this, std::placeholders::_1)),
+          pattern_(pattern),
+          gen_(0x5eed),
+          clk_(0),
+          addr_(0),
+          is_write_(false),
+          get_next_(true),
+          num_issued_(0) {}
+
+    void ClockTick() {
+        memory_system_.ClockTick();
+        if (get_next_) {
+            NextRequest();
+        }
+        get_next_ = memory_system_.WillAcceptTransaction(addr_, is_write_);
+        if (get_next_) {
+            memory_system_.AddTransaction(addr_, is_write_);
+            num_issued_++;
+        }
+        clk_++;
+    }
+
+    uint64_t NumIssued() const { return num_issued_; }
+
+   private:
+    void Callback(uint64_t addr) { return; }
+
+    void NextRequest() {
+        if (pattern_ == "stream") {
+            // sequential 64B accesses, every third one a write
+            addr_ += 64;
+            is_write_ = (num_issued_ % 3 == 2);
+        } else if (pattern_ == "row_hit") {
+            // small working set that mostly stays within open rows
+            addr_ = (gen_() % 256) * 64;
+            is_write_ = (gen_() % 4 == 0);
+        } else {
+            addr_ = gen_();
+            is_write_ = (gen_() % 3 == 0);
+        }
+    }
+
+    MemorySystem memory_system_;
+    std::string pattern_;
+    std::mt19937_64 gen_;
+    uint64_t clk_;
+    uint64_t addr_;
+    bool is_write_;
+    bool get_next_;
+    uint64_t num_issued_;
+};
+
+BenchResult RunCase(const std::string& config_file, const std::string& pattern,
+                    const std::string& output_dir, uint64_t cycles) {
+    BenchDriver driver(config_file, output_dir, pattern);
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t clk = 0; clk < cycles; clk++) {
+        driver.ClockTick();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    BenchResult result;
+    result.cycles = cycles;
+    result.transactions = driver.NumIssued();
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.peak_rss_kb = usage.ru_maxrss;
+    return result;
+}
+
+// run a case in a child process so that its peak RSS is not polluted by
+// previous cases, results are passed back through a pipe
+bool RunCaseIsolated(const std::string& config_file,
+                     const std::string& pattern, const std::string& output_dir,
+                     uint64_t cycles, BenchResult& result) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "Cannot create pipe for benchmark case" << std::endl;
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Cannot fork benchmark case" << std::endl;
+        return false;
+    } else if (pid == 0) {
+        close(fds[0]);
+        auto res = RunCase(config_file, pattern, output_dir, cycles);
+        double buf[4] = {static_cast<double>(res.transactions), res.seconds,
+                         static_cast<double>(res.peak_rss_kb),
+                         static_cast<double>(res.cycles)};
+        ssize_t written = write(fds[1], buf, sizeof(buf));
+        close(fds[1]);
+        _exit(written == sizeof(buf) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    double buf[4];
+    ssize_t num_read = read(fds[0], buf, sizeof(buf));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (num_read != sizeof(buf) || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        return false;
+    }
+    result.transactions = static_cast<uint64_t>(buf[0]);
+    result.seconds = buf[1];
+    result.peak_rss_kb = static_cast<long>(buf[2]);
+    result.cycles = static_cast<uint64_t>(buf[3]);
+    return true;
+}
+
+Json ResultsToJson(const std::vector<BenchResult>& results) {
+    Json j_results;
+    for (const auto& res : results) {
+        Json j_case;
+        j_case["cycles"] = res.cycles;
+        j_case["transactions"] = res.transactions;
+        j_case["seconds"] = res.seconds;
+        j_case["cycles_per_sec"] = res.CyclesPerSec();
+        j_case["trans_per_sec"] = res.TransPerSec();
+        j_case["peak_rss_kb"] = res.peak_rss_kb;
+        j_results[res.name] = j_case;
+    }
+    return j_results;
+}
+
+// returns number of cases slower than baseline by more than tolerance
+int CompareBaseline(const std::vector<BenchResult>& results,
+                    const Json& baseline, double tolerance) {
+    int num_regressions = 0;
+    std::cout << std::endl
+              << fmt::format("{:<34}{:>16}{:>16}{:>10}", "case",
+                             "baseline cyc/s", "current cyc/s", "change")
+              << std::endl;
+    for (const auto& res : results) {
+        if (baseline.find(res.name) == baseline.end()) {
+            std::cout << fmt::format("{:<34}{:>16}", res.name, "(new)")
+                      << std::endl;
+            continue;
+        }
+        double base = baseline[res.name]["cycles_per_sec"].get<double>();
+        double change = (res.CyclesPerSec() - base) / base;
+        bool regressed = change < -tolerance;
+        if (regressed) {
+            num_regressions++;
+        }
+        std::cout << fmt::format("{:<34}{:>16.0f}{:>16.0f}{:>+9.1f}%{}",
+                                 res.name, base, res.CyclesPerSec(),
+                                 change * 100, regressed ? " REGRESSED" : "")
+                  << std::endl;
+    }
+    return num_regressions;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+    args::ArgumentParser parser(
+        "DRAMsim3 simulator throughput benchmark.",
+        "Examples: \n"
+        "./build/dramsim3bench --save baseline.json\n"
+        "./build/dramsim3bench --baseline baseline.json -c 200000");
+    args::HelpFlag help(parser, "help", "Display the help menu", {'h', "help"});
+    args::ValueFlag<uint64_t> num_cycles_arg(
+        parser, "num_cycles", "Number of cycles to simulate per case",
+        {'c', "cycles"}, 100000);
+    args::ValueFlag<std::string> config_dir_arg(
+        parser, "config_dir", "Directory holding the benchmark configs",
+        {'d', "config-dir"}, "configs");
+    args::ValueFlag<std::string> output_dir_arg(
+        parser, "output_dir", "Output directory for stats files",
+        {'o', "output-dir"}, ".");
+    args::ValueFlag<std::string> filter_arg(
+        parser, "filter", "Only run cases whose name contains this string",
+        {'f', "filter"}, "");
+    args::ValueFlag<std::string> save_arg(
+        parser, "save", "Save results as JSON to this file", {"save"});
+    args::ValueFlag<std::string> baseline_arg(
+        parser, "baseline", "Compare results against this baseline JSON",
+        {"baseline"});
+    args::ValueFlag<double> tolerance_arg(
+        parser, "tolerance",
+        "Allowed slowdown against baseline before failing (percent)",
+        {"tolerance"}, 10.0);
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help) {
+        std::cout << parser;
+        return 0;
+    } catch (args::ParseError e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    uint64_t cycles = args::get(num_cycles_arg);
+    std::string config_dir = args::get(config_dir_arg);
+    std::string output_dir = args::get(output_dir_arg);
+    std::string filter = args::get(filter_arg);
+
+    std::vector<BenchResult> results;
+    std::cout << fmt::format("{:<34}{:>14}{:>14}{:>12}", "case", "cycles/s",
+                             "trans/s", "peak RSS")
+              << std::endl;
+    for (const auto& config : kBenchConfigs) {
+        for (const auto& pattern : kBenchPatterns) {
+            std::string name =
+                config.substr(0, config.size() - 4) + "/" + pattern;
+            if (!filter.empty() && name.find(filter) == std::string::npos) {
+                continue;
+            }
+            BenchResult res;
+            res.name = name;
+            std::string config_file = config_dir + "/" + config;
+            if (!RunCaseIsolated(config_file, pattern, output_dir, cycles,
+                                 res)) {
+                std::cerr << "Benchmark case " << name << " failed"
+                          << std::endl;
+                return 1;
+            }
+            std::cout << fmt::format("{:<34}{:>14.0f}{:>14.0f}{:>9} KB",
+                                     res.name, res.CyclesPerSec(),
+                                     res.TransPerSec(), res.peak_rss_kb)
+                      << std::endl;
+            results.push_back(res);
+        }
+    }
+
+    Json j_results = ResultsToJson(results);
+    if (save_arg) {
+        std::ofstream j_out(args::get(save_arg));
+        j_out << j_results.dump(4) << std::endl;
+    }
+
+    if (baseline_arg) {
+        std::ifstream j_in(args::get(baseline_arg));
+        if (j_in.fail()) {
+            std::cerr << "Cannot open baseline " << args::get(baseline_arg)
+                      << std::endl;
+            return 1;
+        }
+        Json baseline;
+        j_in >> baseline;
+        double tolerance = args::get(tolerance_arg) / 100.0;
+        int num_regressions = CompareBaseline(results, baseline, tolerance);
+        if (num_regressions > 0) {
+            std::cout << num_regressions << " case(s) regressed by more than "
+                      << args::get(tolerance_arg) << "%" << std::endl;
+            return 2;
+        }
+    }
+    return 0;
+}
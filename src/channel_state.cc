@@ -99,13 +99,18 @@ Command ChannelState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
         } else {
             return Command();
         }
+    } else if (cmd.IsPIM()) {
+        return GetReadyPIMCommand(cmd, clk);
+    } else if (cmd.cmd_type == CommandType::CLONE_PSM) {
+        return GetReadyPSMCommand(cmd, clk);
     } else {
         ready_cmd = bank_states_[cmd.Rank()][cmd.Bankgroup()][cmd.Bank()]
                         .GetReadyCommand(cmd, clk);
         if (!ready_cmd.IsValid()) {
             return Command();
         }
-        if (ready_cmd.cmd_type == CommandType::ACTIVATE) {
+        if (ready_cmd.cmd_type == CommandType::ACTIVATE ||
+            ready_cmd.cmd_type == CommandType::CLONE_FPM) {
             if (!ActivationWindowOk(ready_cmd.Rank(), clk)) {
                 return Command();
             }
@@ -114,6 +119,73 @@ Command ChannelState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
     }
 }
 
+Command ChannelState::GetReadyPIMCommand(const Command& cmd,
+                                         uint64_t clk) const {
+    // column commands need the row open in every bank of the rank, otherwise
+    // the open banks are closed one by one and all of them activated at once
+    int rank = cmd.Rank();
+    bool all_open = true;
+    for (auto j = 0; j < config_.bankgroups; j++) {
+        for (auto k = 0; k < config_.banks_per_group; k++) {
+            if (!IsRowOpen(rank, j, k) || OpenRow(rank, j, k) != cmd.Row()) {
+                all_open = false;
+            }
+        }
+    }
+    Command target =
+        all_open ? cmd
+                 : Command(CommandType::PIM_ACTIVATE, cmd.addr, cmd.hex_addr);
+    bool all_ready = true;
+    for (auto j = 0; j < config_.bankgroups; j++) {
+        for (auto k = 0; k < config_.banks_per_group; k++) {
+            Command ready_cmd =
+                bank_states_[rank][j][k].GetReadyCommand(target, clk);
+            if (!ready_cmd.IsValid()) {
+                all_ready = false;
+            } else if (ready_cmd.cmd_type == CommandType::PRECHARGE) {
+                ready_cmd.addr = Address(cmd.Channel(), rank, j, k, -1, -1);
+                return ready_cmd;
+            } else if (ready_cmd.cmd_type == CommandType::SREF_EXIT) {
+                return ready_cmd;
+            }
+        }
+    }
+    if (!all_ready) {
+        return Command();
+    }
+    if (target.cmd_type == CommandType::PIM_ACTIVATE &&
+        !ActivationWindowOk(rank, clk)) {
+        return Command();
+    }
+    return target;
+}
+
+Command ChannelState::GetReadyPSMCommand(const Command& cmd,
+                                         uint64_t clk) const {
+    // the source row is opened first, then the destination row in its bank;
+    // the source is read and the destination written, so the destination
+    // bank is held to the timing of a WRITE
+    Command dest(CommandType::WRITE, config_.AddressMapping(cmd.hex_addr),
+                 cmd.hex_addr);
+    for (const auto& bank_cmd : {cmd, dest}) {
+        Command ready_cmd =
+            bank_states_[bank_cmd.Rank()][bank_cmd.Bankgroup()]
+                        [bank_cmd.Bank()]
+                            .GetReadyCommand(bank_cmd, clk);
+        if (!ready_cmd.IsValid()) {
+            return Command();
+        }
+        if (ready_cmd.cmd_type == CommandType::ACTIVATE &&
+            !ActivationWindowOk(ready_cmd.Rank(), clk)) {
+            return Command();
+        }
+        if (ready_cmd.cmd_type != bank_cmd.cmd_type) {
+            return ready_cmd;
+        }
+    }
+    return cmd;
+}
+
 void ChannelState::UpdateState(const Command& cmd) {
     if (cmd.IsRankCMD()) {
         for (auto j = 0; j < config_.bankgroups; j++) {
@@ -128,6 +200,18 @@ void ChannelState::UpdateState(const Command& cmd) {
         } else if (cmd.cmd_type == CommandType::SREF_EXIT) {
             rank_is_sref_[cmd.Rank()] = false;
         }
+    } else if (cmd.IsPIM()) {
+        for (auto j = 0; j < config_.bankgroups; j++) {
+            for (auto k = 0; k < config_.banks_per_group; k++) {
+                bank_states_[cmd.Rank()][j][k].UpdateState(cmd);
+            }
+        }
+    } else if (cmd.cmd_type == CommandType::CLONE_PSM) {
+        Command dest(cmd.cmd_type, config_.AddressMapping(cmd.hex_addr),
+                     cmd.hex_addr);
+        bank_states_[cmd.Rank()][cmd.Bankgroup()][cmd.Bank()].UpdateState(cmd);
+        bank_states_[dest.Rank()][dest.Bankgroup()][dest.Bank()].UpdateState(
+            dest);
     } else {
         bank_states_[cmd.Rank()][cmd.Bankgroup()][cmd.Bank()].UpdateState(cmd);
         if (cmd.IsRefresh()) {
@@ -139,8 +223,13 @@ void ChannelState::UpdateState(const Command& cmd) {
 
 void ChannelState::UpdateTiming(const Command& cmd, uint64_t clk) {
     switch (cmd.cmd_type) {
+        case CommandType::CLONE_FPM:
+            // activates the source and then the destination row
+            UpdateActivationTimes(cmd.Rank(), clk);
+            // fallthrough
         case CommandType::ACTIVATE:
             UpdateActivationTimes(cmd.Rank(), clk);
+            // fallthrough
         case CommandType::READ:
         case CommandType::READ_PRECHARGE:
         case CommandType::WRITE:
@@ -172,6 +261,29 @@ void ChannelState::UpdateTiming(const Command& cmd, uint64_t clk) {
                 cmd.addr, timing_.other_ranks[static_cast<int>(cmd.cmd_type)],
                 clk);
             break;
+        case CommandType::CLONE_PSM:
+            // the internal bus is shared by the rank, the two banks also
+            // have their own constraints
+            UpdateSameRankTiming(
+                cmd.addr, timing_.same_rank[static_cast<int>(cmd.cmd_type)],
+                clk);
+            UpdateSameBankTiming(
+                cmd.addr, timing_.same_bank[static_cast<int>(cmd.cmd_type)],
+                clk);
+            UpdateSameBankTiming(
+                config_.AddressMapping(cmd.hex_addr),
+                timing_.same_bank[static_cast<int>(cmd.cmd_type)], clk);
+            break;
+        case CommandType::PIM_ACTIVATE:
+            // approximation: the all-bank activate opens every bank but
+            // takes one slot of the tFAW window, counting each bank would
+            // keep it from ever issuing on parts with more than 4 banks;
+            // the all-bank timing in same_rank spaces it from other
+            // activations instead
+            UpdateActivationTimes(cmd.Rank(), clk);
+            // fallthrough
+        case CommandType::PIM_COMPUTE:
+        case CommandType::PIM_WRITEBACK:
         case CommandType::REFRESH:
         case CommandType::SREF_ENTER:
         case CommandType::SREF_EXIT:
@@ -313,4 +425,49 @@ bool ChannelState::Is32AWReady(int rank, uint64_t curr_time) const {
     return true;
 }
 
+void ChannelState::SaveState(CheckpointWriter& ckpt) const {
+    ckpt.Write(rank_idle_cycles);
+    ckpt.Write(rank_is_sref_);
+    for (const auto& rank_states : bank_states_) {
+        for (const auto& bg_states : rank_states) {
+            for (const auto& bank_state : bg_states) {
+                bank_state.SaveState(ckpt);
+            }
+        }
+    }
+    ckpt.Write(refresh_q_);
+    ckpt.Write(four_aw_);
+    ckpt.Write(thirty_two_aw_);
+}
+
+void ChannelState::LoadState(CheckpointReader& ckpt) {
+    ckpt.Read(rank_idle_cycles);
+    ckpt.Read(rank_is_sref_);
+    for (auto& rank_states : bank_states_) {
+        for (auto& bg_states : rank_states) {
+            for (auto& bank_state : bg_states) {
+                bank_state.LoadState(ckpt);
+            }
+        }
+    }
+    ckpt.Read(refresh_q_);
+    ckpt.Read(four_aw_);
+    ckpt.Read(thirty_two_aw_);
+}
+
+void ChannelState::FunctionalRefresh(int rank, int bankgroup, int bank) {
+    for (auto j = 0; j < config_.bankgroups; j++) {
+        for (auto k = 0; k < config_.banks_per_group; k++) {
+            if (bankgroup >= 0 && (j != bankgroup || k != bank)) {
+                continue;
+            }
+            if (bank_states_[rank][j][k].IsRowOpen()) {
+                Command pre(CommandType::PRECHARGE,
+                            Address(-1, rank, j, k, -1, -1), -1);
+                bank_states_[rank][j][k].UpdateState(pre);
+            }
+        }
+    }
+}
+
 }  // namespace dramsim3
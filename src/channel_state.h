@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "bankstate.h"
+#include "checkpoint.h"
 #include "common.h"
 #include "configuration.h"
 #include "timing.h"
@@ -28,12 +29,17 @@ class ChannelState {
     const Command& PendingRefCommand() const {return refresh_q_.front(); }
     void BankNeedRefresh(int rank, int bankgroup, int bank, bool need);
     void RankNeedRefresh(int rank, bool need);
+    // untimed refresh used in fast-forward, closes the rows of a bank, or
+    // of the whole rank if bankgroup and bank are -1
+    void FunctionalRefresh(int rank, int bankgroup, int bank);
     int OpenRow(int rank, int bankgroup, int bank) const {
         return bank_states_[rank][bankgroup][bank].OpenRow();
     }
     int RowHitCount(int rank, int bankgroup, int bank) const {
         return bank_states_[rank][bankgroup][bank].RowHitCount();
     };
+    void SaveState(CheckpointWriter& ckpt) const;
+    void LoadState(CheckpointReader& ckpt);
 
     std::vector<int> rank_idle_cycles;
 
@@ -47,6 +53,10 @@ class ChannelState {
 
     std::vector<std::vector<uint64_t> > four_aw_;
     std::vector<std::vector<uint64_t> > thirty_two_aw_;
+    // all-bank commands work on every bank of the rank of cmd
+    Command GetReadyPIMCommand(const Command& cmd, uint64_t clk) const;
+    // CLONE_PSM needs the source and the destination row open
+    Command GetReadyPSMCommand(const Command& cmd, uint64_t clk) const;
     bool IsFAWReady(int rank, uint64_t curr_time) const;
     bool Is32AWReady(int rank, uint64_t curr_time) const;
     // Update timing of the bank the command corresponds to
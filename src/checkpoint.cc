@@ -0,0 +1,127 @@
+#include "checkpoint.h"
+
+namespace dramsim3 {
+
+void CheckpointWriter::Write(const std::string& str) {
+    Write(static_cast<uint64_t>(str.size()));
+    out_.write(str.data(), str.size());
+}
+
+void CheckpointWriter::Write(const Address& addr) {
+    Write(addr.channel);
+    Write(addr.rank);
+    Write(addr.bankgroup);
+    Write(addr.bank);
+    Write(addr.row);
+    Write(addr.column);
+}
+
+void CheckpointWriter::Write(const Command& cmd) {
+    Write(cmd.cmd_type);
+    Write(cmd.addr);
+    Write(cmd.hex_addr);
+}
+
+void CheckpointWriter::Write(const Transaction& trans) {
+    Write(trans.addr);
+    Write(trans.added_cycle);
+    Write(trans.complete_cycle);
+    Write(trans.is_write);
+    Write(trans.size);
+    Write(trans.addr2);
+    Write(trans.addr3);
+    Write(trans.req_id);
+    Write(trans.is_read);
+    Write(trans.is_part);
+    Write(trans.cim_op);
+    Write(trans.cim_count);
+    Write(trans.cim_stride);
+    Write(trans.pim_op);
+    Write(trans.clone_op);
+    Write(trans.atomic_op);
+    Write(trans.is_cim);
+    Write(trans.tag);
+    Write(trans.source_id);
+    Write(trans.priority);
+    Write(trans.is_tagged);
+}
+
+void CheckpointWriter::Write(const Completion& completion) {
+    Write(completion.tag);
+    Write(completion.addr);
+    Write(completion.source_id);
+    Write(completion.is_write);
+}
+
+void CheckpointWriter::Write(const std::vector<bool>& vec) {
+    Write(static_cast<uint64_t>(vec.size()));
+    for (bool val : vec) {
+        Write(val);
+    }
+}
+
+void CheckpointReader::Read(std::string& str) {
+    uint64_t size = ReadSize();
+    str.assign(size, '\0');
+    if (size > 0) {
+        in_.read(&str[0], size);
+    }
+}
+
+void CheckpointReader::Read(Address& addr) {
+    Read(addr.channel);
+    Read(addr.rank);
+    Read(addr.bankgroup);
+    Read(addr.bank);
+    Read(addr.row);
+    Read(addr.column);
+}
+
+void CheckpointReader::Read(Command& cmd) {
+    Read(cmd.cmd_type);
+    Read(cmd.addr);
+    Read(cmd.hex_addr);
+}
+
+void CheckpointReader::Read(Transaction& trans) {
+    Read(trans.addr);
+    Read(trans.added_cycle);
+    Read(trans.complete_cycle);
+    Read(trans.is_write);
+    Read(trans.size);
+    Read(trans.addr2);
+    Read(trans.addr3);
+    Read(trans.req_id);
+    Read(trans.is_read);
+    Read(trans.is_part);
+    Read(trans.cim_op);
+    Read(trans.cim_count);
+    Read(trans.cim_stride);
+    Read(trans.pim_op);
+    Read(trans.clone_op);
+    Read(trans.atomic_op);
+    Read(trans.is_cim);
+    Read(trans.tag);
+    Read(trans.source_id);
+    Read(trans.priority);
+    Read(trans.is_tagged);
+}
+
+void CheckpointReader::Read(Completion& completion) {
+    Read(completion.tag);
+    Read(completion.addr);
+    Read(completion.source_id);
+    Read(completion.is_write);
+}
+
+void CheckpointReader::Read(std::vector<bool>& vec) {
+    uint64_t size = ReadSize();
+    vec.clear();
+    for (uint64_t i = 0; i < size && Good(); i++) {
+        bool val = false;
+        Read(val);
+        vec.push_back(val);
+    }
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,172 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <deque>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+namespace dramsim3 {
+
+// Binary serialization helpers used to checkpoint simulator state.
+// Values are written in native byte order, so a checkpoint is only meant to
+// be restored on the same kind of host that produced it.
+class CheckpointWriter {
+   public:
+    CheckpointWriter(std::ostream& out) : out_(out) {}
+    bool Good() const { return out_.good(); }
+
+    template <typename T>
+    void Write(const T& val) {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                      "only scalars can be written directly");
+        out_.write(reinterpret_cast<const char*>(&val), sizeof(T));
+    }
+    void Write(const std::string& str);
+    void Write(const Address& addr);
+    void Write(const Command& cmd);
+    void Write(const Transaction& trans);
+    void Write(const Completion& completion);
+    void Write(const std::vector<bool>& vec);
+
+    template <typename T1, typename T2>
+    void Write(const std::pair<T1, T2>& val) {
+        Write(val.first);
+        Write(val.second);
+    }
+    template <typename T, typename A>
+    void Write(const std::vector<T, A>& vec) {
+        WriteRange(vec);
+    }
+    template <typename T, typename A>
+    void Write(const std::deque<T, A>& deq) {
+        WriteRange(deq);
+    }
+    template <typename K, typename V, typename C, typename A>
+    void Write(const std::map<K, V, C, A>& map) {
+        WriteRange(map);
+    }
+    template <typename K, typename V, typename C, typename A>
+    void Write(const std::multimap<K, V, C, A>& map) {
+        WriteRange(map);
+    }
+    template <typename K, typename V, typename H, typename E, typename A>
+    void Write(const std::unordered_map<K, V, H, E, A>& map) {
+        WriteRange(map);
+    }
+    template <typename K, typename H, typename E, typename A>
+    void Write(const std::unordered_set<K, H, E, A>& set) {
+        WriteRange(set);
+    }
+
+   private:
+    template <typename Container>
+    void WriteRange(const Container& container) {
+        Write(static_cast<uint64_t>(container.size()));
+        for (const auto& it : container) {
+            Write(it);
+        }
+    }
+    std::ostream& out_;
+};
+
+class CheckpointReader {
+   public:
+    CheckpointReader(std::istream& in) : in_(in) {}
+    bool Good() const { return in_.good(); }
+
+    template <typename T>
+    void Read(T& val) {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                      "only scalars can be read directly");
+        in_.read(reinterpret_cast<char*>(&val), sizeof(T));
+    }
+    void Read(std::string& str);
+    void Read(Address& addr);
+    void Read(Command& cmd);
+    void Read(Transaction& trans);
+    void Read(Completion& completion);
+    void Read(std::vector<bool>& vec);
+
+    template <typename T1, typename T2>
+    void Read(std::pair<T1, T2>& val) {
+        Read(val.first);
+        Read(val.second);
+    }
+    // vectors are cleared instead of re-assigned so that reserved capacity,
+    // which the controller uses as queue size, is kept
+    template <typename T, typename A>
+    void Read(std::vector<T, A>& vec) {
+        uint64_t size = ReadSize();
+        vec.clear();
+        for (uint64_t i = 0; i < size && Good(); i++) {
+            T val;
+            Read(val);
+            vec.push_back(val);
+        }
+    }
+    template <typename T, typename A>
+    void Read(std::deque<T, A>& deq) {
+        uint64_t size = ReadSize();
+        deq.clear();
+        for (uint64_t i = 0; i < size && Good(); i++) {
+            T val;
+            Read(val);
+            deq.push_back(val);
+        }
+    }
+    template <typename K, typename V, typename C, typename A>
+    void Read(std::map<K, V, C, A>& map) {
+        ReadPairs(map);
+    }
+    // equal keys are restored in their original (insertion) order
+    template <typename K, typename V, typename C, typename A>
+    void Read(std::multimap<K, V, C, A>& map) {
+        ReadPairs(map);
+    }
+    template <typename K, typename V, typename H, typename E, typename A>
+    void Read(std::unordered_map<K, V, H, E, A>& map) {
+        ReadPairs(map);
+    }
+    template <typename K, typename H, typename E, typename A>
+    void Read(std::unordered_set<K, H, E, A>& set) {
+        uint64_t size = ReadSize();
+        set.clear();
+        for (uint64_t i = 0; i < size && Good(); i++) {
+            K key;
+            Read(key);
+            set.insert(key);
+        }
+    }
+
+   private:
+    uint64_t ReadSize() {
+        uint64_t size = 0;
+        Read(size);
+        return size;
+    }
+    template <typename Map>
+    void ReadPairs(Map& map) {
+        uint64_t size = ReadSize();
+        map.clear();
+        for (uint64_t i = 0; i < size && Good(); i++) {
+            typename std::remove_const<typename Map::key_type>::type key;
+            typename Map::mapped_type val;
+            Read(key);
+            Read(val);
+            map.insert(std::make_pair(key, val));
+        }
+    }
+    std::istream& in_;
+};
+
+}  // namespace dramsim3
+#endif
@@ -0,0 +1,320 @@
+#include "cim.h"
+
+#include <algorithm>
+
+namespace dramsim3 {
+
+CiMEngine::CiMEngine(const Config &config, std::vector<Controller *> &ctrls)
+    : config_(config), ctrls_(ctrls) {
+    int max_latency = 0;
+    for (size_t i = 0; i < config_.cim_ops.size(); i++) {
+        op_index_[CiMOpId(config_.cim_ops[i].name)] = i;
+        max_latency = std::max(max_latency, config_.cim_ops[i].latency);
+    }
+    uint64_t wheel_size = 1;
+    while (wheel_size <= static_cast<uint64_t>(max_latency)) {
+        wheel_size <<= 1;
+    }
+    wheel_.resize(wheel_size);
+    wheel_mask_ = wheel_size - 1;
+}
+
+int CiMEngine::FindOp(uint64_t op_id) const {
+    auto it = op_index_.find(op_id);
+    if (it == op_index_.end()) {
+        std::cerr << "Unknown CiM operation, declare it in [cim] ops"
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    return it->second;
+}
+
+bool CiMEngine::WillAcceptTransaction(const Transaction &trans) const {
+    const CiMOpSpec &spec = config_.cim_ops[FindOp(trans.cim_op)];
+    if (trans.cim_count > 1) {
+        return bulk_.size() < static_cast<size_t>(config_.trans_queue_size);
+    }
+    uint64_t operands[3] = {trans.addr, trans.addr2, trans.addr3};
+    return CanStart(spec, operands);
+}
+
+bool CiMEngine::CanStart(const CiMOpSpec &spec,
+                         const uint64_t *operands) const {
+    // every channel touched needs room for all of its reads and writes
+    std::vector<int> channels, reads, writes;
+    auto count = [&](int operand, std::vector<int> &counts) {
+        int channel = config_.AddressMapping(operands[operand]).channel;
+        size_t i = 0;
+        while (i < channels.size() && channels[i] != channel) {
+            i++;
+        }
+        if (i == channels.size()) {
+            channels.push_back(channel);
+            reads.push_back(0);
+            writes.push_back(0);
+        }
+        counts[i]++;
+    };
+    for (auto operand : spec.reads) {
+        count(operand, reads);
+    }
+    for (auto operand : spec.writes) {
+        count(operand, writes);
+    }
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (!ctrls_[channels[i]]->WillAcceptTransaction(0, reads[i],
+                                                        writes[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CiMEngine::CheckPlacement(const CiMOpSpec &spec,
+                               const CiMRecord &record) const {
+    if (spec.placement == CiMPlacement::CONTROLLER) {
+        return;
+    }
+    Address first = config_.AddressMapping(record.operands[0]);
+    for (int i = 1; i < spec.num_operands; i++) {
+        Address addr = config_.AddressMapping(record.operands[i]);
+        bool local = addr.channel == first.channel;
+        if (spec.placement == CiMPlacement::BANK) {
+            local = local && addr.rank == first.rank &&
+                    addr.bankgroup == first.bankgroup &&
+                    addr.bank == first.bank;
+        }
+        if (!local) {
+            std::cerr << spec.name << " operands must be in the same "
+                      << (spec.placement == CiMPlacement::BANK ? "bank"
+                                                                : "vault")
+                      << ", got " << std::hex << record.operands[0] << " and "
+                      << record.operands[i] << std::dec << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+    }
+}
+
+void CiMEngine::AddTransaction(const Transaction &trans, uint64_t clk) {
+    int op = FindOp(trans.cim_op);
+    uint64_t operands[3] = {trans.addr, trans.addr2, trans.addr3};
+    if (trans.cim_count <= 1) {
+        StartOp(op, operands, clk);
+        return;
+    }
+
+    CiMBulk bulk;
+    bulk.op = op;
+    std::copy(operands, operands + 3, bulk.operands);
+    bulk.stride = trans.cim_stride == 0 ? config_.request_size_bytes
+                                        : trans.cim_stride;
+    bulk.next = 0;
+    // elements in the same row of their first operand go back to back so
+    // they share one activation, rows are visited in address order
+    std::vector<std::pair<int, uint32_t>> rows(trans.cim_count);
+    for (uint32_t i = 0; i < trans.cim_count; i++) {
+        rows[i] = std::make_pair(
+            config_.AddressMapping(operands[0] + i * bulk.stride).row, i);
+    }
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](const std::pair<int, uint32_t> &a,
+                        const std::pair<int, uint32_t> &b) {
+                         return a.first < b.first;
+                     });
+    bulk.order.reserve(rows.size());
+    for (const auto &it : rows) {
+        bulk.order.push_back(it.second);
+    }
+    bulk_.push_back(std::move(bulk));
+}
+
+void CiMEngine::StartBulkElements(uint64_t clk) {
+    for (auto it = bulk_.begin(); it != bulk_.end();) {
+        CiMBulk &bulk = *it;
+        const CiMOpSpec &spec = config_.cim_ops[bulk.op];
+        while (bulk.next < bulk.order.size()) {
+            uint64_t offset = bulk.order[bulk.next] * bulk.stride;
+            uint64_t operands[3] = {bulk.operands[0] + offset,
+                                    bulk.operands[1] + offset,
+                                    bulk.operands[2] + offset};
+            if (!CanStart(spec, operands)) {
+                break;
+            }
+            StartOp(bulk.op, operands, clk);
+            bulk.next++;
+        }
+        if (bulk.next == bulk.order.size()) {
+            it = bulk_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CiMEngine::StartOp(int op, const uint64_t *operands, uint64_t clk) {
+    const CiMOpSpec &spec = config_.cim_ops[op];
+    uint32_t slot;
+    if (free_records_.empty()) {
+        slot = records_.size();
+        records_.emplace_back();
+    } else {
+        slot = free_records_.back();
+        free_records_.pop_back();
+    }
+    CiMRecord &record = records_[slot];
+    record.op = op;
+    std::copy(operands, operands + 3, record.operands);
+    record.outstanding = spec.reads.size();
+    record.writing_back = false;
+    record.start_cycle = clk;
+    record.ready_cycle = clk;
+    record.write_cycle = clk;
+    CheckPlacement(spec, record);
+
+    if (spec.reads.empty()) {
+        wheel_[(clk + spec.latency) & wheel_mask_].push_back(slot);
+        return;
+    }
+    for (auto operand : spec.reads) {
+        Issue(slot, operand, false);
+    }
+}
+
+void CiMEngine::Issue(uint32_t slot, int operand, bool is_write) {
+    uint64_t addr = records_[slot].operands[operand];
+    Transaction trans(addr, is_write);
+    trans.is_cim = true;
+    trans.req_id = slot;
+    ctrls_[config_.AddressMapping(addr).channel]->AddTransaction(trans);
+}
+
+void CiMEngine::TransactionDone(const Transaction &trans, uint64_t clk) {
+    uint32_t slot = trans.req_id;
+    CiMRecord &record = records_[slot];
+    if (--record.outstanding > 0) {
+        return;
+    }
+    if (record.writing_back) {
+        Complete(slot, clk);
+    } else {
+        // operands read, write back once the result is computed
+        int latency = config_.cim_ops[record.op].latency;
+        record.ready_cycle = clk;
+        wheel_[(clk + latency) & wheel_mask_].push_back(slot);
+    }
+}
+
+void CiMEngine::ClockTick(uint64_t clk) {
+    auto &due = wheel_[clk & wheel_mask_];
+    for (auto slot : due) {
+        CiMRecord &record = records_[slot];
+        const CiMOpSpec &spec = config_.cim_ops[record.op];
+        record.write_cycle = clk;
+        if (spec.writes.empty()) {
+            Complete(slot, clk);
+            continue;
+        }
+        record.writing_back = true;
+        record.outstanding = spec.writes.size();
+        for (auto operand : spec.writes) {
+            Issue(slot, operand, true);
+        }
+    }
+    due.clear();
+    if (!bulk_.empty()) {
+        StartBulkElements(clk);
+    }
+}
+
+void CiMEngine::Complete(uint32_t slot, uint64_t clk) {
+    const CiMRecord &record = records_[slot];
+    int channel = config_.AddressMapping(record.operands[0]).channel;
+    ctrls_[channel]->RecordCiMOp(record.op,
+                                 record.ready_cycle - record.start_cycle,
+                                 record.write_cycle - record.ready_cycle,
+                                 clk - record.write_cycle);
+    free_records_.push_back(slot);
+}
+
+void CiMEngine::SaveState(CheckpointWriter &ckpt, uint64_t clk) const {
+    ckpt.Write(static_cast<uint64_t>(records_.size()));
+    for (const auto &record : records_) {
+        ckpt.Write(record.op);
+        for (auto operand : record.operands) {
+            ckpt.Write(operand);
+        }
+        ckpt.Write(record.outstanding);
+        ckpt.Write(record.writing_back);
+        ckpt.Write(record.start_cycle);
+        ckpt.Write(record.ready_cycle);
+        ckpt.Write(record.write_cycle);
+    }
+    ckpt.Write(free_records_);
+    ckpt.Write(static_cast<uint64_t>(bulk_.size()));
+    for (const auto &bulk : bulk_) {
+        ckpt.Write(bulk.op);
+        for (auto operand : bulk.operands) {
+            ckpt.Write(operand);
+        }
+        ckpt.Write(bulk.stride);
+        ckpt.Write(bulk.order);
+        ckpt.Write(static_cast<uint64_t>(bulk.next));
+    }
+    // the wheel size follows the latencies, which may differ in the run
+    // that restores, so save the cycle each operation is due at
+    std::vector<std::pair<uint64_t, uint32_t>> due_slots;
+    for (uint64_t i = 0; i < wheel_.size(); i++) {
+        uint64_t due = clk + ((i - clk) & wheel_mask_);
+        for (auto slot : wheel_[i]) {
+            due_slots.emplace_back(due, slot);
+        }
+    }
+    ckpt.Write(due_slots);
+}
+
+void CiMEngine::LoadState(CheckpointReader &ckpt, uint64_t clk) {
+    uint64_t num_records = 0;
+    ckpt.Read(num_records);
+    records_.resize(num_records);
+    for (auto &record : records_) {
+        ckpt.Read(record.op);
+        for (auto &operand : record.operands) {
+            ckpt.Read(operand);
+        }
+        ckpt.Read(record.outstanding);
+        ckpt.Read(record.writing_back);
+        ckpt.Read(record.start_cycle);
+        ckpt.Read(record.ready_cycle);
+        ckpt.Read(record.write_cycle);
+    }
+    ckpt.Read(free_records_);
+    uint64_t num_bulk = 0;
+    ckpt.Read(num_bulk);
+    bulk_.resize(num_bulk);
+    for (auto &bulk : bulk_) {
+        ckpt.Read(bulk.op);
+        for (auto &operand : bulk.operands) {
+            ckpt.Read(operand);
+        }
+        ckpt.Read(bulk.stride);
+        ckpt.Read(bulk.order);
+        uint64_t next = 0;
+        ckpt.Read(next);
+        bulk.next = next;
+    }
+    std::vector<std::pair<uint64_t, uint32_t>> due_slots;
+    ckpt.Read(due_slots);
+    uint64_t wheel_size = wheel_.size();
+    for (const auto &it : due_slots) {
+        while (it.first - clk >= wheel_size) {
+            wheel_size <<= 1;
+        }
+    }
+    wheel_.assign(wheel_size, std::vector<uint32_t>());
+    wheel_mask_ = wheel_size - 1;
+    for (const auto &it : due_slots) {
+        wheel_[it.first & wheel_mask_].push_back(it.second);
+    }
+}
+
+}  // namespace dramsim3
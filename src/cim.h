@@ -0,0 +1,85 @@
+#ifndef __CIM_H
+#define __CIM_H
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "checkpoint.h"
+#include "common.h"
+#include "configuration.h"
+#include "controller.h"
+
+namespace dramsim3 {
+
+// One CiM operation from its first read to the end of its write back.
+// Records are pooled, the DRAM transactions of an operation carry the index
+// of its record in req_id.
+struct CiMRecord {
+    int op;  // index into Config::cim_ops
+    uint64_t operands[3];
+    int outstanding;  // DRAM transactions of the current phase in flight
+    bool writing_back;
+    uint64_t start_cycle;
+    uint64_t ready_cycle;  // operands read
+    uint64_t write_cycle;  // result computed, write back issued
+};
+
+// A vector CiM operation over count elements, element i has the operands of
+// element 0 moved by i * stride. Elements are started one by one as the
+// controllers accept them.
+struct CiMBulk {
+    int op;
+    uint64_t operands[3];
+    uint64_t stride;
+    std::vector<uint32_t> order;  // element indices in start order
+    size_t next;                  // elements started so far
+};
+
+// Runs the operations of Config::cim_ops on top of plain DRAM reads and
+// writes, shared by the JEDEC and HMC systems. An operation reads its input
+// operands, computes for its latency, then writes its results; the owner
+// hands every returned is_cim transaction back through TransactionDone.
+// Cycles are DRAM cycles, completed operations are recorded in the stats of
+// the channel of their first operand.
+class CiMEngine {
+   public:
+    CiMEngine(const Config &config, std::vector<Controller *> &ctrls);
+    // unknown operations abort
+    bool WillAcceptTransaction(const Transaction &trans) const;
+    // operands that are not local to the placement of the operation abort,
+    // trans.cim_count > 1 makes it a vector operation
+    void AddTransaction(const Transaction &trans, uint64_t clk);
+    void TransactionDone(const Transaction &trans, uint64_t clk);
+    // issues the write backs due at clk and starts vector elements
+    void ClockTick(uint64_t clk);
+    bool IsIdle() const {
+        return bulk_.empty() && free_records_.size() == records_.size();
+    }
+    void SaveState(CheckpointWriter &ckpt, uint64_t clk) const;
+    void LoadState(CheckpointReader &ckpt, uint64_t clk);
+
+   private:
+    int FindOp(uint64_t op_id) const;
+    bool CanStart(const CiMOpSpec &spec, const uint64_t *operands) const;
+    void StartOp(int op, const uint64_t *operands, uint64_t clk);
+    void StartBulkElements(uint64_t clk);
+    void CheckPlacement(const CiMOpSpec &spec, const CiMRecord &record) const;
+    void Issue(uint32_t slot, int operand, bool is_write);
+    void Complete(uint32_t slot, uint64_t clk);
+
+    const Config &config_;
+    std::vector<Controller *> &ctrls_;
+    std::unordered_map<uint64_t, int> op_index_;
+    std::vector<CiMRecord> records_;
+    std::vector<uint32_t> free_records_;
+    std::deque<CiMBulk> bulk_;
+    // operations waiting for the compute latency, slot clk & mask is due at
+    // clk; sized above the largest latency so slots never wrap onto each
+    // other
+    std::vector<std::vector<uint32_t>> wheel_;
+    uint64_t wheel_mask_;
+};
+
+}  // namespace dramsim3
+#endif
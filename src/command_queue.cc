@@ -44,7 +44,7 @@ Command CommandQueue::GetCommandToIssue() {
         }
         auto cmd = GetFirstReadyInQueue(queue);
         if (cmd.IsValid()) {
-            if (cmd.IsReadWrite()) {
+            if (cmd.IsColumnCMD() || cmd.cmd_type == CommandType::CLONE_FPM) {
                 EraseRWCommand(cmd);
             }
             return cmd;
@@ -109,13 +109,36 @@ bool CommandQueue::ArbitratePrecharge(const CMDIterator& cmd_it,
     return false;
 }
 
+bool CommandQueue::ArbitrateDevicePrecharge(const Command& pre) const {
+    if (channel_state_.RowHitCount(pre.Rank(), pre.Bankgroup(), pre.Bank()) >=
+        4) {
+        return true;
+    }
+    int open_row =
+        channel_state_.OpenRow(pre.Rank(), pre.Bankgroup(), pre.Bank());
+    const auto& queue =
+        queues_[GetQueueIndex(pre.Rank(), pre.Bankgroup(), pre.Bank())];
+    for (const auto& cmd : queue) {
+        if (!cmd.IsPIM() && !cmd.IsRowClone() && cmd.Row() == open_row &&
+            cmd.Bank() == pre.Bank() && cmd.Bankgroup() == pre.Bankgroup() &&
+            cmd.Rank() == pre.Rank()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool CommandQueue::WillAcceptCommand(int rank, int bankgroup, int bank) const {
     int q_idx = GetQueueIndex(rank, bankgroup, bank);
     return queues_[q_idx].size() < queue_size_;
 }
 
+bool CommandQueue::WillAcceptCommand(const Command& cmd) const {
+    return queues_[GetQueueIndex(cmd)].size() < queue_size_;
+}
+
 bool CommandQueue::QueueEmpty() const {
-    for (const auto q : queues_) {
+    for (const auto &q : queues_) {
         if (!q.empty()) {
             return false;
         }
@@ -125,7 +148,7 @@ bool CommandQueue::QueueEmpty() const {
 
 
 bool CommandQueue::AddCommand(Command cmd) {
-    auto& queue = GetQueue(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
+    auto& queue = queues_[GetQueueIndex(cmd)];
     if (queue.size() < queue_size_) {
         queue.push_back(cmd);
         rank_q_empty[cmd.Rank()] = false;
@@ -170,17 +193,32 @@ int CommandQueue::GetQueueIndex(int rank, int bankgroup, int bank) const {
     }
 }
 
-CMDQueue& CommandQueue::GetQueue(int rank, int bankgroup, int bank) {
-    int index = GetQueueIndex(rank, bankgroup, bank);
-    return queues_[index];
+int CommandQueue::GetQueueIndex(const Command& cmd) const {
+    if (cmd.IsPIM() || cmd.IsRowClone()) {
+        return GetQueueIndex(cmd.Rank(), 0, 0);
+    }
+    return GetQueueIndex(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
 }
 
 Command CommandQueue::GetFirstReadyInQueue(CMDQueue& queue) const {
     for (auto cmd_it = queue.begin(); cmd_it != queue.end(); cmd_it++) {
+        bool is_device_op = cmd_it->IsPIM() || cmd_it->IsRowClone();
+        if (is_device_op && HasDeviceOpDependency(cmd_it, queue)) {
+            continue;
+        }
         Command cmd = channel_state_.GetReadyCommand(*cmd_it, clk_);
         if (!cmd.IsValid()) {
             continue;
         }
+        if (is_device_op) {
+            // PIM and RowClone operations close the rows in their way once
+            // the row hits pending there are served, up to the same limit
+            if (cmd.cmd_type == CommandType::PRECHARGE &&
+                !ArbitrateDevicePrecharge(cmd)) {
+                continue;
+            }
+            return cmd;
+        }
         if (cmd.cmd_type == CommandType::PRECHARGE) {
             if (!ArbitratePrecharge(cmd_it, queue)) {
                 continue;
@@ -196,7 +234,7 @@ Command CommandQueue::GetFirstReadyInQueue(CMDQueue& queue) const {
 }
 
 void CommandQueue::EraseRWCommand(const Command& cmd) {
-    auto& queue = GetQueue(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
+    auto& queue = queues_[GetQueueIndex(cmd)];
     for (auto cmd_it = queue.begin(); cmd_it != queue.end(); cmd_it++) {
         if (cmd.hex_addr == cmd_it->hex_addr && cmd.cmd_type == cmd_it->cmd_type) {
             queue.erase(cmd_it);
@@ -229,4 +267,44 @@ bool CommandQueue::HasRWDependency(const CMDIterator& cmd_it,
     return false;
 }
 
+bool CommandQueue::HasDeviceOpDependency(const CMDIterator& cmd_it,
+                                         const CMDQueue& queue) const {
+    // PIM and RowClone commands of a rank share a queue and go in order, and
+    // wait for a pending refresh of the rank as they would reopen the banks
+    // it closes
+    if (is_in_ref_ && channel_state_.IsRefreshWaiting() &&
+        channel_state_.PendingRefCommand().Rank() == cmd_it->Rank()) {
+        return true;
+    }
+    for (auto it = queue.begin(); it != cmd_it; it++) {
+        if ((it->IsPIM() || it->IsRowClone()) && it->Rank() == cmd_it->Rank()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CommandQueue::SaveState(CheckpointWriter& ckpt) const {
+    ckpt.Write(rank_q_empty);
+    for (const auto& queue : queues_) {
+        ckpt.Write(queue);
+    }
+    ckpt.Write(ref_q_indices_);
+    ckpt.Write(is_in_ref_);
+    ckpt.Write(queue_idx_);
+    ckpt.Write(clk_);
+}
+
+void CommandQueue::LoadState(CheckpointReader& ckpt) {
+    ckpt.Read(rank_q_empty);
+    // load queues in place to keep their reserved capacity
+    for (auto& queue : queues_) {
+        ckpt.Read(queue);
+    }
+    ckpt.Read(ref_q_indices_);
+    ckpt.Read(is_in_ref_);
+    ckpt.Read(queue_idx_);
+    ckpt.Read(clk_);
+}
+
 }  // namespace dramsim3
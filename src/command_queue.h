@@ -4,6 +4,7 @@
 #include <unordered_set>
 #include <vector>
 #include "channel_state.h"
+#include "checkpoint.h"
 #include "common.h"
 #include "configuration.h"
 #include "simple_stats.h"
@@ -21,20 +22,30 @@ class CommandQueue {
     Command GetCommandToIssue();
     Command FinishRefresh();
     void ClockTick() { clk_ += 1; };
+    void FastForward(uint64_t clk) { clk_ = clk; }
     bool WillAcceptCommand(int rank, int bankgroup, int bank) const;
+    bool WillAcceptCommand(const Command& cmd) const;
     bool AddCommand(Command cmd);
     bool QueueEmpty() const;
     int QueueUsage() const;
+    void SaveState(CheckpointWriter& ckpt) const;
+    void LoadState(CheckpointReader& ckpt);
     std::vector<bool> rank_q_empty;
 
    private:
     bool ArbitratePrecharge(const CMDIterator& cmd_it,
                             const CMDQueue& queue) const;
+    // precharge a PIM or RowClone operation needs in another bank
+    bool ArbitrateDevicePrecharge(const Command& pre) const;
     bool HasRWDependency(const CMDIterator& cmd_it,
                          const CMDQueue& queue) const;
+    bool HasDeviceOpDependency(const CMDIterator& cmd_it,
+                               const CMDQueue& queue) const;
     Command GetFirstReadyInQueue(CMDQueue& queue) const;
     int GetQueueIndex(int rank, int bankgroup, int bank) const;
-    CMDQueue& GetQueue(int rank, int bankgroup, int bank);
+    // PIM and RowClone commands of a rank all go to the queue of its first
+    // bank so that they stay in order
+    int GetQueueIndex(const Command& cmd) const;
     CMDQueue& GetNextQueue();
     void GetRefQIndices(const Command& ref);
     void EraseRWCommand(const Command& cmd);
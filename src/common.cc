@@ -1,5 +1,6 @@
 #include "common.h"
 #include "fmt/format.h"
+#include <algorithm>
 #include <sstream>
 #include <unordered_set>
 #include <sys/stat.h>
@@ -18,6 +19,11 @@ std::ostream& operator<<(std::ostream& os, const Command& cmd) {
         "refresh",
         "self_refresh_enter",
         "self_refresh_exit",
+        "pim_activate",
+        "pim_compute",
+        "pim_writeback",
+        "clone_fpm",
+        "clone_psm",
         "WRONG"};
     os << fmt::format("{:<20} {:>3} {:>3} {:>3} {:>3} {:>#8x} {:>#8x}",
                       command_string[static_cast<int>(cmd.cmd_type)],
@@ -35,25 +41,115 @@ std::ostream& operator<<(std::ostream& os, const Transaction& trans) {
 std::istream& operator>>(std::istream& is, Transaction& trans) {
     std::unordered_set<std::string> write_types = {"WRITE", "write", "P_MEM_WR",
                                                    "BOFF"};
-    /*Some CIM operations have two addresses. Ex: CIM_ADD, CIM_XOR, CIM_SWAP*/
-    std::unordered_set<std::string> cim_operations_with_two_addresses = {"CIM_ADD","CIM_SWAP","CIM_XOR" };
-    std::unordered_set<std::string> cim_operations = { "CIM_ADD","CIM_SWAP","CIM_XOR" };
     std::string mem_op;
-    is >> std::hex >> trans.addr ;
+    is >> std::hex >> trans.addr >> mem_op;
+    trans.addr2 = 0;
     trans.addr3 = 0;
-    is >> mem_op;
-    if (cim_operations_with_two_addresses.count(mem_op) == 1)//Store the second address
-        is >> std::hex >> trans.addr2;
-    if(mem_op == "CIM_ADD" || mem_op == "CIM_XOR")
-        is >> std::hex >> trans.addr3;
-    is>> std::dec >> trans.added_cycle;
-    trans.is_write = write_types.count(mem_op) == 1;
-    trans.is_read = mem_op == "READ";
-    trans.is_cim_add = mem_op == "CIM_ADD";
-    trans.is_cim_swap = mem_op == "CIM_SWAP";
-    trans.is_cim_xor = mem_op == "CIM_XOR";
-    trans.is_cim_fetch = mem_op == "CIM_FETCH";
-    trans.is_cim_store = mem_op == "CIM_STORE";
+    trans.cim_op = 0;
+    trans.pim_op = PIMOp::NONE;
+    trans.clone_op = RowCloneOp::NONE;
+    trans.atomic_op = AtomicOp::NONE;
+    trans.size = 0;
+    if (mem_op == "ROW_COPY") {
+        // the source row comes before the cycle
+        is >> trans.addr2 >> std::dec >> trans.added_cycle;
+        trans.clone_op = RowCloneOp::COPY;
+        trans.is_write = false;
+        trans.is_read = false;
+        return is;
+    } else if (mem_op == "ROW_INIT") {
+        is >> std::dec >> trans.added_cycle;
+        trans.clone_op = RowCloneOp::INIT;
+        trans.is_write = false;
+        trans.is_read = false;
+        return is;
+    } else if (mem_op.compare(0, 4, "HMC_") == 0) {
+        // HMC atomics go by their name in the HMC spec, in AtomicOp order
+        static const std::vector<std::string> atomic_names = {
+            "2ADD8",  "ADD16",  "P_2ADD8", "P_ADD16",   "2ADDS8R",
+            "ADDS16R", "INC8",  "P_INC8",  "XOR16",     "OR16",
+            "NOR16",  "AND16",  "NAND16",  "CASGT8",    "CASGT16",
+            "CASLT8", "CASLT16", "CASEQ8", "CASZERO16", "EQ8",
+            "EQ16",   "BWR",    "P_BWR",   "BWR8R",     "SWAP16"};
+        auto it = std::find(atomic_names.begin(), atomic_names.end(),
+                            mem_op.substr(4));
+        if (it == atomic_names.end()) {
+            std::cerr << "Unknown HMC atomic operation: " << mem_op
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        is >> std::dec >> trans.added_cycle;
+        trans.atomic_op =
+            static_cast<AtomicOp>(it - atomic_names.begin() + 1);
+        trans.is_write = false;
+        trans.is_read = false;
+        return is;
+    }
+    bool is_pim = mem_op.compare(0, 4, "PIM_") == 0;
+    if (mem_op.compare(0, 4, "CIM_") != 0 && !is_pim) {
+        // reads and writes may give their size in bytes after the cycle
+        std::string line;
+        std::getline(is, line);
+        std::istringstream fields(line);
+        fields >> std::dec >> trans.added_cycle;
+        if (!(fields >> trans.size)) {
+            trans.size = 0;
+        }
+        trans.is_write = write_types.count(mem_op) == 1;
+        trans.is_read = !trans.is_write;
+        return is;
+    }
+
+    // CiM operations carry up to 2 more (hex) operands before the cycle,
+    // vector ones (suffix .V) the element count and stride in between
+    bool is_vector = mem_op.size() > 2 &&
+                     mem_op.compare(mem_op.size() - 2, 2, ".V") == 0;
+    if (is_vector) {
+        mem_op.resize(mem_op.size() - 2);
+    }
+    std::string line, field;
+    std::getline(is, line);
+    std::istringstream fields(line);
+    std::vector<std::string> values;
+    while (fields >> field) {
+        values.push_back(field);
+    }
+    trans.is_write = false;
+    trans.is_read = false;
+    trans.cim_stride = 0;
+    if (is_pim) {
+        // all-bank operations take the number of columns before the cycle
+        if ((mem_op != "PIM_MAC" && mem_op != "PIM_ADD") || values.empty() ||
+            values.size() > 2) {
+            std::cerr << "Bad PIM trace line: " << std::hex << trans.addr
+                      << " " << mem_op << line << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        trans.pim_op = mem_op == "PIM_MAC" ? PIMOp::MAC : PIMOp::ADD;
+        trans.cim_count = values.size() == 2 ? std::stoul(values[0]) : 1;
+        trans.added_cycle = std::stoull(values.back());
+        return is;
+    }
+    size_t num_fields = is_vector ? 3 : 1;
+    if (values.size() < num_fields || values.size() > num_fields + 2) {
+        std::cerr << "Bad CiM trace line: " << std::hex << trans.addr << " "
+                  << mem_op << line << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    trans.added_cycle = std::stoull(values.back());
+    trans.cim_count = 1;
+    if (is_vector) {
+        trans.cim_count = std::stoul(values[values.size() - 3]);
+        trans.cim_stride = std::stoull(values[values.size() - 2]);
+        values.resize(values.size() - 2);
+    }
+    if (values.size() > 1) {
+        trans.addr2 = std::stoull(values[0], nullptr, 16);
+    }
+    if (values.size() > 2) {
+        trans.addr3 = std::stoull(values[1], nullptr, 16);
+    }
+    trans.cim_op = CiMOpId(mem_op);
     return is;
 }
 
@@ -95,6 +191,16 @@ void AbruptExit(const std::string& file, int line) {
     std::exit(-1);
 }
 
+uint64_t CiMOpId(const std::string& name) {
+    // 64 bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
 bool DirExist(std::string dir) {
     // courtesy to stackoverflow
     struct stat info;
@@ -6,8 +6,7 @@
 #include <vector>
 
 namespace dramsim3 {
-#define CIM 2
-enum CIM_OPERATIONS{CIM_FETCH,CIM_STORE,CIM_ADD,CIM_XOR,CIM_SWAP};
+
 struct Address {
     Address()
         : channel(-1), rank(-1), bankgroup(-1), bank(-1), row(-1), column(-1) {}
@@ -50,6 +49,9 @@ void StringSplit(const std::string& s, char delim, Out result);
 
 int LogBase2(int power_of_two);
 void AbruptExit(const std::string& file, int line);
+// stable id of a CiM operation name, so traces can be parsed without the
+// operation table
+uint64_t CiMOpId(const std::string& name);
 bool DirExist(std::string dir);
 
 enum class CommandType {
@@ -63,8 +65,18 @@ enum class CommandType {
     REFRESH,
     SREF_ENTER,
     SREF_EXIT,
+    // all-bank processing-in-memory commands, each one works on every bank
+    // of a rank at once: activate a row, compute on a column, write the
+    // result registers back into a column of the open row
+    PIM_ACTIVATE,
+    PIM_COMPUTE,
+    PIM_WRITEBACK,
+    // RowClone bulk copy: FPM copies a row to another row of its subarray
+    // with two back to back activations and a precharge, PSM moves one
+    // column between two banks over the internal bus
+    CLONE_FPM,
+    CLONE_PSM,
     SIZE
-    
 };
 
 struct Command {
@@ -87,6 +99,21 @@ struct Command {
                cmd_type == CommandType ::WRITE_PRECHARGE;
     }
     bool IsReadWrite() const { return IsRead() || IsWrite(); }
+    bool IsPIM() const {
+        return cmd_type == CommandType::PIM_ACTIVATE ||
+               cmd_type == CommandType::PIM_COMPUTE ||
+               cmd_type == CommandType::PIM_WRITEBACK;
+    }
+    bool IsRowClone() const {
+        return cmd_type == CommandType::CLONE_FPM ||
+               cmd_type == CommandType::CLONE_PSM;
+    }
+    // commands that address a column, the rest only address rows or banks
+    bool IsColumnCMD() const {
+        return IsReadWrite() || cmd_type == CommandType::PIM_COMPUTE ||
+               cmd_type == CommandType::PIM_WRITEBACK ||
+               cmd_type == CommandType::CLONE_PSM;
+    }
     bool IsRankCMD() const {
         return cmd_type == CommandType::REFRESH ||
                cmd_type == CommandType::SREF_ENTER ||
@@ -95,6 +122,7 @@ struct Command {
     
     CommandType cmd_type;
     Address addr;
+    // physical address, for CLONE_PSM the one of the destination column
     uint64_t hex_addr;
 
     int Channel() const { return addr.channel; }
@@ -107,64 +135,165 @@ struct Command {
     friend std::ostream& operator<<(std::ostream& os, const Command& cmd);
 };
 
+// All-bank PIM operation of a transaction. MAC accumulates the columns of a
+// row into a register per bank and writes the sum back once, ADD updates
+// every column and writes each one back.
+enum class PIMOp { NONE, MAC, ADD };
+
+// RowClone operation of a transaction on the whole row of addr: COPY copies
+// the row of addr2 into it, INIT copies the reserved zero row of its
+// subarray into it
+enum class RowCloneOp { NONE, COPY, INIT };
+
+// HMC atomic request run by the vault logic as a read-modify-write, in the
+// order of the atomic HMCReqTypes; ADD8 and ADDS8R are 2ADD8 and 2ADDS8R
+enum class AtomicOp {
+    NONE,
+    ADD8,
+    ADD16,
+    P_2ADD8,
+    P_ADD16,
+    ADDS8R,
+    ADDS16R,
+    INC8,
+    P_INC8,
+    XOR16,
+    OR16,
+    NOR16,
+    AND16,
+    NAND16,
+    CASGT8,
+    CASGT16,
+    CASLT8,
+    CASLT16,
+    CASEQ8,
+    CASZERO16,
+    EQ8,
+    EQ16,
+    BWR,
+    P_BWR,
+    BWR8R,
+    SWAP16
+};
+
+// Caller supplied metadata of a tagged request
+struct RequestMeta {
+    RequestMeta() : source_id(0), priority(0) {}
+    RequestMeta(int source_id, int priority)
+        : source_id(source_id), priority(priority) {}
+    int source_id;
+    // requests with higher priority are scheduled ahead of lower ones
+    int priority;
+};
+
+// Delivered when a tagged request completes
+struct Completion {
+    uint64_t tag;
+    uint64_t addr;
+    int source_id;
+    bool is_write;
+};
+
 struct Transaction {
-    Transaction() {}
+    Transaction() : Transaction(0, false) {}
     Transaction(uint64_t addr, bool is_write)
         : addr(addr),
           added_cycle(0),
           complete_cycle(0),
           is_write(is_write),
+          size(0),
           addr2(0),
           addr3(0),
           req_id(0),
-          is_read(!is_write) {is_cim=0;}
+          is_read(!is_write),
+          is_part(false),
+          cim_op(0),
+          cim_count(1),
+          cim_stride(0),
+          pim_op(PIMOp::NONE),
+          clone_op(RowCloneOp::NONE),
+          atomic_op(AtomicOp::NONE),
+          is_cim(false),
+          tag(0),
+          source_id(0),
+          priority(0),
+          is_tagged(false) {}
+    Transaction(uint64_t addr, bool is_write, uint64_t tag,
+                const RequestMeta& meta)
+        : Transaction(addr, is_write) {
+        this->tag = tag;
+        source_id = meta.source_id;
+        priority = meta.priority;
+        is_tagged = true;
+    }
     Transaction(const Transaction& tran)
         : addr(tran.addr),
           added_cycle(tran.added_cycle),
           complete_cycle(tran.complete_cycle),
-          is_write(tran.is_write),req_id(0),is_read(false),is_cim_fetch(false),is_cim_store(false),is_cim_add(false),is_cim_swap(false),is_cim_xor(false),is_cim(false) {
-          req_id = tran.req_id;
-          is_read = tran.is_read;
-          is_cim_fetch = tran.is_cim_fetch;
-          is_cim_store = tran.is_cim_store;
-          is_cim_add = tran.is_cim_add;
-          is_cim_xor = tran.is_cim_xor;
-          is_cim_swap = tran.is_cim_swap;
-          is_cim = tran.is_cim;
-          }
-          
-    //Creating new constructors for CIM
-    //For CIM transactions with one memory operands
-    /*Transaction(uint64_t addr1, bool is_cim_fetch, bool is_cim_store)
-                : addr(addr1),added_cycle(0),complete_cycle(0),
-                 addr2(0),addr3(0), is_write(false), is_read(false), is_cim_fetch(is_cim_fetch),
-                is_cim_store(is_cim_store), is_cim_add(false), is_cim_swap(false),is_cim_xor(false) {is_cim=0;} */
-    //For CIM transactions with two memory operands
-    /*Transaction(uint64_t addr1, uint64_t addr2,bool is_cim_add, bool is_cim_swap, bool is_cim_xor)
-                : addr(addr1),added_cycle(0),complete_cycle(0),
-                 addr2(addr2),addr3(addr3), is_write(false), is_read(false), is_cim_fetch(false),
-                is_cim_store(false), is_cim_add(is_cim_add), is_cim_swap(is_cim_swap),is_cim_xor(is_cim_xor) {is_cim=0;}*/
-                
-                
+          is_write(tran.is_write),
+          size(tran.size),
+          addr2(tran.addr2),
+          addr3(tran.addr3),
+          req_id(tran.req_id),
+          is_read(tran.is_read),
+          is_part(tran.is_part),
+          cim_op(tran.cim_op),
+          cim_count(tran.cim_count),
+          cim_stride(tran.cim_stride),
+          pim_op(tran.pim_op),
+          clone_op(tran.clone_op),
+          atomic_op(tran.atomic_op),
+          is_cim(tran.is_cim),
+          tag(tran.tag),
+          source_id(tran.source_id),
+          priority(tran.priority),
+          is_tagged(tran.is_tagged) {}
+
     uint64_t addr;
     uint64_t added_cycle;
     uint64_t complete_cycle;
     bool is_write;
+    // bytes of a read or write, 0 for one burst (request_size_bytes); larger
+    // ones are split into the bursts they cover, writes of less than their
+    // bursts are masked
+    uint32_t size;
     friend std::ostream& operator<<(std::ostream& os, const Transaction& trans);
     friend std::istream& operator>>(std::istream& is, Transaction& trans);
     
-    //Adding member variables for CIM operations
-    uint64_t addr2; //the address of the second operand for CIM_Add and CIM_xor operations
+    // second and third operand of a CiM request
+    uint64_t addr2;
     uint64_t addr3;
+    // id given by the system that issued it, e.g. the CiM operation or the
+    // HMC response slot, returned unchanged with the transaction
     uint64_t req_id;
     bool is_read;
-    bool is_cim_fetch;
-    bool is_cim_store;
-    bool is_cim_add;
-    bool is_cim_swap;
-    bool is_cim_xor;
-    bool is_cim; 
-    
+    // one burst of a split request, req_id is the split slot in the
+    // controller
+    bool is_part;
+    // CiMOpId of the operation of a CiM request, 0 for reads and writes
+    uint64_t cim_op;
+    // vector CiM operation: cim_count elements, cim_stride bytes apart (one
+    // request size if 0); for all-bank PIM operations the number of columns
+    uint32_t cim_count;
+    uint64_t cim_stride;
+    // all-bank PIM operation on the row of addr in every bank of its rank,
+    // starting at the column of addr
+    PIMOp pim_op;
+    RowCloneOp clone_op;
+    AtomicOp atomic_op;
+    // run inside the memory instead of being a plain read or write
+    bool IsOperation() const {
+        return cim_op != 0 || pim_op != PIMOp::NONE ||
+               clone_op != RowCloneOp::NONE || atomic_op != AtomicOp::NONE;
+    }
+    // DRAM access issued by the CiM engine, req_id identifies the operation
+    bool is_cim;
+
+    // set for requests added with a caller supplied tag
+    uint64_t tag;
+    int source_id;
+    int priority;
+    bool is_tagged;
 };
 
 }  // namespace dramsim3
@@ -1,5 +1,7 @@
 #include "configuration.h"
 
+#include <mutex>
+#include <set>
 #include <vector>
 
 #ifdef THERMAL
@@ -8,6 +10,81 @@
 
 namespace dramsim3 {
 
+namespace {
+// output prefixes of all live Config instances in this process, so that
+// concurrent simulations never write to the same stats files
+std::mutex prefix_mutex;
+std::set<std::string> prefixes_in_use;
+
+std::string ClaimOutputPrefix(const std::string& prefix) {
+    std::lock_guard<std::mutex> lock(prefix_mutex);
+    std::string claimed = prefix;
+    for (int i = 1; prefixes_in_use.count(claimed) > 0; i++) {
+        claimed = prefix + "_" + std::to_string(i);
+    }
+    prefixes_in_use.insert(claimed);
+    return claimed;
+}
+
+void ReleaseOutputPrefix(const std::string& prefix) {
+    std::lock_guard<std::mutex> lock(prefix_mutex);
+    prefixes_in_use.erase(prefix);
+}
+
+MemoryBackend BackendFromName(const std::string& name) {
+    if (name == "JEDEC") {
+        return MemoryBackend::JEDEC;
+    } else if (name == "IDEAL") {
+        return MemoryBackend::IDEAL;
+    } else if (name == "BANDWIDTH") {
+        return MemoryBackend::BANDWIDTH;
+    } else if (name == "QUEUEING") {
+        return MemoryBackend::QUEUEING;
+    }
+    std::cerr << "Unknown backend " << name << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+    return MemoryBackend::JEDEC;
+}
+
+HMCTopology TopologyFromName(const std::string& name) {
+    if (name == "DAISY") {
+        return HMCTopology::DAISY;
+    } else if (name == "STAR") {
+        return HMCTopology::STAR;
+    }
+    std::cerr << "Unknown HMC chain topology " << name << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+    return HMCTopology::DAISY;
+}
+
+CiMPlacement PlacementFromName(const std::string& name) {
+    if (name == "BANK") {
+        return CiMPlacement::BANK;
+    } else if (name == "VAULT") {
+        return CiMPlacement::VAULT;
+    } else if (name == "CONTROLLER") {
+        return CiMPlacement::CONTROLLER;
+    }
+    std::cerr << "Unknown CiM placement " << name << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+    return CiMPlacement::CONTROLLER;
+}
+
+// comma separated list, blanks around the items are dropped
+std::vector<std::string> ListFromString(const std::string& str) {
+    std::vector<std::string> items;
+    for (auto item : StringSplit(str, ',')) {
+        size_t begin = item.find_first_not_of(" \t");
+        if (begin == std::string::npos) {
+            continue;
+        }
+        size_t end = item.find_last_not_of(" \t");
+        items.push_back(item.substr(begin, end - begin + 1));
+    }
+    return items;
+}
+}  // namespace
+
 Config::Config(std::string config_file, std::string out_dir)
     : output_dir(out_dir), reader_(new INIReader(config_file)) {
     if (reader_->ParseError() < 0) {
@@ -31,6 +108,8 @@ Config::Config(std::string config_file, std::string out_dir)
     delete (reader_);
 }
 
+Config::~Config() { ReleaseOutputPrefix(output_prefix); }
+
 Address Config::AddressMapping(uint64_t hex_addr) const {
     hex_addr >>= shift_bits;
     int channel = (hex_addr >> ch_pos) & ch_mask;
@@ -42,6 +121,16 @@ Address Config::AddressMapping(uint64_t hex_addr) const {
     return Address(channel, rank, bg, ba, ro, co);
 }
 
+uint64_t Config::ReverseAddressMapping(const Address& addr) const {
+    uint64_t hex_addr = (static_cast<uint64_t>(addr.channel) << ch_pos) |
+                        (static_cast<uint64_t>(addr.rank) << ra_pos) |
+                        (static_cast<uint64_t>(addr.bankgroup) << bg_pos) |
+                        (static_cast<uint64_t>(addr.bank) << ba_pos) |
+                        (static_cast<uint64_t>(addr.row) << ro_pos) |
+                        (static_cast<uint64_t>(addr.column) << co_pos);
+    return hex_addr << shift_bits;
+}
+
 void Config::CalculateSize() {
     // calculate rank and re-calculate channel_size
     devices_per_rank = bus_width / device_width;
@@ -101,6 +190,7 @@ void Config::InitDRAMParams() {
     banks = bankgroups * banks_per_group;
     rows = GetInteger("dram_structure", "rows", 1 << 16);
     columns = GetInteger("dram_structure", "columns", 1 << 10);
+    subarray_rows = GetInteger("dram_structure", "subarray_rows", 512);
     device_width = GetInteger("dram_structure", "device_width", 8);
     BL = GetInteger("dram_structure", "BL", 8);
     num_dies = GetInteger("dram_structure", "num_dies", 1);
@@ -114,7 +204,51 @@ void Config::InitDRAMParams() {
     link_speed = GetInteger("hmc", "link_speed", 15000);  //MHz
     block_size = GetInteger("hmc", "block_size", 64);
     xbar_queue_depth = GetInteger("hmc", "xbar_queue_depth", 16);
+    xbar_bandwidth = GetInteger("hmc", "xbar_bandwidth", 2);
+    num_quads = GetInteger("hmc", "num_quads", 4);
+    num_cubes = GetInteger("hmc", "num_cubes", 1);
+    chain_topology =
+        TopologyFromName(reader.Get("hmc", "chain_topology", "DAISY"));
+    pass_through_latency = GetInteger("hmc", "pass_through_latency", 8);
+    dev_link_bandwidth = GetInteger("hmc", "dev_link_bandwidth", 1);
+    link_tokens = GetInteger("hmc", "link_tokens", 256);
+    serdes_latency = GetInteger("hmc", "serdes_latency", 0);
+    link_error_rate = reader.GetReal("hmc", "link_error_rate", 0.0);
+    link_retry_latency = GetInteger("hmc", "link_retry_latency", 16);
+    atomic_latency = GetInteger("hmc", "atomic_latency", 4);
+    vault_threads = GetInteger("hmc", "vault_threads", 1);
+    skip_idle_logic = reader.GetBoolean("hmc", "skip_idle_logic", true);
     if (IsHMC()) {
+        // xbar arbitration keeps its ports in a 64 bit mask
+        if (num_links < 1 || num_links > 64 || num_quads < 1 ||
+            num_quads * num_cubes > 64 || xbar_bandwidth < 1) {
+            std::cerr << "HMC needs 1 to 64 links and quads and a positive "
+                         "xbar_bandwidth"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        if (num_cubes < 1 || num_cubes > 8 ||
+            (num_cubes & (num_cubes - 1)) != 0 || dev_link_bandwidth < 1 ||
+            pass_through_latency < 0) {
+            std::cerr << "HMC chains have 1, 2, 4 or 8 cubes and links with "
+                         "a positive bandwidth"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        // a link must take the largest packet, 17 flits
+        if (link_tokens < 17 || serdes_latency < 0 || link_error_rate < 0 ||
+            link_error_rate >= 1 || link_retry_latency < 0) {
+            std::cerr << "HMC links need at least 17 tokens and an error rate "
+                         "below 1"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        if (atomic_latency < 0 || vault_threads < 1) {
+            std::cerr << "HMC needs a non-negative atomic_latency and at "
+                         "least 1 vault thread"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
         // the BL for HMC is determined by max block_size, which is a multiple
         // of 32B, each "device" transfer 32b per half cycle therefore BL is 8
         // for 32B block size
@@ -161,6 +295,40 @@ void Config::InitOtherParams() {
     // 1: default value, adds epoch CSV output on level 0
     // 2: adds histogram outputs in a different CSV format
     output_level = reader.GetInteger("other", "output_level", 1);
+    // sampled simulation: every sample_period cycles, the last epoch is
+    // measured in detail after sample_warmup detailed cycles, the rest is
+    // fast-forwarded functionally
+    sample_period = GetInteger("other", "sample_period", 0);
+    sample_warmup = GetInteger("other", "sample_warmup", 10000);
+    if (IsSampling()) {
+        if (IsHMC() || backend != MemoryBackend::JEDEC) {
+            std::cerr << "Sampled simulation is only supported for the JEDEC "
+                         "backend"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        if (sample_period % epoch_period != 0 ||
+            sample_period < epoch_period + sample_warmup) {
+            std::cerr << "sample_period must be a multiple of epoch_period "
+                         "and cover epoch_period + sample_warmup"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+    }
+    if (IsHybrid()) {
+        if (IsHMC() || IsSampling() || backend != MemoryBackend::JEDEC) {
+            std::cerr << "fast_backend needs the JEDEC backend and no sampling"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        for (size_t i = 1; i < fidelity_switch_cycles.size(); i++) {
+            if (fidelity_switch_cycles[i] <= fidelity_switch_cycles[i - 1]) {
+                std::cerr << "fidelity_switch_cycles must be increasing"
+                          << std::endl;
+                AbruptExit(__FILE__, __LINE__);
+            }
+        }
+    }
     // Other Parameters
     // give a prefix instead of specify the output name one by one...
     // this would allow outputing to a directory and you can always override
@@ -173,8 +341,14 @@ void Config::InitOtherParams() {
     } else {
         output_dir = output_dir + "/";
     }
-    output_prefix =
+    std::string prefix =
         output_dir + reader.Get("other", "output_prefix", "dramsim3");
+    output_prefix = ClaimOutputPrefix(prefix);
+    if (output_prefix != prefix) {
+        std::cout << "WARNING: Output prefix " << prefix
+                  << " is used by another instance, writing to "
+                  << output_prefix << " instead" << std::endl;
+    }
     json_stats_name = output_prefix + ".json";
     json_epoch_name = output_prefix + "epoch.json";
     txt_stats_name = output_prefix + ".txt";
@@ -212,6 +386,15 @@ void Config::InitPowerParams() {
     pre_stb_energy_inc = VDD * IDD2N * devices;
     pre_pd_energy_inc = VDD * IDD2P * devices;
     sref_energy_inc = VDD * IDD6x * devices;
+    // all-bank PIM commands do the work of their single bank counterpart in
+    // every bank
+    pim_act_energy_inc = act_energy_inc * banks;
+    pim_compute_energy_inc = read_energy_inc * banks;
+    pim_wb_energy_inc = write_energy_inc * banks;
+    // FPM activates the source and the destination row, PSM reads a column
+    // in one bank and writes it in another
+    clone_fpm_energy_inc = act_energy_inc * 2;
+    clone_psm_energy_inc = read_energy_inc + write_energy_inc;
     return;
 }
 
@@ -220,6 +403,15 @@ void Config::InitSystemParams() {
     channel_size = GetInteger("system", "channel_size", 1024);
     channels = GetInteger("system", "channels", 1);
     bus_width = GetInteger("system", "bus_width", 64);
+    backend = BackendFromName(reader.Get("system", "backend", "JEDEC"));
+    // hybrid fidelity: start in fast_backend and toggle between it and the
+    // detailed model at each of fidelity_switch_cycles
+    fast_backend =
+        BackendFromName(reader.Get("system", "fast_backend", "JEDEC"));
+    for (const auto& cycle : ListFromString(
+             reader.Get("system", "fidelity_switch_cycles", ""))) {
+        fidelity_switch_cycles.push_back(std::stoull(cycle));
+    }
     address_mapping = reader.Get("system", "address_mapping", "chrobabgraco");
     queue_structure = reader.Get("system", "queue_structure", "PER_BANK");
     row_buf_policy = reader.Get("system", "row_buf_policy", "OPEN_PAGE");
@@ -345,11 +537,69 @@ void Config::InitTimingParams() {
     return;
 }
 
-/*Get CiM Parameters*/
 void Config::InitCiMParams() {
-    CiM_Add_Delay = GetInteger("cim", "CiM_Add_Delay", 100);
-    CiM_Xor_Delay = GetInteger("cim", "CiM_Xor_Delay", 30);
-    CiM_Swap_Delay = GetInteger("cim", "CiM_Swap_Delay", 20);
+    const auto& reader = *reader_;
+    // built in operations, FETCH and STORE move one operand between the
+    // memory and the compute logic
+    cim_ops = {
+        {"CIM_FETCH", 1, {0}, {}, 0, CiMPlacement::CONTROLLER},
+        {"CIM_STORE", 1, {}, {0}, 0, CiMPlacement::CONTROLLER},
+        {"CIM_ADD", 3, {0, 1}, {2}, GetInteger("cim", "CiM_Add_Delay", 100),
+         CiMPlacement::CONTROLLER},
+        {"CIM_XOR", 3, {0, 1}, {2}, GetInteger("cim", "CiM_Xor_Delay", 30),
+         CiMPlacement::CONTROLLER},
+        {"CIM_SWAP", 2, {0, 1}, {0, 1}, GetInteger("cim", "CiM_Swap_Delay", 20),
+         CiMPlacement::CONTROLLER}};
+
+    // more operations are declared by name, e.g.
+    //   ops = CIM_MAC
+    //   CIM_MAC.operands = 3
+    //   CIM_MAC.reads = 0, 1, 2
+    //   CIM_MAC.writes = 2
+    //   CIM_MAC.latency = 40
+    //   CIM_MAC.placement = BANK
+    for (const auto& name : ListFromString(reader.Get("cim", "ops", ""))) {
+        if (name.compare(0, 4, "CIM_") != 0) {
+            std::cerr << "CiM operation " << name << " must start with CIM_"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        for (const auto& op : cim_ops) {
+            if (op.name == name) {
+                std::cerr << "CiM operation " << name << " defined twice"
+                          << std::endl;
+                AbruptExit(__FILE__, __LINE__);
+            }
+        }
+        CiMOpSpec op;
+        op.name = name;
+        op.num_operands = GetInteger("cim", name + ".operands", 1);
+        op.latency = GetInteger("cim", name + ".latency", 0);
+        op.placement = PlacementFromName(
+            reader.Get("cim", name + ".placement", "CONTROLLER"));
+        for (const auto& index :
+             ListFromString(reader.Get("cim", name + ".reads", ""))) {
+            op.reads.push_back(std::stoi(index));
+        }
+        for (const auto& index :
+             ListFromString(reader.Get("cim", name + ".writes", ""))) {
+            op.writes.push_back(std::stoi(index));
+        }
+        std::vector<int> operands(op.reads);
+        operands.insert(operands.end(), op.writes.begin(), op.writes.end());
+        bool valid = op.num_operands >= 1 && op.num_operands <= 3 &&
+                     op.latency >= 0 && !operands.empty();
+        for (auto index : operands) {
+            valid = valid && index >= 0 && index < op.num_operands;
+        }
+        if (!valid) {
+            std::cerr << "Invalid CiM operation " << name
+                      << ": 1 to 3 operands, reads/writes are operand indices"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        cim_ops.push_back(op);
+    }
 }
 
 void Config::SetAddressMapping() {
@@ -396,6 +646,7 @@ void Config::SetAddressMapping() {
         pos += field_widths[token];
     }
 
+    cube_pos = pos;
     ch_pos = field_pos.at("ch");
     ra_pos = field_pos.at("ra");
     bg_pos = field_pos.at("bg");
@@ -3,6 +3,7 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
 #include "common.h"
 
 #include "INIReader.h"
@@ -24,6 +25,30 @@ enum class DRAMProtocol {
     SIZE
 };
 
+// JEDEC is the cycle accurate model, the others are analytic models for
+// fast first order estimates, see dram_system.h
+enum class MemoryBackend { JEDEC, IDEAL, BANDWIDTH, QUEUEING };
+
+// Where the compute logic of a CiM operation sits, all operands have to be
+// local to it: in one bank, in one channel (vault), or anywhere
+enum class CiMPlacement { BANK, VAULT, CONTROLLER };
+
+// How chained HMC cubes connect: a chain where cube i passes through cubes
+// 0..i-1, or a star where cube 0 links every other cube to the host
+enum class HMCTopology { DAISY, STAR };
+
+// A compute-in-memory operation. A CiM request carries up to 3 operand
+// addresses (addr, addr2, addr3 of Transaction), the operation reads some of
+// them, computes for latency DRAM cycles, then writes some of them
+struct CiMOpSpec {
+    std::string name;  // trace mnemonic, starts with CIM_
+    int num_operands;
+    std::vector<int> reads;   // operand indices
+    std::vector<int> writes;  // operand indices
+    int latency;
+    CiMPlacement placement;
+};
+
 enum class RefreshPolicy {
     RANK_LEVEL_SIMULTANEOUS,  // impractical due to high power requirement
     RANK_LEVEL_STAGGERED,
@@ -34,7 +59,13 @@ enum class RefreshPolicy {
 class Config {
    public:
     Config(std::string config_file, std::string out_dir);
+    ~Config();
+    // the output prefix is owned by this instance until it is destroyed
+    Config(const Config&) = delete;
+    Config& operator=(const Config&) = delete;
     Address AddressMapping(uint64_t hex_addr) const;
+    // first byte of the request at addr
+    uint64_t ReverseAddressMapping(const Address& addr) const;
     // DRAM physical structure
     DRAMProtocol protocol;
     int channel_size;
@@ -45,6 +76,8 @@ class Config {
     int banks_per_group;
     int rows;
     int columns;
+    // rows sharing the sense amplifiers of a subarray, for RowClone
+    int subarray_rows;
     int device_width;
     int bus_width;
     int devices_per_rank;
@@ -110,6 +143,11 @@ class Config {
     double pre_stb_energy_inc;
     double pre_pd_energy_inc;
     double sref_energy_inc;
+    double pim_act_energy_inc;
+    double pim_compute_energy_inc;
+    double pim_wb_energy_inc;
+    double clone_fpm_energy_inc;
+    double clone_psm_energy_inc;
 
     // HMC
     int num_links;
@@ -119,8 +157,36 @@ class Config {
     int num_vaults;
     int block_size;  // block size in bytes
     int xbar_queue_depth;
+    int xbar_bandwidth;  // flits per logic cycle through each xbar port
+    int num_quads;
+    // chained cubes, only cube 0 has host links; the cube id is taken from
+    // the address bits above one cube, i.e. from cube_pos of the shifted
+    // address
+    int num_cubes;
+    int cube_pos;
+    HMCTopology chain_topology;
+    int pass_through_latency;  // logic cycles per device-to-device hop
+    int dev_link_bandwidth;    // flits per logic cycle of such a link
+    // host link layer: flow control tokens (flits of the link input buffer),
+    // SerDes latency and packets replayed after a CRC error
+    int link_tokens;
+    int serdes_latency;      // logic cycles
+    double link_error_rate;  // per packet
+    int link_retry_latency;  // logic cycles until a replay starts
+    // DRAM cycles of the vault atomic unit between the read and the write
+    // of an atomic request
+    int atomic_latency;
+    // threads ticking the vault controllers, 1 ticks them on the calling
+    // thread
+    int vault_threads;
+    // jump over logic cycles in which no packet can move, off only to
+    // check the jump
+    bool skip_idle_logic;
 
     // System
+    MemoryBackend backend;
+    MemoryBackend fast_backend;
+    std::vector<uint64_t> fidelity_switch_cycles;
     std::string address_mapping;
     std::string queue_structure;
     std::string row_buf_policy;
@@ -137,6 +203,9 @@ class Config {
 
     int epoch_period;
     int output_level;
+    // sampled simulation, 0 period means every cycle is simulated in detail
+    int sample_period;
+    int sample_warmup;
     std::string output_dir;
     std::string output_prefix;
     std::string json_stats_name;
@@ -156,6 +225,13 @@ class Config {
                 protocol == DRAMProtocol::HBM2);
     }
     bool IsHMC() const { return (protocol == DRAMProtocol::HMC); }
+    // column bursts of a request of size bytes, one for size 0
+    int Bursts(uint32_t size) const {
+        uint32_t burst = request_size_bytes;
+        return size <= burst ? 1 : (size + burst - 1) / burst;
+    }
+    bool IsSampling() const { return sample_period > 0; }
+    bool IsHybrid() const { return fast_backend != MemoryBackend::JEDEC; }
     // yzy: add another function
     bool IsDDR4() const { return (protocol == DRAMProtocol::DDR4); }
 
@@ -182,10 +258,8 @@ class Config {
     double bank_asr;  // the aspect ratio of a bank: #row_bits / #col_bits
 #endif  // THERMAL
 
-  //CiM Parameters
-  int CiM_Add_Delay;
-  int CiM_Xor_Delay;
-  int CiM_Swap_Delay;
+    // CiM operations, the built in ones followed by those of [cim] ops
+    std::vector<CiMOpSpec> cim_ops;
 
    private:
     INIReader* reader_;
@@ -42,11 +42,12 @@ Controller::Controller(int channel, const Config &config, const Timing &timing)
 #endif  // CMD_TRACE
 }
 
-std::pair<uint64_t, int> Controller::ReturnDoneTrans(uint64_t clk) {
+bool Controller::ReturnDoneTrans(uint64_t clk, Transaction &trans) {
     auto it = return_queue_.begin();
     while (it != return_queue_.end()) {
         if (clk >= it->complete_cycle) {
-            if (it->is_cim != true) {
+            // stats count bursts, a split request returns after its parts
+            if (it->is_cim != true && config_.Bursts(it->size) == 1) {
                 if (it->is_write) {
                     simple_stats_.Increment("num_writes_done");
                 }
@@ -54,21 +55,25 @@ std::pair<uint64_t, int> Controller::ReturnDoneTrans(uint64_t clk) {
                     simple_stats_.Increment("num_reads_done");
                     simple_stats_.AddValue("read_latency", clk_ - it->added_cycle);
                 }
-                auto pair = std::make_pair(it->addr, it->is_write);
-                it = return_queue_.erase(it);
-                return pair;
             }
-            else {
-                    auto pair = std::make_pair(it->req_id, CIM);
-                    it = return_queue_.erase(it);
-                    return pair;
-
+            if (it->is_part) {
+                uint32_t slot = it->req_id;
+                return_queue_.erase(it);
+                if (--splits_[slot].parts_left == 0) {
+                    splits_[slot].trans.complete_cycle = clk;
+                    return_queue_.push_back(splits_[slot].trans);
+                    free_splits_.push_back(slot);
+                }
+                it = return_queue_.begin();
+                continue;
             }
-
+            trans = *it;
+            return_queue_.erase(it);
+            return true;
         }
         ++it;
     }
-    return std::make_pair(-1, -1);
+    return false;
 }
 
 void Controller::ClockTick() {
@@ -93,7 +98,7 @@ void Controller::ClockTick() {
         if (config_.enable_hbm_dual_cmd) {
             auto second_cmd = cmd_queue_.GetCommandToIssue();
             if (second_cmd.IsValid()) {
-                if (second_cmd.IsReadWrite() != cmd.IsReadWrite()) {
+                if (second_cmd.IsColumnCMD() != cmd.IsColumnCMD()) {
                     IssueCommand(second_cmd);
                     simple_stats_.Increment("hbm_dual_cmds");
                 }
@@ -166,61 +171,211 @@ bool Controller::WillAcceptTransaction(uint64_t hex_addr, bool is_write) const {
         return write_buffer_.size() < write_buffer_.capacity();
     }
 }
-//Overloading for CIM
-bool Controller::WillAcceptTransaction(uint64_t hex_addr, int no_of_reads, int no_of_writes) const {
+
+bool Controller::WillAcceptTransaction(uint64_t hex_addr, int num_reads,
+                                       int num_writes) const {
     if (is_unified_queue_) {
-        return unified_queue_.size()+(no_of_reads+ no_of_writes) < unified_queue_.capacity();
+        return unified_queue_.size() + num_reads + num_writes <=
+               unified_queue_.capacity();
+    }
+    return (num_reads == 0 ||
+            read_queue_.size() + num_reads <= read_queue_.capacity()) &&
+           (num_writes == 0 ||
+            write_buffer_.size() + num_writes <= write_buffer_.capacity());
+}
+
+bool Controller::WillAcceptTransaction(const Transaction &trans) const {
+    int bursts = config_.Bursts(trans.size);
+    if (bursts == 1) {
+        return WillAcceptTransaction(trans.addr, trans.is_write);
     }
-    return (read_queue_.size()+ no_of_reads < read_queue_.capacity()) && (write_buffer_.size()+ no_of_writes < write_buffer_.capacity());
+    if (bursts > config_.trans_queue_size) {
+        std::cerr << "A request of " << trans.size << " bytes does not fit "
+                  << "in the transaction queue" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    return WillAcceptTransaction(trans.addr, trans.is_write ? 0 : bursts,
+                                 trans.is_write ? bursts : 0);
+}
+
+bool Controller::WillAcceptDeviceOp() const {
+    return device_ops_.size() < static_cast<size_t>(config_.trans_queue_size);
 }
 
 bool Controller::AddTransaction(Transaction trans) {
-    /* Modifying this function to simulate CIM operations
-       Steps:
-       Step1: Break down the CIM instructions into individual read and write transactions
-       Step2: Event level simulation of CIM operations
-       Step3: Add the transactions to the return queue
-    */
     trans.added_cycle = clk_;
     simple_stats_.AddValue("interarrival_latency", clk_ - last_trans_clk_);
     last_trans_clk_ = clk_;
-    if (trans.is_write || trans.is_cim_store) {
-        //std::cout << "write\n";
-        trans.is_write = true;
+    if (trans.pim_op != PIMOp::NONE || trans.clone_op != RowCloneOp::NONE) {
+        trans.is_read = false;
+        trans.is_write = false;
+        if (trans.pim_op != PIMOp::NONE) {
+            AddPIMOp(trans);
+        } else {
+            AddRowCloneOp(trans);
+        }
+        return true;
+    }
+    if (trans.is_write && trans.size % config_.request_size_bytes != 0) {
+        // the last burst only writes some of its bytes
+        simple_stats_.Increment("num_masked_writes");
+    }
+    int bursts = config_.Bursts(trans.size);
+    if (bursts > 1) {
+        AddSplitTransaction(trans, bursts);
+    } else {
+        AddBurst(trans);
+    }
+    return true;
+}
+
+void Controller::AddSplitTransaction(const Transaction &trans, int bursts) {
+    uint32_t slot;
+    if (free_splits_.empty()) {
+        slot = splits_.size();
+        splits_.emplace_back();
+    } else {
+        slot = free_splits_.back();
+        free_splits_.pop_back();
+    }
+    splits_[slot].trans = trans;
+    splits_[slot].parts_left = bursts;
+    simple_stats_.Increment("num_split_requests");
+    // the bursts holding the bytes of the request, on this channel even if
+    // the mapping interleaves channels below the request size
+    int channel = config_.AddressMapping(trans.addr).channel;
+    for (int i = 0; i < bursts; i++) {
+        Address part_addr = config_.AddressMapping(
+            trans.addr + static_cast<uint64_t>(i) * config_.request_size_bytes);
+        part_addr.channel = channel;
+        Transaction part(config_.ReverseAddressMapping(part_addr),
+                         trans.is_write);
+        part.added_cycle = clk_;
+        part.priority = trans.priority;
+        part.req_id = slot;
+        part.is_part = true;
+        AddBurst(part);
+    }
+}
+
+void Controller::AddBurst(Transaction trans) {
+    if (trans.is_write) {
         if (pending_wr_q_.count(trans.addr) == 0) {  // can not merge writes
             pending_wr_q_.insert(std::make_pair(trans.addr, trans));
-            if (is_unified_queue_) {
-                unified_queue_.push_back(trans);
-            } else {
-                write_buffer_.push_back(trans);
-            }
+            EnqueueTransaction(
+                is_unified_queue_ ? unified_queue_ : write_buffer_, trans);
         }
         trans.complete_cycle = clk_ + 1;
         return_queue_.push_back(trans);
-        return true;
-    } else if(trans.is_read || trans.is_cim_fetch) {  // read
-        //std::cout << "read\n";
+        return;
+    } else {  // read
         // if in write buffer, use the write buffer value
-        trans.is_read = true;
         if (pending_wr_q_.count(trans.addr) > 0) {
             trans.complete_cycle = clk_ + 1;
             return_queue_.push_back(trans);
-            return true;
+            return;
         }
         pending_rd_q_.insert(std::make_pair(trans.addr, trans));
         if (pending_rd_q_.count(trans.addr) == 1) {
-            if (is_unified_queue_) {
-                unified_queue_.push_back(trans);
-            } else {
-                read_queue_.push_back(trans);
-            }
+            EnqueueTransaction(
+                is_unified_queue_ ? unified_queue_ : read_queue_, trans);
+        }
+        return;
+    }
+}
+
+void Controller::EnqueueTransaction(std::vector<Transaction> &queue,
+                                    const Transaction &trans) {
+    // ahead of lower priority transactions, behind everything else
+    auto it = queue.end();
+    while (it != queue.begin() && (it - 1)->priority < trans.priority) {
+        --it;
+    }
+    queue.insert(it, trans);
+}
+
+bool Controller::IsDrained() const {
+    return unified_queue_.empty() && read_queue_.empty() &&
+           write_buffer_.empty() && pending_rd_q_.empty() &&
+           pending_wr_q_.empty() && device_ops_.empty() &&
+           cmd_queue_.QueueEmpty() &&
+           !channel_state_.IsRefreshWaiting();
+}
+
+void Controller::FlushWriteBuffer() {
+    // a few buffered writes would otherwise wait for more writes forever
+    if (write_draining_ == 0 && !is_unified_queue_) {
+        write_draining_ = write_buffer_.size();
+    }
+}
+
+void Controller::FastForward(uint64_t clk) {
+    if (clk <= clk_) {
+        return;
+    }
+    refresh_.FastForward(clk);
+    cmd_queue_.FastForward(clk);
+    clk_ = clk;
+}
+
+void Controller::FunctionalAccess(Transaction trans) {
+    trans.added_cycle = clk_;
+    last_trans_clk_ = clk_;
+    uint64_t latency = UpdateRowState(trans);
+    if (trans.is_write) {
+        // writes are acknowledged once buffered, same as in detailed mode
+        trans.complete_cycle = clk_ + 1;
+    } else {
+        trans.is_read = true;
+        // the bursts of a larger read follow the first one on the open row
+        trans.complete_cycle = clk_ + latency + config_.read_delay +
+                               (config_.Bursts(trans.size) - 1) *
+                                   config_.burst_cycle;
+    }
+    return_queue_.push_back(trans);
+}
+
+void Controller::WarmRowBuffer(const Transaction &trans) {
+    last_trans_clk_ = clk_;
+    UpdateRowState(trans);
+}
+
+// leaves the bank as trans would, returns the latency of the row commands
+uint64_t Controller::UpdateRowState(const Transaction &trans) {
+    auto cmd = TransToCommand(trans);
+    int rank = cmd.Rank();
+    int bankgroup = cmd.Bankgroup();
+    int bank = cmd.Bank();
+    uint64_t latency = 0;
+    if (channel_state_.IsRankSelfRefreshing(rank)) {
+        channel_state_.UpdateState(
+            Command(CommandType::SREF_EXIT, cmd.addr, cmd.hex_addr));
+        latency += config_.tXS;
+    }
+    if (channel_state_.IsRowOpen(rank, bankgroup, bank) &&
+        channel_state_.OpenRow(rank, bankgroup, bank) != cmd.Row()) {
+        channel_state_.UpdateState(
+            Command(CommandType::PRECHARGE, cmd.addr, cmd.hex_addr));
+        latency += config_.tRP;
+    }
+    if (!channel_state_.IsRowOpen(rank, bankgroup, bank)) {
+        channel_state_.UpdateState(
+            Command(CommandType::ACTIVATE, cmd.addr, cmd.hex_addr));
+        if (config_.IsGDDR() || config_.IsHBM()) {
+            latency += trans.is_write ? config_.tRCDWR : config_.tRCDRD;
+        } else {
+            latency += config_.tRCD - config_.AL;
         }
-        return true;
     }
-    return false;//Need to do something to this
+    channel_state_.UpdateState(cmd);
+    return latency;
 }
 
 void Controller::ScheduleTransaction() {
+    if (ScheduleDeviceCommand()) {
+        return;
+    }
+
     // determine whether to schedule read or write
     if (write_draining_ == 0 && !is_unified_queue_) {
         // we basically have a upper and lower threshold for write buffer
@@ -252,6 +407,192 @@ void Controller::ScheduleTransaction() {
     }
 }
 
+void Controller::AddPIMOp(const Transaction &trans) {
+    auto addr = config_.AddressMapping(trans.addr);
+    if (trans.cim_count == 0 ||
+        addr.column + trans.cim_count > config_.co_mask + 1) {
+        std::cerr << "All-bank PIM operation at " << std::hex << trans.addr
+                  << std::dec << " does not fit in its row" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    DeviceOpState op;
+    op.trans = trans;
+    op.num_cmds = trans.cim_count;
+    op.num_cmds += trans.pim_op == PIMOp::MAC ? 1 : trans.cim_count;
+    op.barrier = op.num_cmds;
+    op.cmds_queued = 0;
+    op.cmds_issued = 0;
+    device_ops_.push_back(op);
+}
+
+void Controller::AddRowCloneOp(const Transaction &trans) {
+    DeviceOpState op;
+    op.trans = trans;
+    op.cmds_queued = 0;
+    op.cmds_issued = 0;
+    auto dst = config_.AddressMapping(trans.addr);
+    auto src = trans.clone_op == RowCloneOp::COPY
+                   ? config_.AddressMapping(trans.addr2)
+                   : dst;
+    if (src.channel != dst.channel || src.rank != dst.rank) {
+        std::cerr << "RowClone needs the source and destination in the same "
+                  << "rank, got " << std::hex << trans.addr2 << " and "
+                  << trans.addr << std::dec << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    int columns = config_.co_mask + 1;
+    bool same_bank = src.bankgroup == dst.bankgroup && src.bank == dst.bank;
+    if (same_bank && src.row / config_.subarray_rows ==
+                         dst.row / config_.subarray_rows) {
+        // one back to back activation, init copies a reserved zero row of
+        // the subarray
+        op.num_cmds = 1;
+        op.barrier = 1;
+    } else if (!same_bank) {
+        op.num_cmds = columns;
+        op.barrier = columns;
+    } else {
+        // a bank can only move a column to another bank, so the row goes
+        // through a temporary bank and back
+        if (config_.banks < 2) {
+            std::cerr << "RowClone across subarrays needs a second bank"
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        op.num_cmds = 2 * columns;
+        op.barrier = columns;
+    }
+    device_ops_.push_back(op);
+}
+
+bool Controller::ScheduleDeviceCommand() {
+    // next command of the oldest device operation that has some left
+    for (auto &op : device_ops_) {
+        if (op.cmds_queued == op.num_cmds ||
+            (op.cmds_queued == op.barrier && op.cmds_issued < op.barrier)) {
+            continue;
+        }
+        auto cmd = DeviceOpCommand(op.trans, op.cmds_queued);
+        if (!cmd_queue_.WillAcceptCommand(cmd)) {
+            return false;
+        }
+        cmd_queue_.AddCommand(cmd);
+        op.cmds_queued++;
+        return true;
+    }
+    return false;
+}
+
+Command Controller::DeviceOpCommand(const Transaction &trans,
+                                    int index) const {
+    if (trans.pim_op != PIMOp::NONE) {
+        return PIMCommand(trans, index);
+    }
+    return RowCloneCommand(trans, index);
+}
+
+Command Controller::PIMCommand(const Transaction &trans, int index) const {
+    auto addr = config_.AddressMapping(trans.addr);
+    // all banks are used, the command stands for the rank
+    addr.bankgroup = 0;
+    addr.bank = 0;
+    CommandType cmd_type;
+    int columns = static_cast<int>(trans.cim_count);
+    if (trans.pim_op == PIMOp::ADD) {
+        cmd_type = index % 2 == 0 ? CommandType::PIM_COMPUTE
+                                  : CommandType::PIM_WRITEBACK;
+        addr.column += index / 2;
+    } else if (index < columns) {
+        cmd_type = CommandType::PIM_COMPUTE;
+        addr.column += index;
+    } else {
+        // the accumulated sum goes to the first column
+        cmd_type = CommandType::PIM_WRITEBACK;
+    }
+    return Command(cmd_type, addr, trans.addr);
+}
+
+Command Controller::RowCloneCommand(const Transaction &trans,
+                                    int index) const {
+    auto dst = config_.AddressMapping(trans.addr);
+    if (trans.clone_op == RowCloneOp::INIT) {
+        return Command(CommandType::CLONE_FPM, dst, trans.addr);
+    }
+    auto src = config_.AddressMapping(trans.addr2);
+    bool same_bank = src.bankgroup == dst.bankgroup && src.bank == dst.bank;
+    if (same_bank && src.row / config_.subarray_rows ==
+                         dst.row / config_.subarray_rows) {
+        return Command(CommandType::CLONE_FPM, dst, trans.addr);
+    }
+    // one column per command, hex_addr carries the destination
+    int columns = config_.co_mask + 1;
+    Address from = src;
+    Address to = dst;
+    if (same_bank) {
+        Address tmp = src;
+        if (config_.bankgroups > 1) {
+            tmp.bankgroup = (tmp.bankgroup + 1) % config_.bankgroups;
+        } else {
+            tmp.bank = (tmp.bank + 1) % config_.banks_per_group;
+        }
+        if (index < columns) {
+            to = tmp;
+        } else {
+            from = tmp;
+        }
+    }
+    from.column = index % columns;
+    to.column = index % columns;
+    return Command(CommandType::CLONE_PSM, from,
+                   config_.ReverseAddressMapping(to));
+}
+
+void Controller::DeviceCommandIssued(const Command &cmd) {
+    // commands of an operation issue in order, find the operation that
+    // expects this one next
+    for (auto it = device_ops_.begin(); it != device_ops_.end(); it++) {
+        if (it->cmds_issued == it->cmds_queued) {
+            continue;
+        }
+        auto expected = DeviceOpCommand(it->trans, it->cmds_issued);
+        if (expected.cmd_type != cmd.cmd_type ||
+            expected.hex_addr != cmd.hex_addr ||
+            expected.Rank() != cmd.Rank() ||
+            expected.Bankgroup() != cmd.Bankgroup() ||
+            expected.Bank() != cmd.Bank() || expected.Row() != cmd.Row() ||
+            expected.Column() != cmd.Column()) {
+            continue;
+        }
+        it->cmds_issued++;
+        if (it->cmds_issued == it->num_cmds) {
+            const Transaction &trans = it->trans;
+            if (trans.pim_op != PIMOp::NONE) {
+                it->trans.complete_cycle = clk_ + config_.write_delay;
+                simple_stats_.Increment("num_pim_ops_done");
+            } else {
+                it->trans.complete_cycle =
+                    clk_ + (cmd.cmd_type == CommandType::CLONE_FPM
+                                ? 2 * config_.tRAS
+                                : config_.write_delay);
+                bool is_copy = trans.clone_op == RowCloneOp::COPY;
+                simple_stats_.Increment(is_copy ? "num_row_copies_done"
+                                                : "num_row_inits_done");
+                // bytes a copy would have moved over the bus both ways, an
+                // init only written
+                simple_stats_.IncrementBy(
+                    "clone_bytes_saved",
+                    (config_.co_mask + 1) * config_.request_size_bytes *
+                        (is_copy ? 2 : 1));
+            }
+            return_queue_.push_back(it->trans);
+            device_ops_.erase(it);
+        }
+        return;
+    }
+    std::cerr << "PIM or RowClone command without an operation!" << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+}
+
 void Controller::IssueCommand(const Command &cmd) {
 #ifdef CMD_TRACE
     cmd_trace_ << std::left << std::setw(18) << clk_ << " " << cmd << std::endl;
@@ -285,6 +626,10 @@ void Controller::IssueCommand(const Command &cmd) {
         auto wr_lat = clk_ - it->second.added_cycle + config_.write_delay;
         simple_stats_.AddValue("write_latency", wr_lat);
         pending_wr_q_.erase(it);
+    } else if (cmd.cmd_type == CommandType::PIM_COMPUTE ||
+               cmd.cmd_type == CommandType::PIM_WRITEBACK ||
+               cmd.IsRowClone()) {
+        DeviceCommandIssued(cmd);
     }
     // must update stats before states (for row hits)
     UpdateCommandStats(cmd);
@@ -305,6 +650,20 @@ Command Controller::TransToCommand(const Transaction &trans) {
 
 int Controller::QueueUsage() const { return cmd_queue_.QueueUsage(); }
 
+void Controller::RecordCiMOp(int op, uint64_t operand_cycles,
+                             uint64_t compute_cycles,
+                             uint64_t writeback_cycles) {
+    const CiMOpSpec &spec = config_.cim_ops[op];
+    simple_stats_.Increment(simple_stats_.CiMDoneStat(op));
+    // without CiM every operand would have crossed the host interface
+    simple_stats_.IncrementBy(
+        "cim_bytes_saved",
+        (spec.reads.size() + spec.writes.size()) * config_.request_size_bytes);
+    simple_stats_.AddValue("cim_operand_latency", operand_cycles);
+    simple_stats_.AddValue("cim_compute_latency", compute_cycles);
+    simple_stats_.AddValue("cim_writeback_latency", writeback_cycles);
+}
+
 void Controller::PrintEpochStats() {
     simple_stats_.Increment("epoch_num");
     simple_stats_.PrintEpochStats();
@@ -365,9 +724,88 @@ void Controller::UpdateCommandStats(const Command &cmd) {
         case CommandType::SREF_EXIT:
             simple_stats_.Increment("num_srefx_cmds");
             break;
+        case CommandType::PIM_ACTIVATE:
+            simple_stats_.Increment("num_pim_act_cmds");
+            break;
+        case CommandType::PIM_COMPUTE:
+            simple_stats_.Increment("num_pim_compute_cmds");
+            break;
+        case CommandType::PIM_WRITEBACK:
+            simple_stats_.Increment("num_pim_wb_cmds");
+            break;
+        case CommandType::CLONE_FPM:
+            simple_stats_.Increment("num_clone_fpm_cmds");
+            break;
+        case CommandType::CLONE_PSM:
+            simple_stats_.Increment("num_clone_psm_cmds");
+            break;
         default:
             AbruptExit(__FILE__, __LINE__);
     }
 }
 
+void Controller::SaveState(CheckpointWriter &ckpt) const {
+    ckpt.Write(clk_);
+    ckpt.Write(unified_queue_);
+    ckpt.Write(read_queue_);
+    ckpt.Write(write_buffer_);
+    ckpt.Write(pending_rd_q_);
+    ckpt.Write(pending_wr_q_);
+    ckpt.Write(return_queue_);
+    ckpt.Write(static_cast<uint64_t>(device_ops_.size()));
+    for (const auto &op : device_ops_) {
+        ckpt.Write(op.trans);
+        ckpt.Write(op.num_cmds);
+        ckpt.Write(op.barrier);
+        ckpt.Write(op.cmds_queued);
+        ckpt.Write(op.cmds_issued);
+    }
+    ckpt.Write(static_cast<uint64_t>(splits_.size()));
+    for (const auto &split : splits_) {
+        ckpt.Write(split.trans);
+        ckpt.Write(split.parts_left);
+    }
+    ckpt.Write(free_splits_);
+    ckpt.Write(last_trans_clk_);
+    ckpt.Write(write_draining_);
+    simple_stats_.SaveState(ckpt);
+    channel_state_.SaveState(ckpt);
+    cmd_queue_.SaveState(ckpt);
+    refresh_.SaveState(ckpt);
+}
+
+void Controller::LoadState(CheckpointReader &ckpt) {
+    ckpt.Read(clk_);
+    ckpt.Read(unified_queue_);
+    ckpt.Read(read_queue_);
+    ckpt.Read(write_buffer_);
+    ckpt.Read(pending_rd_q_);
+    ckpt.Read(pending_wr_q_);
+    ckpt.Read(return_queue_);
+    uint64_t num_device_ops = 0;
+    ckpt.Read(num_device_ops);
+    device_ops_.resize(num_device_ops);
+    for (auto &op : device_ops_) {
+        ckpt.Read(op.trans);
+        ckpt.Read(op.num_cmds);
+        ckpt.Read(op.barrier);
+        ckpt.Read(op.cmds_queued);
+        ckpt.Read(op.cmds_issued);
+    }
+    uint64_t num_splits = 0;
+    ckpt.Read(num_splits);
+    splits_.resize(num_splits);
+    for (auto &split : splits_) {
+        ckpt.Read(split.trans);
+        ckpt.Read(split.parts_left);
+    }
+    ckpt.Read(free_splits_);
+    ckpt.Read(last_trans_clk_);
+    ckpt.Read(write_draining_);
+    simple_stats_.LoadState(ckpt);
+    channel_state_.LoadState(ckpt);
+    cmd_queue_.LoadState(ckpt);
+    refresh_.LoadState(ckpt);
+}
+
 }  // namespace dramsim3
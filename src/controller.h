@@ -6,6 +6,7 @@
 #include <unordered_set>
 #include <vector>
 #include "channel_state.h"
+#include "checkpoint.h"
 #include "command_queue.h"
 #include "common.h"
 #include "refresh.h"
@@ -19,6 +20,23 @@ namespace dramsim3 {
 
 enum class RowBufPolicy { OPEN_PAGE, CLOSE_PAGE, SIZE };
 
+// An all-bank PIM or a RowClone operation, handed to the command queue one
+// command at a time as it has room. Commands from barrier on are queued only
+// once all the earlier ones have issued.
+struct DeviceOpState {
+    Transaction trans;
+    int num_cmds;
+    int barrier;
+    int cmds_queued;
+    int cmds_issued;
+};
+
+// A request larger than one burst, done once all its parts are
+struct SplitState {
+    Transaction trans;
+    int parts_left;
+};
+
 
 class Controller {
    public:
@@ -30,8 +48,13 @@ class Controller {
 #endif  // THERMAL
     void ClockTick();
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const;
-    /*Overloading for CIM */
-    bool WillAcceptTransaction(uint64_t hex_addr,int no_of_reads, int no_of_writes) const; //CIM instructions can have more than 1 read or write transactions
+    // room for several reads and writes at once, e.g. of one CiM operation
+    bool WillAcceptTransaction(uint64_t hex_addr, int num_reads,
+                               int num_writes) const;
+    // room for all the bursts of a read or write of trans.size bytes
+    bool WillAcceptTransaction(const Transaction &trans) const;
+    // room for another all-bank PIM or RowClone operation
+    bool WillAcceptDeviceOp() const;
     /* ************** */
     bool AddTransaction(Transaction trans);
     int QueueUsage() const;
@@ -39,12 +62,32 @@ class Controller {
     void PrintEpochStats();
     void PrintFinalStats();
     void ResetStats() { simple_stats_.Reset(); }
-    std::pair<uint64_t, int> ReturnDoneTrans(uint64_t clock);
+    void DiscardEpochStats() { simple_stats_.DiscardEpoch(); }
+    double LastEpochStat(const std::string &name) const {
+        return simple_stats_.GetCalculated(name);
+    }
+    // pops one completed transaction, returns false if there is none
+    bool ReturnDoneTrans(uint64_t clock, Transaction &trans);
+    void SaveState(CheckpointWriter &ckpt) const;
+
+    // sampled simulation support: a drained controller can skip cycles and
+    // serve requests functionally, only row buffer and refresh state are
+    // updated and the latency is derived from the timing parameters
+    bool IsDrained() const;
+    void FlushWriteBuffer();
+    void FastForward(uint64_t clk);
+    void FunctionalAccess(Transaction trans);
+    // hybrid fidelity support: keeps the rows of an idle controller warm for
+    // requests served by another backend
+    bool IsIdle() const { return IsDrained() && return_queue_.empty(); }
+    void WarmRowBuffer(const Transaction &trans);
+    // stats of a completed CiM operation (index into Config::cim_ops) whose
+    // first operand is in this channel, latencies of its three phases
+    void RecordCiMOp(int op, uint64_t operand_cycles, uint64_t compute_cycles,
+                     uint64_t writeback_cycles);
+    void LoadState(CheckpointReader &ckpt);
 
     int channel_id_;
-    std::unordered_map<uint64_t,int> cim_transactions;
-    std::unordered_map<int,uint64_t> cim_transactions_start_cycle;
-    std::unordered_map<int,uint64_t> cim_transactions_complete_cycle;
    private:
     uint64_t clk_;
     const Config &config_;
@@ -70,6 +113,13 @@ class Controller {
     // completed transactions
     std::vector<Transaction> return_queue_;
 
+    // PIM and RowClone operations in arrival order until their last command
+    std::vector<DeviceOpState> device_ops_;
+
+    // split requests by slot, their parts carry the slot in req_id
+    std::vector<SplitState> splits_;
+    std::vector<uint32_t> free_splits_;
+
     // row buffer policy
     RowBufPolicy row_buf_policy_;
 
@@ -82,9 +132,21 @@ class Controller {
 
     // transaction queueing
     int write_draining_;
+    void EnqueueTransaction(std::vector<Transaction> &queue,
+                            const Transaction &trans);
     void ScheduleTransaction();
+    void AddBurst(Transaction trans);
+    void AddSplitTransaction(const Transaction &trans, int bursts);
+    void AddPIMOp(const Transaction &trans);
+    void AddRowCloneOp(const Transaction &trans);
+    bool ScheduleDeviceCommand();
+    Command DeviceOpCommand(const Transaction &trans, int index) const;
+    Command PIMCommand(const Transaction &trans, int index) const;
+    Command RowCloneCommand(const Transaction &trans, int index) const;
+    void DeviceCommandIssued(const Command &cmd);
     void IssueCommand(const Command &tmp_cmd);
     Command TransToCommand(const Transaction &trans);
+    uint64_t UpdateRowState(const Transaction &trans);
     void UpdateCommandStats(const Command &cmd);
 };
 }  // namespace dramsim3
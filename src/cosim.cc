@@ -0,0 +1,237 @@
+#include "cosim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+#include <thread>
+
+namespace dramsim3 {
+
+namespace {
+const uint64_t kCosimMagic = 0x4d49534f43334452;  // "DR3COSIM"
+const uint32_t kCosimVersion = 2;
+// yields between two checks that the other side is still running
+const int kLivenessSpins = 1024;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "shared memory rings need lock free atomics");
+
+size_t RegionSize(uint32_t ring_capacity) {
+    return sizeof(CosimHeader) + ring_capacity * sizeof(CosimRequest) +
+           ring_capacity * sizeof(CosimCompletion);
+}
+
+bool ProcessAlive(pid_t pid) { return kill(pid, 0) == 0 || errno != ESRCH; }
+
+CosimRequest *RequestSlots(CosimHeader *header) {
+    return reinterpret_cast<CosimRequest *>(header + 1);
+}
+
+CosimCompletion *CompletionSlots(CosimHeader *header) {
+    return reinterpret_cast<CosimCompletion *>(RequestSlots(header) +
+                                               header->ring_capacity);
+}
+}  // namespace
+
+CosimServer::CosimServer(MemorySystem &memory, const std::string &shm_name,
+                         uint32_t ring_capacity)
+    : memory_(memory),
+      shm_name_(shm_name),
+      region_size_(RegionSize(ring_capacity)),
+      header_(nullptr),
+      clk_(0),
+      backlog_head_(0) {
+    if (ring_capacity == 0 || (ring_capacity & (ring_capacity - 1)) != 0) {
+        std::cerr << "Co-simulation ring capacity must be a power of 2"
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    shm_unlink(shm_name_.c_str());
+    int fd = shm_open(shm_name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, region_size_) != 0) {
+        std::cerr << "Cannot create shared memory region " << shm_name_
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    void *region = mmap(nullptr, region_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        std::cerr << "Cannot map shared memory region " << shm_name_
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+
+    header_ = new (region) CosimHeader();
+    header_->version = kCosimVersion;
+    header_->ring_capacity = ring_capacity;
+    header_->server_pid = getpid();
+    header_->client_pid.store(0);
+    header_->target_cycle.store(0);
+    header_->mem_cycle.store(0);
+    header_->shutdown.store(0);
+    header_->requests.head.store(0);
+    header_->requests.tail.store(0);
+    header_->completions.head.store(0);
+    header_->completions.tail.store(0);
+    requests_ = CosimRing<CosimRequest>(&header_->requests,
+                                        RequestSlots(header_), ring_capacity);
+    completions_ = CosimRing<CosimCompletion>(
+        &header_->completions, CompletionSlots(header_), ring_capacity);
+    header_->magic.store(kCosimMagic, std::memory_order_release);
+}
+
+CosimServer::~CosimServer() {
+    munmap(header_, region_size_);
+    shm_unlink(shm_name_.c_str());
+}
+
+void CosimServer::Serve() {
+    int spins = 0;
+    while (true) {
+        if (clk_ < header_->target_cycle.load(std::memory_order_acquire)) {
+            Step();
+            spins = 0;
+        } else if (header_->shutdown.load(std::memory_order_acquire) &&
+                   clk_ >=
+                       header_->target_cycle.load(std::memory_order_acquire)) {
+            return;
+        } else if (++spins == kLivenessSpins) {
+            spins = 0;
+            int32_t client = header_->client_pid.load();
+            if (client != 0 && !ProcessAlive(client)) {
+                std::cerr << "Co-simulation client " << client << " is gone"
+                          << std::endl;
+                return;
+            }
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void CosimServer::Step() {
+    memory_.ClockTick();
+    memory_.DrainCompletions(drained_);
+    for (const auto &completion : drained_) {
+        CosimCompletion resp;
+        resp.tag = completion.tag;
+        resp.addr = completion.addr;
+        resp.source_id = completion.source_id;
+        resp.is_write = completion.is_write;
+        backlog_.push_back(resp);
+    }
+    PublishCompletions();
+
+    // requests are used in place, nothing is copied out of the ring
+    const CosimRequest *req = requests_.Front();
+    while (req != nullptr &&
+           memory_.WillAcceptTransaction(req->addr, req->is_write != 0)) {
+        memory_.AddTransaction(req->addr, req->is_write != 0, req->tag,
+                               RequestMeta(req->source_id, req->priority));
+        requests_.Pop();
+        req = requests_.Front();
+    }
+
+    clk_++;
+    header_->mem_cycle.store(clk_, std::memory_order_release);
+}
+
+void CosimServer::PublishCompletions() {
+    while (backlog_head_ < backlog_.size() &&
+           completions_.Push(backlog_[backlog_head_])) {
+        backlog_head_++;
+    }
+    if (backlog_head_ == backlog_.size()) {
+        backlog_.clear();
+        backlog_head_ = 0;
+    }
+}
+
+CosimClient::CosimClient() : region_size_(0), header_(nullptr) {}
+
+CosimClient::~CosimClient() {
+    if (header_ != nullptr) {
+        munmap(header_, region_size_);
+    }
+}
+
+bool CosimClient::Connect(const std::string &shm_name) {
+    int fd = shm_open(shm_name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat shm_stat;
+    if (fstat(fd, &shm_stat) != 0 ||
+        static_cast<size_t>(shm_stat.st_size) < sizeof(CosimHeader)) {
+        close(fd);
+        return false;
+    }
+    region_size_ = shm_stat.st_size;
+    void *region = mmap(nullptr, region_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        return false;
+    }
+    header_ = static_cast<CosimHeader *>(region);
+    if (header_->magic.load(std::memory_order_acquire) != kCosimMagic ||
+        header_->version != kCosimVersion ||
+        region_size_ < RegionSize(header_->ring_capacity)) {
+        munmap(header_, region_size_);
+        header_ = nullptr;
+        return false;
+    }
+    header_->client_pid.store(getpid());
+    requests_ =
+        CosimRing<CosimRequest>(&header_->requests, RequestSlots(header_),
+                                header_->ring_capacity);
+    completions_ = CosimRing<CosimCompletion>(&header_->completions,
+                                              CompletionSlots(header_),
+                                              header_->ring_capacity);
+    return true;
+}
+
+bool CosimClient::SendRequest(const CosimRequest &req) {
+    return requests_.Push(req);
+}
+
+bool CosimClient::ReceiveCompletion(CosimCompletion &completion) {
+    const CosimCompletion *front = completions_.Front();
+    if (front == nullptr) {
+        return false;
+    }
+    completion = *front;
+    completions_.Pop();
+    return true;
+}
+
+bool CosimClient::RunUntil(uint64_t cycle) {
+    header_->target_cycle.store(cycle, std::memory_order_release);
+    int spins = 0;
+    while (header_->mem_cycle.load(std::memory_order_acquire) < cycle) {
+        if (++spins == kLivenessSpins) {
+            spins = 0;
+            if (!ProcessAlive(header_->server_pid)) {
+                return false;
+            }
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+uint64_t CosimClient::MemCycle() const {
+    return header_->mem_cycle.load(std::memory_order_acquire);
+}
+
+void CosimClient::Shutdown() {
+    header_->shutdown.store(1, std::memory_order_release);
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,163 @@
+#ifndef __COSIM_H
+#define __COSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "memory_system.h"
+
+namespace dramsim3 {
+
+// Co-simulation with a CPU simulator running in another process on the same
+// host. The memory side (CosimServer) creates a POSIX shared memory region
+// holding a request ring, a completion ring and two cycle counters, and the
+// CPU side maps it with CosimClient. Both rings are single producer single
+// consumer, so neither side ever takes a lock.
+//
+// Cycles are handed out by the client: it raises target_cycle and the
+// server simulates until mem_cycle reaches it. Each memory cycle the server
+// ticks the memory system, publishes completions, then admits as many queued
+// requests as the memory system accepts; the rest stay in the ring, which is
+// the backpressure seen by the client.
+//
+// Each side records its pid in the region, and a side waiting for the other
+// checks now and then that the other process still exists, so neither hangs
+// when its peer dies.
+
+struct CosimRequest {
+    uint64_t tag;
+    uint64_t addr;
+    int32_t source_id;
+    int32_t priority;
+    uint32_t is_write;
+    uint32_t reserved;
+};
+
+struct CosimCompletion {
+    uint64_t tag;
+    uint64_t addr;
+    int32_t source_id;
+    uint32_t is_write;
+};
+
+// head and tail live on separate cache lines so that producer and consumer
+// do not false share
+struct CosimRingIndex {
+    alignas(64) std::atomic<uint64_t> head;  // advanced by the consumer
+    alignas(64) std::atomic<uint64_t> tail;  // advanced by the producer
+};
+
+// start of the shared region, followed by the request slots and then the
+// completion slots
+struct CosimHeader {
+    std::atomic<uint64_t> magic;  // set last, once the region is ready
+    uint32_t version;
+    uint32_t ring_capacity;
+    int32_t server_pid;
+    std::atomic<int32_t> client_pid;  // 0 until a client connects
+    alignas(64) std::atomic<uint64_t> target_cycle;  // written by the client
+    alignas(64) std::atomic<uint64_t> mem_cycle;     // written by the server
+    std::atomic<uint32_t> shutdown;
+    CosimRingIndex requests;
+    CosimRingIndex completions;
+};
+
+// View of one ring inside the shared region, capacity is a power of 2
+template <typename T>
+class CosimRing {
+   public:
+    CosimRing() : index_(nullptr), slots_(nullptr), mask_(0) {}
+    CosimRing(CosimRingIndex *index, T *slots, uint64_t capacity)
+        : index_(index), slots_(slots), mask_(capacity - 1) {}
+
+    bool Push(const T &val) {
+        uint64_t tail = index_->tail.load(std::memory_order_relaxed);
+        if (tail - index_->head.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        slots_[tail & mask_] = val;
+        index_->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // oldest entry, left in place until Pop, nullptr if the ring is empty
+    const T *Front() const {
+        uint64_t head = index_->head.load(std::memory_order_relaxed);
+        if (head == index_->tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots_[head & mask_];
+    }
+
+    void Pop() {
+        uint64_t head = index_->head.load(std::memory_order_relaxed);
+        index_->head.store(head + 1, std::memory_order_release);
+    }
+
+   private:
+    CosimRingIndex *index_;
+    T *slots_;
+    uint64_t mask_;
+};
+
+class CosimServer {
+   public:
+    // creates the shared region shm_name (e.g. "/dramsim3"), replacing a
+    // stale one with the same name
+    CosimServer(MemorySystem &memory, const std::string &shm_name,
+                uint32_t ring_capacity);
+    ~CosimServer();
+    // simulates cycles as the client grants them, returns once the client
+    // has shut down and all granted cycles are simulated, or once a
+    // connected client process is gone
+    void Serve();
+    uint64_t Cycle() const { return clk_; }
+
+   private:
+    void Step();
+    void PublishCompletions();
+
+    MemorySystem &memory_;
+    std::string shm_name_;
+    size_t region_size_;
+    CosimHeader *header_;
+    CosimRing<CosimRequest> requests_;
+    CosimRing<CosimCompletion> completions_;
+    uint64_t clk_;
+
+    // completions that did not fit in the ring yet
+    std::vector<Completion> drained_;
+    std::vector<CosimCompletion> backlog_;
+    size_t backlog_head_;
+};
+
+// Reference client, all calls are non-blocking except RunUntil
+class CosimClient {
+   public:
+    CosimClient();
+    ~CosimClient();
+    // returns false if there is no ready server region under this name
+    bool Connect(const std::string &shm_name);
+    // returns false if the request ring is full
+    bool SendRequest(const CosimRequest &req);
+    // returns false if there is no completion to receive
+    bool ReceiveCompletion(CosimCompletion &completion);
+    // let the memory system simulate up to cycle and wait until it has,
+    // returns false if the server process is gone
+    bool RunUntil(uint64_t cycle);
+    uint64_t MemCycle() const;
+    // tells the server to stop once it reaches the last granted cycle
+    void Shutdown();
+
+   private:
+    size_t region_size_;
+    CosimHeader *header_;
+    CosimRing<CosimRequest> requests_;
+    CosimRing<CosimCompletion> completions_;
+};
+
+}  // namespace dramsim3
+#endif
@@ -0,0 +1,88 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "./../ext/headers/args.hxx"
+#include "cosim.h"
+
+// Reference co-simulation client, stands in for a CPU simulator: sends one
+// random request per cycle while the request ring has room, advances the
+// memory system one cycle at a time and collects completions
+
+using namespace dramsim3;
+
+int main(int argc, const char **argv) {
+    args::ArgumentParser parser(
+        "DRAMsim3 co-simulation reference client.",
+        "Example: \n"
+        "./build/dramsim3cosimclient --shm /dramsim3 -c 100000");
+    args::HelpFlag help(parser, "help", "Display the help menu", {'h', "help"});
+    args::ValueFlag<uint64_t> num_cycles_arg(parser, "num_cycles",
+                                             "Number of cycles to simulate",
+                                             {'c', "cycles"}, 100000);
+    args::ValueFlag<std::string> shm_arg(
+        parser, "shm", "Name of the shared memory region", {"shm"},
+        "/dramsim3");
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help) {
+        std::cout << parser;
+        return 0;
+    } catch (args::ParseError e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    CosimClient client;
+    int retries = 0;
+    while (!client.Connect(args::get(shm_arg))) {
+        if (++retries > 100) {
+            std::cerr << "No co-simulation server on " << args::get(shm_arg)
+                      << std::endl;
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    uint64_t cycles = args::get(num_cycles_arg);
+    std::mt19937_64 gen(0);
+    // issue cycle of each request, indexed by tag
+    std::vector<uint64_t> issue_cycle;
+    uint64_t num_done = 0, latency_sum = 0;
+    bool get_next = true;
+    CosimRequest req;
+    for (uint64_t clk = client.MemCycle(); clk < cycles; clk++) {
+        if (get_next) {
+            req.tag = issue_cycle.size();
+            req.addr = gen() & ~0x3fULL;
+            req.is_write = gen() % 3 == 0;
+            req.source_id = 0;
+            req.priority = 0;
+            req.reserved = 0;
+        }
+        get_next = client.SendRequest(req);
+        if (get_next) {
+            issue_cycle.push_back(clk);
+        }
+        if (!client.RunUntil(clk + 1)) {
+            std::cerr << "The co-simulation server is gone" << std::endl;
+            return 1;
+        }
+        CosimCompletion completion;
+        while (client.ReceiveCompletion(completion)) {
+            num_done++;
+            latency_sum += clk + 1 - issue_cycle[completion.tag];
+        }
+    }
+    client.Shutdown();
+
+    std::cout << "Sent " << issue_cycle.size() << " requests, " << num_done
+              << " completed, average latency "
+              << (num_done > 0 ? static_cast<double>(latency_sum) / num_done
+                               : 0.0)
+              << " cycles" << std::endl;
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <iostream>
+#include "./../ext/headers/args.hxx"
+#include "cosim.h"
+
+// Memory side of a co-simulation, serves a CPU simulator running in another
+// process through shared memory until the CPU side shuts it down
+
+using namespace dramsim3;
+
+int main(int argc, const char **argv) {
+    args::ArgumentParser parser(
+        "DRAMsim3 co-simulation server.",
+        "Example: \n"
+        "./build/dramsim3cosim configs/DDR4_8Gb_x8_3200.ini --shm /dramsim3\n"
+        "then start the CPU simulator (or ./build/dramsim3cosimclient) with "
+        "the same --shm name");
+    args::HelpFlag help(parser, "help", "Display the help menu", {'h', "help"});
+    args::ValueFlag<std::string> output_dir_arg(
+        parser, "output_dir", "Output directory for stats files",
+        {'o', "output-dir"}, ".");
+    args::ValueFlag<std::string> shm_arg(
+        parser, "shm", "Name of the shared memory region", {"shm"},
+        "/dramsim3");
+    args::ValueFlag<uint32_t> ring_arg(
+        parser, "ring_size", "Entries per ring, must be a power of 2",
+        {"ring-size"}, 1024);
+    args::Positional<std::string> config_arg(
+        parser, "config", "The config file name (mandatory)");
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help) {
+        std::cout << parser;
+        return 0;
+    } catch (args::ParseError e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    std::string config_file = args::get(config_arg);
+    if (config_file.empty()) {
+        std::cerr << parser;
+        return 1;
+    }
+
+    auto callback = [](uint64_t addr) { return; };
+    MemorySystem memory_system(config_file, args::get(output_dir_arg),
+                               callback, callback);
+    CosimServer server(memory_system, args::get(shm_arg), args::get(ring_arg));
+    std::cout << "Serving on " << args::get(shm_arg) << std::endl;
+    server.Serve();
+    std::cout << "Client shut down after " << server.Cycle() << " cycles"
+              << std::endl;
+    memory_system.PrintStats();
+    return 0;
+}
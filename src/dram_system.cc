@@ -1,33 +1,41 @@
 #include "dram_system.h"
 
 #include <assert.h>
+#include <cmath>
 
 namespace dramsim3 {
 
-// alternative way is to assign the id in constructor but this is less
-// destructive
-int BaseDRAMSystem::total_channels_ = 0;
-
 BaseDRAMSystem::BaseDRAMSystem(Config &config, const std::string &output_dir,
                                std::function<void(uint64_t)> read_callback,
                                std::function<void(uint64_t)> write_callback)
     : read_callback_(read_callback),
       write_callback_(write_callback),
+      req_id_(0),
       last_req_clk_(0),
       config_(config),
       timing_(config_),
+      parallel_cycles_(0),
+      serial_cycles_(0),
 #ifdef THERMAL
       thermal_calc_(config_),
 #endif  // THERMAL
-      clk_(0) {
-    total_channels_ += config_.channels;
-
+      clk_(0),
+      epoch_file_started_(false) {
 #ifdef ADDR_TRACE
     std::string addr_trace_name = config_.output_prefix + "addr.trace";
     address_trace_.open(addr_trace_name);
 #endif
 }
 
+bool BaseDRAMSystem::IsIdle() const {
+    for (auto ctrl : ctrls_) {
+        if (!ctrl->IsIdle()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 int BaseDRAMSystem::GetChannel(uint64_t hex_addr) const {
     hex_addr >>= config_.shift_bits;
     return (hex_addr >> config_.ch_pos) & config_.ch_mask;
@@ -35,9 +43,10 @@ int BaseDRAMSystem::GetChannel(uint64_t hex_addr) const {
 
 void BaseDRAMSystem::PrintEpochStats() {
     // first epoch, print bracket
-    if (clk_ - config_.epoch_period == 0) {
+    if (!epoch_file_started_) {
         std::ofstream epoch_out(config_.json_epoch_name, std::ofstream::out);
         epoch_out << "[";
+        epoch_file_started_ = true;
     }
     for (size_t i = 0; i < ctrls_.size(); i++) {
         ctrls_[i]->PrintEpochStats();
@@ -50,6 +59,88 @@ void BaseDRAMSystem::PrintEpochStats() {
     return;
 }
 
+void BaseDRAMSystem::SaveState(CheckpointWriter &ckpt) const {
+    ckpt.Write(req_id_);
+    ckpt.Write(last_req_clk_);
+    ckpt.Write(parallel_cycles_);
+    ckpt.Write(serial_cycles_);
+    ckpt.Write(clk_);
+    ckpt.Write(samples_);
+    ckpt.Write(completions_);
+    for (auto ctrl : ctrls_) {
+        ctrl->SaveState(ckpt);
+    }
+}
+
+void BaseDRAMSystem::LoadState(CheckpointReader &ckpt) {
+    ckpt.Read(req_id_);
+    ckpt.Read(last_req_clk_);
+    ckpt.Read(parallel_cycles_);
+    ckpt.Read(serial_cycles_);
+    ckpt.Read(clk_);
+    ckpt.Read(samples_);
+    ckpt.Read(completions_);
+    for (auto ctrl : ctrls_) {
+        ctrl->LoadState(ckpt);
+    }
+    epoch_file_started_ = false;
+}
+
+void BaseDRAMSystem::RecordSample() {
+    // system level values of the window that just finished
+    double bandwidth = 0.0, energy = 0.0, power = 0.0, read_latency = 0.0;
+    for (auto ctrl : ctrls_) {
+        bandwidth += ctrl->LastEpochStat("average_bandwidth");
+        energy += ctrl->LastEpochStat("total_energy");
+        power += ctrl->LastEpochStat("average_power");
+        read_latency += ctrl->LastEpochStat("average_read_latency");
+    }
+    samples_["average_bandwidth"].push_back(bandwidth);
+    samples_["total_energy"].push_back(energy);
+    samples_["average_power"].push_back(power);
+    samples_["average_read_latency"].push_back(read_latency / ctrls_.size());
+}
+
+void BaseDRAMSystem::PrintSampleStats() const {
+    nlohmann::json j_data;
+    j_data["sample_period"] = config_.sample_period;
+    j_data["sample_warmup"] = config_.sample_warmup;
+    j_data["measured_cycles"] = config_.epoch_period;
+    j_data["simulated_cycles"] = clk_;
+    size_t num_samples =
+        samples_.empty() ? 0 : samples_.begin()->second.size();
+    j_data["num_samples"] = num_samples;
+    // totals are extrapolated from the measured windows to the whole run
+    double scale = static_cast<double>(clk_) / config_.epoch_period;
+    for (const auto &it : samples_) {
+        const auto &values = it.second;
+        double mean = 0.0, var = 0.0;
+        for (auto val : values) {
+            mean += val;
+        }
+        mean /= values.size();
+        for (auto val : values) {
+            var += (val - mean) * (val - mean);
+        }
+        var = values.size() > 1 ? var / (values.size() - 1) : 0.0;
+        // 95% confidence interval, normal approximation
+        double half_width = 1.96 * std::sqrt(var / values.size());
+        nlohmann::json j_stat;
+        j_stat["mean"] = mean;
+        j_stat["stddev"] = std::sqrt(var);
+        j_stat["ci95_low"] = mean - half_width;
+        j_stat["ci95_high"] = mean + half_width;
+        if (it.first == "total_energy") {
+            j_stat["extrapolated_total"] = mean * scale;
+            j_stat["extrapolated_ci95_low"] = (mean - half_width) * scale;
+            j_stat["extrapolated_ci95_high"] = (mean + half_width) * scale;
+        }
+        j_data[it.first] = j_stat;
+    }
+    std::ofstream j_out(config_.output_prefix + "sampling.json");
+    j_out << j_data.dump(4) << std::endl;
+}
+
 void BaseDRAMSystem::PrintStats() {
     // Finish epoch output, remove last comma and append ]
     std::ofstream epoch_out(config_.json_epoch_name, std::ios_base::in |
@@ -64,6 +155,13 @@ void BaseDRAMSystem::PrintStats() {
 
     // close it now so that each channel can handle it
     json_out.close();
+    if (config_.IsSampling()) {
+        // overall stats only cover the measured windows, drop the rest
+        for (auto ctrl : ctrls_) {
+            ctrl->DiscardEpochStats();
+        }
+        PrintSampleStats();
+    }
     for (size_t i = 0; i < ctrls_.size(); i++) {
         ctrls_[i]->PrintFinalStats();
         if (i != ctrls_.size() - 1) {
@@ -93,10 +191,46 @@ void BaseDRAMSystem::RegisterCallbacks(
     write_callback_ = write_callback;
 }
 
+void BaseDRAMSystem::RegisterCompletionCallback(
+    std::function<void(const Completion &)> completion_callback) {
+    completion_callback_ = completion_callback;
+}
+
+void BaseDRAMSystem::DrainCompletions(std::vector<Completion> &completions) {
+    // swap instead of copy so that neither side allocates once both buffers
+    // have grown to their working size
+    completions.clear();
+    completions.swap(completions_);
+}
+
+void BaseDRAMSystem::ReturnTransaction(const Transaction &trans) {
+    if (trans.is_tagged) {
+        Completion completion;
+        completion.tag = trans.tag;
+        completion.addr = trans.addr;
+        completion.source_id = trans.source_id;
+        completion.is_write = trans.is_write;
+        DeliverCompletion(completion);
+    } else if (trans.is_write) {
+        write_callback_(trans.addr);
+    } else {
+        read_callback_(trans.addr);
+    }
+}
+
+void BaseDRAMSystem::DeliverCompletion(const Completion &completion) {
+    if (completion_callback_) {
+        completion_callback_(completion);
+    } else {
+        completions_.push_back(completion);
+    }
+}
+
 JedecDRAMSystem::JedecDRAMSystem(Config &config, const std::string &output_dir,
                                  std::function<void(uint64_t)> read_callback,
                                  std::function<void(uint64_t)> write_callback)
-    : BaseDRAMSystem(config, output_dir, read_callback, write_callback) {
+    : BaseDRAMSystem(config, output_dir, read_callback, write_callback),
+      cim_(config_, ctrls_) {
     if (config_.IsHMC()) {
         std::cerr << "Initialized a memory system with an HMC config file!"
                   << std::endl;
@@ -104,13 +238,9 @@ JedecDRAMSystem::JedecDRAMSystem(Config &config, const std::string &output_dir,
     }
 
     ctrls_.reserve(config_.channels);
-    //Get the CiM values from the config file
-    CiM_Add_Delay = config_.CiM_Add_Delay;
-    CiM_Xor_Delay = config_.CiM_Xor_Delay;
-    CiM_Swap_Delay = config_.CiM_Swap_Delay;
     for (auto i = 0; i < config_.channels; i++) {
 #ifdef THERMAL
-        ctrls_ctrls_.push_back(new Controller(i, config_, timing_, thermal_calc_));
+        ctrls_.push_back(new Controller(i, config_, timing_, thermal_calc_));
 #else
         ctrls_.push_back(new Controller(i, config_, timing_));
 #endif  // THERMAL
@@ -127,21 +257,42 @@ bool JedecDRAMSystem::WillAcceptTransaction(uint64_t hex_addr,
                                             bool is_write) const {
 
     int channel = GetChannel(hex_addr);
+    if (!IsDetailedCycle()) {
+        // hold new requests back until in-flight ones are drained
+        return ctrls_[channel]->IsDrained();
+    }
     return ctrls_[channel]->WillAcceptTransaction(hex_addr, is_write);
 }
 
 bool JedecDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write) {
+    Transaction trans = Transaction(hex_addr, is_write);
+    return AddReadWrite(trans);
+}
+
+bool JedecDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write,
+                                     uint64_t tag, const RequestMeta &meta) {
+    Transaction trans = Transaction(hex_addr, is_write, tag, meta);
+    return AddReadWrite(trans);
+}
+
+bool JedecDRAMSystem::AddReadWrite(Transaction &trans) {
 // Record trace - Record address trace for debugging or other purposes
 #ifdef ADDR_TRACE
-    address_trace_ << std::hex << hex_addr << std::dec << " "
-                   << (is_write ? "WRITE " : "READ ") << clk_ << std::endl;
+    address_trace_ << std::hex << trans.addr << std::dec << " "
+                   << (trans.is_write ? "WRITE " : "READ ") << clk_
+                   << std::endl;
 #endif
-    int channel = GetChannel(hex_addr);
-    bool ok = ctrls_[channel]->WillAcceptTransaction(hex_addr, is_write);
+    int channel = GetChannel(trans.addr);
+    if (IsFastForwarding(channel)) {
+        ctrls_[channel]->FastForward(clk_);
+        ctrls_[channel]->FunctionalAccess(trans);
+        last_req_clk_ = clk_;
+        return true;
+    }
+    bool ok = ctrls_[channel]->WillAcceptTransaction(trans);
 
     assert(ok);
     if (ok) {
-        Transaction trans = Transaction(hex_addr, is_write);
         ctrls_[channel]->AddTransaction(trans);
     }
     last_req_clk_ = clk_;
@@ -149,252 +300,380 @@ bool JedecDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write) {
 }
 
 
-/* Overloading for CIM. */
-bool JedecDRAMSystem::WillAcceptTransaction(Transaction& trans) const {
-    int channel_1, channel_2, channel_3;
-    if (trans.is_cim_add  || trans.is_cim_xor) { //CiM_Add or CiM_Xor
-        channel_1 = GetChannel(trans.addr);
-        channel_2 = GetChannel(trans.addr2);
-        channel_3 = GetChannel(trans.addr3);
-        return ctrls_[channel_1]->WillAcceptTransaction(trans.addr, false) && ctrls_[channel_2]->WillAcceptTransaction(trans.addr2, false)
-            && ctrls_[channel_3]->WillAcceptTransaction(trans.addr, true);
-    }
-    if (trans.is_cim_swap) { //CiM_Swap
-        channel_1 = GetChannel(trans.addr);
-        channel_2 = GetChannel(trans.addr2);
-        return ctrls_[channel_1]->WillAcceptTransaction(trans.addr, false) && ctrls_[channel_1]->WillAcceptTransaction(trans.addr, true)
-            && ctrls_[channel_2]->WillAcceptTransaction(trans.addr2, false) && ctrls_[channel_2]->WillAcceptTransaction(trans.addr2, true);
+static void CheckNoAtomic(const Transaction &trans) {
+    if (trans.atomic_op != AtomicOp::NONE) {
+        std::cerr << "HMC atomic operations need an HMC config" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
     }
-    return true;
 }
-/************************************************************/
-
-/*Overloading for CIM*/
-bool JedecDRAMSystem::AddTransaction(Transaction& trans) { 
-#ifdef ADDR_TRACE
-    address_trace_ << std::hex << hex_addr << std::dec << " "
-        << (is_write ? "WRITE " : "READ ") << clk_ << std::endl;
-#endif
-    bool ok = true;
-    if (trans.is_cim_add || trans.is_cim_xor) {
-        int channel_1 = GetChannel(trans.addr);
-        int channel_2 = GetChannel(trans.addr2);
-        int channel_3 = GetChannel(trans.addr3);
-        ok = ctrls_[channel_1]->WillAcceptTransaction(trans.addr, false) && 
-                    ctrls_[channel_2]->WillAcceptTransaction(trans.addr2, false) &&
-                    ctrls_[channel_3]->WillAcceptTransaction(trans.addr3, true);
-        assert(ok);
-        if (ok) {
-            Transaction dram_trans;
-            for (int i = 0; i < 2; i++) {
-                if (i == 0)
-                    dram_trans = Transaction(trans.addr, false); //Issue two fetches
-                else
-                    dram_trans = Transaction(trans.addr2, false);
-                dram_trans.is_cim_add = trans.is_cim_add;
-                dram_trans.is_cim_xor = trans.is_cim_xor;
-                dram_trans.is_cim_swap = false;
-                dram_trans.is_cim = true;
-                dram_trans.req_id = req_id_;
-                if (i == 0)
-                    ctrls_[channel_1]->AddTransaction(dram_trans);
-                else
-                    ctrls_[channel_2]->AddTransaction(dram_trans);
 
-            }
+bool JedecDRAMSystem::WillAcceptTransaction(Transaction &trans) const {
+    CheckNoAtomic(trans);
+    int channel = GetChannel(trans.addr);
+    if (trans.pim_op != PIMOp::NONE || trans.clone_op != RowCloneOp::NONE) {
+        return ctrls_[channel]->WillAcceptDeviceOp();
+    } else if (trans.cim_op == 0) {
+        // a read or write of trans.size bytes
+        if (!IsDetailedCycle()) {
+            return ctrls_[channel]->IsDrained();
         }
-        no_of_reads_and_writes_for_cim[req_id_] = 2;
-        pending_callbacks[req_id_] = 2;
-        address_map_for_addxor[req_id_] = trans.addr3;
-        req_id_to_cim[req_id_] = trans.is_cim_add ? CiMReqType::CiM_Add : CiMReqType::CiM_Xor;
-        clock_cycle_record[req_id_].first = clk_;
-        req_id_++;
-    }
-    else if (trans.is_cim_swap) { //2 fetches and 2 stores
-        int channel_1 = GetChannel(trans.addr);
-        int channel_2 = GetChannel(trans.addr2);
-        ok = ctrls_[channel_1]->WillAcceptTransaction(trans.addr, false) &&
-            ctrls_[channel_2]->WillAcceptTransaction(trans.addr2, false) &&
-            ctrls_[channel_1]->WillAcceptTransaction(trans.addr, true) && ctrls_[channel_1]->WillAcceptTransaction(trans.addr2, true);
-        assert(ok);
-        if (ok) {
-            Transaction dram_trans;
-            for (int i = 0; i < 2; i++) {
-                if (i == 0)
-                    dram_trans = Transaction(trans.addr, false); //Issue two fetches
-                else
-                    dram_trans = Transaction(trans.addr2, false);
-                dram_trans.is_cim_add = false;
-                dram_trans.is_cim_xor = false;
-                dram_trans.is_cim_swap = true;
-                dram_trans.is_cim = true;
-                dram_trans.req_id = req_id_;
-                if (i == 0)
-                    ctrls_[channel_1]->AddTransaction(dram_trans);
-                else
-                    ctrls_[channel_2]->AddTransaction(dram_trans);
+        return ctrls_[channel]->WillAcceptTransaction(trans);
+    }
+    return cim_.WillAcceptTransaction(trans);
+}
 
-            }
-        }
-        address_map_for_swap[req_id_].first = trans.addr;
-        address_map_for_swap[req_id_].second = trans.addr2;
-        no_of_reads_and_writes_for_cim[req_id_] = 2;
-        pending_callbacks[req_id_] = 2;
-        req_id_to_cim[req_id_] = CiMReqType::CiM_Swap;
-        clock_cycle_record[req_id_].first = clk_;
-        req_id_++;
+bool JedecDRAMSystem::AddTransaction(Transaction &trans) {
+    CheckNoAtomic(trans);
+    if (!trans.IsOperation()) {
+        return AddReadWrite(trans);
+    }
+    SyncControllers();
+    if (trans.pim_op != PIMOp::NONE || trans.clone_op != RowCloneOp::NONE) {
+        // PIM and RowClone operations are broken into commands by the
+        // controller
+        ctrls_[GetChannel(trans.addr)]->AddTransaction(trans);
+    } else {
+        cim_.AddTransaction(trans, clk_);
     }
     last_req_clk_ = clk_;
-    return ok;
+    return true;
 }
 
-/************************************************************/
 void JedecDRAMSystem::ClockTick() {
 
     for (size_t i = 0; i < ctrls_.size(); i++) {
         // look ahead and return earlier
-        while (true) {
-            auto pair = ctrls_[i]->ReturnDoneTrans(clk_);
-            if (pair.second == 1) {
-                write_callback_(pair.first);
-            } else if (pair.second == 0) {
-                read_callback_(pair.first);
-            } else if(pair.second == CIM) {
-                no_of_reads_and_writes_for_cim[pair.first]--;
-                if (no_of_reads_and_writes_for_cim[pair.first] == 0) {
-                    CiM_CallBack(pair.first);
-                }
-                else
-                    break;
-            }
-            else {
-                break;
+        Transaction trans;
+        while (ctrls_[i]->ReturnDoneTrans(clk_, trans)) {
+            if (trans.is_cim) {
+                cim_.TransactionDone(trans, clk_);
+            } else {
+                ReturnTransaction(trans);
             }
         }
     }
-    issue_pending_transactions(clk_);
+    if (!cim_.IsIdle()) {
+        SyncControllers();
+        cim_.ClockTick(clk_);
+    }
+
+    bool detailed = IsDetailedCycle();
+    if (config_.IsSampling() &&
+        clk_ % config_.sample_period ==
+            static_cast<uint64_t>(config_.sample_period - config_.epoch_period)) {
+        // measured window starts, drop stats of fast-forward and warm-up
+        for (auto ctrl : ctrls_) {
+            ctrl->DiscardEpochStats();
+        }
+    }
     for (size_t i = 0; i < ctrls_.size(); i++) {
-        ctrls_[i]->ClockTick();
+        // drained controllers sit idle while fast-forwarding
+        if (detailed) {
+            ctrls_[i]->FastForward(clk_);
+            ctrls_[i]->ClockTick();
+        } else if (!ctrls_[i]->IsDrained()) {
+            ctrls_[i]->FlushWriteBuffer();
+            ctrls_[i]->ClockTick();
+        }
     }
     clk_++;
 
     if (clk_ % config_.epoch_period == 0) {
-        PrintEpochStats();
+        if (!config_.IsSampling()) {
+            PrintEpochStats();
+        } else if (clk_ % config_.sample_period == 0) {
+            PrintEpochStats();
+            RecordSample();
+        }
     }
     return;
 }
 
-/* Call back for CiM Type Transactions*/
-void JedecDRAMSystem::CiM_CallBack(uint64_t req_id) {
-    if (req_id_to_cim[req_id] == CiMReqType::CiM_Add || req_id_to_cim[req_id] == CiMReqType::CiM_Xor || req_id_to_cim[req_id] == CiMReqType::CiM_Swap) {
-        int delay = 0;
-        if (req_id_to_cim[req_id] == CiMReqType::CiM_Add)
-            delay = CiM_Add_Delay;
-        else if (req_id_to_cim[req_id] == CiMReqType::CiM_Xor)
-            delay = CiM_Xor_Delay;
-        else if (req_id_to_cim[req_id] == CiMReqType::CiM_Swap)
-            delay = CiM_Swap_Delay;
-        if (pending_callbacks[req_id] == 2) {
-            pending_transactions[clk_ + delay].push_back(req_id);
-            pending_callbacks[req_id]--;
-        }
-        else if(pending_callbacks[req_id] == 1) {
-            clock_cycle_record[req_id].second = clk_;
-            pending_callbacks[req_id]--;
-            if(req_id_to_cim[req_id] == CiMReqType::CiM_Add)
-            std::cout <<"Request no: "<<req_id<<" type: CiM_Add, no of clock cycles= "
-                <<clock_cycle_record[req_id].second - clock_cycle_record[req_id].first << "\n";
-            else if(req_id_to_cim[req_id] == CiMReqType::CiM_Xor)
-                std::cout << "Request no: " << req_id << " type: CiM_Xor, no of clock cycles= "
-                << clock_cycle_record[req_id].second - clock_cycle_record[req_id].first << "\n";
-            else if(req_id_to_cim[req_id] == CiMReqType::CiM_Swap)
-                std::cout << "Request no: " << req_id << " type: CiM_Swap, no of clock cycles= "
-                << clock_cycle_record[req_id].second - clock_cycle_record[req_id].first << "\n";
-        }
-
+bool JedecDRAMSystem::IsDetailedCycle() const {
+    if (!config_.IsSampling()) {
+        return true;
     }
+    uint64_t detailed_start = config_.sample_period - config_.epoch_period -
+                              config_.sample_warmup;
+    return clk_ % config_.sample_period >= detailed_start;
+}
 
+bool JedecDRAMSystem::IsFastForwarding(int channel) const {
+    return !IsDetailedCycle() && ctrls_[channel]->IsDrained();
 }
 
-void JedecDRAMSystem::issue_pending_transactions(uint64_t clk) {
-    if (pending_transactions[clk].begin() != pending_transactions[clk].end()) {
-        auto it = pending_transactions[clk].begin();
-        while (it != pending_transactions[clk].end()) {
-            uint64_t req_id = *it;
-            if (req_id_to_cim[req_id] == CiMReqType::CiM_Add || req_id_to_cim[req_id] == CiMReqType::CiM_Xor) {
-                uint64_t addr = address_map_for_addxor[req_id];
-                int channel = GetChannel(addr);
-                Transaction trans = Transaction(addr, true);
-                trans.is_cim_add = req_id_to_cim[req_id] == CiMReqType::CiM_Add;
-                trans.is_cim_xor = req_id_to_cim[req_id] == CiMReqType::CiM_Xor;
-                trans.is_cim = true;
-                trans.req_id = req_id;
-                ctrls_[channel]->AddTransaction(trans);
-                no_of_reads_and_writes_for_cim[req_id] = 1;
-            }
-            else {
-                uint64_t addr1 = address_map_for_swap[req_id].first;
-                uint64_t addr2 = address_map_for_swap[req_id].second;
-                int channel1 = GetChannel(addr1);
-                int channel2 = GetChannel(addr2);
-                Transaction trans1 = Transaction(addr1, true);
-                Transaction trans2 = Transaction(addr2, true);
-                trans1.is_cim_add = false;
-                trans2.is_cim_add = false;
-                trans1.is_cim_xor = false;
-                trans2.is_cim_xor = false;
-                trans1.is_cim_swap = true;
-                trans2.is_cim_swap = true;
-                trans1.is_cim = true;
-                trans2.is_cim = true;
-                trans1.req_id = req_id;
-                trans2.req_id = req_id;
-                ctrls_[channel1]->AddTransaction(trans1);
-                ctrls_[channel2]->AddTransaction(trans2);
-                no_of_reads_and_writes_for_cim[req_id] = 2;
-            }
-            it++;
+void JedecDRAMSystem::SyncControllers() {
+    if (config_.IsSampling()) {
+        for (auto ctrl : ctrls_) {
+            ctrl->FastForward(clk_);
         }
+    }
+}
 
+bool JedecDRAMSystem::IsIdle() const {
+    return cim_.IsIdle() && BaseDRAMSystem::IsIdle();
+}
+
+void JedecDRAMSystem::SkipTo(uint64_t clk) {
+    if (clk <= clk_) {
+        return;
+    }
+    clk_ = clk;
+    for (auto ctrl : ctrls_) {
+        ctrl->FastForward(clk_);
     }
+}
 
+void JedecDRAMSystem::WarmRowBuffer(uint64_t hex_addr, bool is_write) {
+    Transaction trans(hex_addr, is_write);
+    ctrls_[GetChannel(hex_addr)]->WarmRowBuffer(trans);
 }
 
+void JedecDRAMSystem::SaveState(CheckpointWriter &ckpt) const {
+    BaseDRAMSystem::SaveState(ckpt);
+    cim_.SaveState(ckpt, clk_);
+}
 
-IdealDRAMSystem::IdealDRAMSystem(Config &config, const std::string &output_dir,
-                                 std::function<void(uint64_t)> read_callback,
-                                 std::function<void(uint64_t)> write_callback)
+void JedecDRAMSystem::LoadState(CheckpointReader &ckpt) {
+    BaseDRAMSystem::LoadState(ckpt);
+    cim_.LoadState(ckpt, clk_);
+}
+
+AnalyticDRAMSystem::AnalyticDRAMSystem(
+    Config &config, const std::string &output_dir,
+    std::function<void(uint64_t)> read_callback,
+    std::function<void(uint64_t)> write_callback)
     : BaseDRAMSystem(config, output_dir, read_callback, write_callback),
-      latency_(config_.ideal_memory_latency) {}
+      queues_(config_.channels),
+      num_reads_(config_.channels, 0),
+      num_writes_(config_.channels, 0),
+      num_bursts_(config_.channels, 0),
+      read_latency_sum_(config_.channels, 0),
+      stats_start_clk_(0) {
+    int activate = (config_.IsGDDR() || config_.IsHBM()) ? config_.tRCDRD
+                                                          : config_.tRCD;
+    access_latency_ = activate + config_.read_delay;
+}
+
+bool AnalyticDRAMSystem::WillAcceptTransaction(uint64_t hex_addr,
+                                               bool is_write) const {
+    return ChannelAccepts(GetChannel(hex_addr));
+}
+
+bool AnalyticDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write) {
+    Transaction trans(hex_addr, is_write);
+    return Enqueue(trans);
+}
+
+bool AnalyticDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write,
+                                        uint64_t tag,
+                                        const RequestMeta &meta) {
+    Transaction trans(hex_addr, is_write, tag, meta);
+    return Enqueue(trans);
+}
 
-IdealDRAMSystem::~IdealDRAMSystem() {}
+bool AnalyticDRAMSystem::WillAcceptTransaction(Transaction &trans) const {
+    return WillAcceptTransaction(trans.addr, trans.is_write);
+}
 
-bool IdealDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write) {
-    auto trans = Transaction(hex_addr, is_write);
+bool AnalyticDRAMSystem::AddTransaction(Transaction &trans) {
+    if (trans.IsOperation()) {
+        std::cerr << "CiM operations are not modeled by analytic backends"
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    return Enqueue(trans);
+}
+
+bool AnalyticDRAMSystem::Enqueue(Transaction &trans) {
+    int channel = GetChannel(trans.addr);
+    auto &queue = queues_[channel];
     trans.added_cycle = clk_;
-    infinite_buffer_q_.push_back(trans);
+    trans.complete_cycle = CompleteCycle(channel, config_.Bursts(trans.size));
+    // requests of a channel leave in arrival order
+    if (!queue.empty() && trans.complete_cycle < queue.back().complete_cycle) {
+        trans.complete_cycle = queue.back().complete_cycle;
+    }
+    queue.push_back(trans);
+    last_req_clk_ = clk_;
     return true;
 }
 
-void IdealDRAMSystem::ClockTick() {
-    for (auto trans_it = infinite_buffer_q_.begin();
-         trans_it != infinite_buffer_q_.end();) {
-        if (clk_ - trans_it->added_cycle >= static_cast<uint64_t>(latency_)) {
-            if (trans_it->is_write) {
-                write_callback_(trans_it->addr);
+void AnalyticDRAMSystem::ClockTick() {
+    for (size_t i = 0; i < queues_.size(); i++) {
+        auto &queue = queues_[i];
+        while (!queue.empty() && queue.front().complete_cycle <= clk_) {
+            const Transaction &trans = queue.front();
+            if (trans.is_write) {
+                num_writes_[i]++;
             } else {
-                read_callback_(trans_it->addr);
+                num_reads_[i]++;
+                read_latency_sum_[i] += clk_ - trans.added_cycle;
             }
-            trans_it = infinite_buffer_q_.erase(trans_it++);
-        }
-        if (trans_it != infinite_buffer_q_.end()) {
-            ++trans_it;
+            num_bursts_[i] += config_.Bursts(trans.size);
+            ReturnTransaction(trans);
+            queue.pop_front();
         }
     }
-
     clk_++;
     return;
 }
 
+bool AnalyticDRAMSystem::IsIdle() const {
+    for (const auto &queue : queues_) {
+        if (!queue.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AnalyticDRAMSystem::PrintStats() {
+    // same layout as the channel stats of the cycle accurate backends, with
+    // the subset of stats an analytic model can provide
+    uint64_t cycles = clk_ - stats_start_clk_;
+    nlohmann::json j_data;
+    for (size_t i = 0; i < queues_.size(); i++) {
+        nlohmann::json j_channel;
+        j_channel["num_cycles"] = cycles;
+        j_channel["num_reads_done"] = num_reads_[i];
+        j_channel["num_writes_done"] = num_writes_[i];
+        j_channel["average_read_latency"] =
+            num_reads_[i] == 0
+                ? 0.0
+                : static_cast<double>(read_latency_sum_[i]) / num_reads_[i];
+        j_channel["average_bandwidth"] =
+            cycles == 0 ? 0.0
+                        : num_bursts_[i] * config_.request_size_bytes /
+                              (cycles * config_.tCK);
+        j_data[std::to_string(i)] = j_channel;
+    }
+    std::ofstream json_out(config_.json_stats_name, std::ofstream::out);
+    json_out << j_data.dump(4) << std::endl;
+}
+
+void AnalyticDRAMSystem::ResetStats() {
+    std::fill(num_reads_.begin(), num_reads_.end(), 0);
+    std::fill(num_writes_.begin(), num_writes_.end(), 0);
+    std::fill(num_bursts_.begin(), num_bursts_.end(), 0);
+    std::fill(read_latency_sum_.begin(), read_latency_sum_.end(), 0);
+    stats_start_clk_ = clk_;
+}
+
+void AnalyticDRAMSystem::SaveState(CheckpointWriter &ckpt) const {
+    BaseDRAMSystem::SaveState(ckpt);
+    for (const auto &queue : queues_) {
+        ckpt.Write(queue);
+    }
+    ckpt.Write(num_reads_);
+    ckpt.Write(num_writes_);
+    ckpt.Write(num_bursts_);
+    ckpt.Write(read_latency_sum_);
+    ckpt.Write(stats_start_clk_);
+}
+
+void AnalyticDRAMSystem::LoadState(CheckpointReader &ckpt) {
+    BaseDRAMSystem::LoadState(ckpt);
+    for (auto &queue : queues_) {
+        ckpt.Read(queue);
+    }
+    ckpt.Read(num_reads_);
+    ckpt.Read(num_writes_);
+    ckpt.Read(num_bursts_);
+    ckpt.Read(read_latency_sum_);
+    ckpt.Read(stats_start_clk_);
+}
+
+IdealDRAMSystem::IdealDRAMSystem(Config &config, const std::string &output_dir,
+                                 std::function<void(uint64_t)> read_callback,
+                                 std::function<void(uint64_t)> write_callback)
+    : AnalyticDRAMSystem(config, output_dir, read_callback, write_callback),
+      latency_(config_.ideal_memory_latency) {}
+
+uint64_t IdealDRAMSystem::CompleteCycle(int channel, int bursts) {
+    return clk_ + latency_;
+}
+
+BandwidthDRAMSystem::BandwidthDRAMSystem(
+    Config &config, const std::string &output_dir,
+    std::function<void(uint64_t)> read_callback,
+    std::function<void(uint64_t)> write_callback)
+    : AnalyticDRAMSystem(config, output_dir, read_callback, write_callback),
+      bus_free_cycle_(config_.channels, 0) {}
+
+uint64_t BandwidthDRAMSystem::CompleteCycle(int channel, int bursts) {
+    uint64_t start = std::max(clk_, bus_free_cycle_[channel]);
+    bus_free_cycle_[channel] = start + bursts * config_.burst_cycle;
+    return start + access_latency_ + (bursts - 1) * config_.burst_cycle;
+}
+
+bool BandwidthDRAMSystem::ChannelAccepts(int channel) const {
+    uint64_t backlog = config_.trans_queue_size * config_.burst_cycle;
+    return bus_free_cycle_[channel] < clk_ + backlog;
+}
+
+void BandwidthDRAMSystem::SaveState(CheckpointWriter &ckpt) const {
+    AnalyticDRAMSystem::SaveState(ckpt);
+    ckpt.Write(bus_free_cycle_);
+}
+
+void BandwidthDRAMSystem::LoadState(CheckpointReader &ckpt) {
+    AnalyticDRAMSystem::LoadState(ckpt);
+    ckpt.Read(bus_free_cycle_);
+}
+
+namespace {
+// weight of the newest inter-arrival time in the moving average
+const double kArrivalSmoothing = 1.0 / 32;
+// the M/D/1 delay diverges at full utilization, cap it
+const double kMaxUtilization = 0.95;
+}  // namespace
+
+QueueingDRAMSystem::QueueingDRAMSystem(
+    Config &config, const std::string &output_dir,
+    std::function<void(uint64_t)> read_callback,
+    std::function<void(uint64_t)> write_callback)
+    : AnalyticDRAMSystem(config, output_dir, read_callback, write_callback),
+      last_arrival_(config_.channels, 0),
+      mean_interarrival_(config_.channels, 0.0) {}
+
+uint64_t QueueingDRAMSystem::CompleteCycle(int channel, int bursts) {
+    double service = config_.burst_cycle;
+    double &mean = mean_interarrival_[channel];
+    double interarrival = clk_ - last_arrival_[channel];
+    // the first arrival of a channel only seeds the average
+    if (mean == 0.0) {
+        mean = std::max(interarrival, service);
+    } else {
+        mean += kArrivalSmoothing * (interarrival - mean);
+    }
+    last_arrival_[channel] = clk_;
+
+    double rho = std::min(service / std::max(mean, 1.0), kMaxUtilization);
+    double wait = rho * service / (2.0 * (1.0 - rho));
+    return clk_ + access_latency_ + static_cast<uint64_t>(std::round(wait)) +
+           (bursts - 1) * config_.burst_cycle;
+}
+
+bool QueueingDRAMSystem::ChannelAccepts(int channel) const {
+    // arrivals faster than the service rate are refused, the model has no
+    // steady state past that
+    bool idle = mean_interarrival_[channel] == 0.0 ||
+                clk_ >= last_arrival_[channel] + config_.burst_cycle;
+    return idle &&
+           InFlight(channel) < static_cast<size_t>(config_.trans_queue_size);
+}
+
+void QueueingDRAMSystem::SaveState(CheckpointWriter &ckpt) const {
+    AnalyticDRAMSystem::SaveState(ckpt);
+    ckpt.Write(last_arrival_);
+    ckpt.Write(mean_interarrival_);
+}
+
+void QueueingDRAMSystem::LoadState(CheckpointReader &ckpt) {
+    AnalyticDRAMSystem::LoadState(ckpt);
+    ckpt.Read(last_arrival_);
+    ckpt.Read(mean_interarrival_);
+}
 
 }  // namespace dramsim3
@@ -1,10 +1,14 @@
 #ifndef __DRAM_SYSTEM_H
 #define __DRAM_SYSTEM_H
 
+#include <deque>
 #include <fstream>
+#include <map>
 #include <string>
 #include <vector>
 
+#include "checkpoint.h"
+#include "cim.h"
 #include "common.h"
 #include "configuration.h"
 #include "controller.h"
@@ -16,12 +20,6 @@
 
 namespace dramsim3 {
 
-enum class CiMReqType {
-    CiM_Add,
-    CiM_Xor,
-    CiM_Swap
-    };
-
 class BaseDRAMSystem {
    public:
     BaseDRAMSystem(Config &config, const std::string &output_dir,
@@ -30,24 +28,42 @@ class BaseDRAMSystem {
     virtual ~BaseDRAMSystem() {}
     void RegisterCallbacks(std::function<void(uint64_t)> read_callback,
                            std::function<void(uint64_t)> write_callback);
+    void RegisterCompletionCallback(
+        std::function<void(const Completion &)> completion_callback);
+    void DrainCompletions(std::vector<Completion> &completions);
     void PrintEpochStats();
-    void PrintStats();
-    void ResetStats();
+    virtual void PrintStats();
+    virtual void ResetStats();
 
     virtual bool WillAcceptTransaction(uint64_t hex_addr,
                                        bool is_write) const = 0;
     virtual bool AddTransaction(uint64_t hex_addr, bool is_write) = 0;
+    virtual bool AddTransaction(uint64_t hex_addr, bool is_write, uint64_t tag,
+                                const RequestMeta &meta) = 0;
     //Overloading for CIM
     virtual bool WillAcceptTransaction(Transaction& trans) const = 0;
     virtual bool AddTransaction(Transaction& trans) = 0;
     
     virtual void ClockTick() = 0;
+    // nothing in flight, no callback is pending
+    virtual bool IsIdle() const;
     int GetChannel(uint64_t hex_addr) const;
 
+    // checkpointing, derived systems append their own state
+    virtual void SaveState(CheckpointWriter &ckpt) const;
+    virtual void LoadState(CheckpointReader &ckpt);
+
     std::function<void(uint64_t req_id)> read_callback_, write_callback_;
-    static int total_channels_;
 
    protected:
+    // tagged requests go to the completion callback if there is one,
+    // otherwise they are buffered until drained, untagged requests go to the
+    // read/write callbacks
+    void ReturnTransaction(const Transaction &trans);
+    void DeliverCompletion(const Completion &completion);
+    std::function<void(const Completion &)> completion_callback_;
+    std::vector<Completion> completions_;
+
     uint64_t req_id_;
     uint64_t last_req_clk_;
     Config &config_;
@@ -62,6 +78,14 @@ class BaseDRAMSystem {
     uint64_t clk_;
     std::vector<Controller*> ctrls_;
 
+    // epoch output is started fresh after a restored checkpoint
+    bool epoch_file_started_;
+
+    // sampled simulation, values of each measured window by stat name
+    std::map<std::string, std::vector<double>> samples_;
+    void RecordSample();
+    void PrintSampleStats() const;
+
 #ifdef ADDR_TRACE
     std::ofstream address_trace_;
 #endif  // ADDR_TRACE
@@ -69,16 +93,6 @@ class BaseDRAMSystem {
 
 // hmmm not sure this is the best naming...
 class JedecDRAMSystem : public BaseDRAMSystem {
-   std::unordered_map<uint64_t,int> no_of_reads_and_writes_for_cim;
-   std::unordered_map<uint64_t,int> pending_callbacks;
-   std::unordered_map<uint64_t, uint64_t> address_map_for_addxor;
-   std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> address_map_for_swap;
-   std::unordered_map<uint64_t, CiMReqType> req_id_to_cim;
-   std::unordered_map<uint64_t,std::pair<uint64_t,uint64_t>> clock_cycle_record;
-   std::unordered_map<uint64_t, std::vector<uint64_t>> pending_transactions;
-   int CiM_Add_Delay;
-   int CiM_Xor_Delay;
-   int CiM_Swap_Delay;
    public:
     JedecDRAMSystem(Config &config, const std::string &output_dir,
                     std::function<void(uint64_t)> read_callback,
@@ -86,33 +100,130 @@ class JedecDRAMSystem : public BaseDRAMSystem {
     ~JedecDRAMSystem();
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const override;
     bool AddTransaction(uint64_t hex_addr, bool is_write) override;
-    //Overloading for CIM
+    bool AddTransaction(uint64_t hex_addr, bool is_write, uint64_t tag,
+                        const RequestMeta &meta) override;
+    // CiM operations
     bool WillAcceptTransaction(Transaction& trans) const override;
-    bool AddTransaction(Transaction& trans) ;
-    void CiM_CallBack(uint64_t req_id);
-    void issue_pending_transactions(uint64_t clk);
+    bool AddTransaction(Transaction& trans) override;
+    void ClockTick() override;
+    bool IsIdle() const override;
+    void SaveState(CheckpointWriter &ckpt) const override;
+    void LoadState(CheckpointReader &ckpt) override;
+
+    // hybrid fidelity support, only valid while idle: skip the clock ahead
+    // (refreshes due in between just close rows) and open the row a request
+    // served by another backend would have left open
+    void SkipTo(uint64_t clk);
+    void WarmRowBuffer(uint64_t hex_addr, bool is_write);
+
+   private:
+    bool AddReadWrite(Transaction &trans);
+    bool IsDetailedCycle() const;
+    bool IsFastForwarding(int channel) const;
+    void SyncControllers();
+
+    CiMEngine cim_;
+};
+
+// Common part of the analytic backends below. Every request gets its
+// completion cycle when it arrives and the requests of a channel complete in
+// FIFO order, so the cost per request is O(1) and nothing is scanned per
+// cycle. CiM operations are not modeled.
+class AnalyticDRAMSystem : public BaseDRAMSystem {
+   public:
+    AnalyticDRAMSystem(Config &config, const std::string &output_dir,
+                       std::function<void(uint64_t)> read_callback,
+                       std::function<void(uint64_t)> write_callback);
+    bool WillAcceptTransaction(uint64_t hex_addr,
+                               bool is_write) const override;
+    bool AddTransaction(uint64_t hex_addr, bool is_write) override;
+    bool AddTransaction(uint64_t hex_addr, bool is_write, uint64_t tag,
+                        const RequestMeta &meta) override;
+    bool WillAcceptTransaction(Transaction &trans) const override;
+    bool AddTransaction(Transaction &trans) override;
     void ClockTick() override;
+    bool IsIdle() const override;
+    void PrintStats() override;
+    void ResetStats() override;
+    void SaveState(CheckpointWriter &ckpt) const override;
+    void LoadState(CheckpointReader &ckpt) override;
+
+   protected:
+    // completion cycle of a request of bursts bursts arriving at a channel
+    // in this cycle
+    virtual uint64_t CompleteCycle(int channel, int bursts) = 0;
+    virtual bool ChannelAccepts(int channel) const { return true; }
+    size_t InFlight(int channel) const { return queues_[channel].size(); }
+
+    // unloaded closed page read latency, from the .ini timing
+    uint64_t access_latency_;
+
+   private:
+    bool Enqueue(Transaction &trans);
+
+    std::vector<std::deque<Transaction>> queues_;
+    std::vector<uint64_t> num_reads_;
+    std::vector<uint64_t> num_writes_;
+    std::vector<uint64_t> num_bursts_;
+    std::vector<uint64_t> read_latency_sum_;
+    uint64_t stats_start_clk_;
 };
 
 // Model a memorysystem with an infinite bandwidth and a fixed latency (possibly
 // zero) To establish a baseline for what a 'good' memory standard can and
 // cannot do for a given application
-class IdealDRAMSystem : public BaseDRAMSystem {
+class IdealDRAMSystem : public AnalyticDRAMSystem {
    public:
     IdealDRAMSystem(Config &config, const std::string &output_dir,
                     std::function<void(uint64_t)> read_callback,
                     std::function<void(uint64_t)> write_callback);
-    ~IdealDRAMSystem();
-    bool WillAcceptTransaction(uint64_t hex_addr,
-                               bool is_write) const override {
-        return true;
-    };
-    bool AddTransaction(uint64_t hex_addr, bool is_write) override;
-    void ClockTick() override;
+
+   protected:
+    uint64_t CompleteCycle(int channel, int bursts) override;
 
    private:
     int latency_;
-    std::vector<Transaction> infinite_buffer_q_;
+};
+
+// Fixed latency, but each request holds the data bus of its channel for one
+// burst, so a channel never exceeds its peak bandwidth. At most
+// trans_queue_size bursts can be waiting for the bus.
+class BandwidthDRAMSystem : public AnalyticDRAMSystem {
+   public:
+    BandwidthDRAMSystem(Config &config, const std::string &output_dir,
+                        std::function<void(uint64_t)> read_callback,
+                        std::function<void(uint64_t)> write_callback);
+    void SaveState(CheckpointWriter &ckpt) const override;
+    void LoadState(CheckpointReader &ckpt) override;
+
+   protected:
+    uint64_t CompleteCycle(int channel, int bursts) override;
+    bool ChannelAccepts(int channel) const override;
+
+   private:
+    std::vector<uint64_t> bus_free_cycle_;
+};
+
+// M/D/1 queue per channel: the service time is one burst, the arrival rate
+// is a moving average of the observed inter-arrival times and each request
+// sees the unloaded latency plus the expected queueing delay. A channel
+// accepts at most one request per burst and has at most trans_queue_size
+// requests in flight.
+class QueueingDRAMSystem : public AnalyticDRAMSystem {
+   public:
+    QueueingDRAMSystem(Config &config, const std::string &output_dir,
+                       std::function<void(uint64_t)> read_callback,
+                       std::function<void(uint64_t)> write_callback);
+    void SaveState(CheckpointWriter &ckpt) const override;
+    void LoadState(CheckpointReader &ckpt) override;
+
+   protected:
+    uint64_t CompleteCycle(int channel, int bursts) override;
+    bool ChannelAccepts(int channel) const override;
+
+   private:
+    std::vector<uint64_t> last_arrival_;
+    std::vector<double> mean_interarrival_;
 };
 
 }  // namespace dramsim3
@@ -1,17 +1,60 @@
 #include "hmc.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace dramsim3 {
 
-HMCRequest::HMCRequest(HMCReqType req_type, uint64_t hex_addr1, int vault, uint64_t hex_addr2, uint64_t hex_addr3)
-    : type(req_type), mem_operand1(hex_addr1), mem_operand2(hex_addr2), mem_operand3(hex_addr3), vault(vault) {
+static bool IsAtomic(HMCReqType type) {
+    return type >= HMCReqType::ADD8 && type <= HMCReqType::SWAP16;
+}
+
+// EQ8 and EQ16 only compare, every other atomic writes its result back
+static bool AtomicWrites(HMCReqType type) {
+    return type != HMCReqType::EQ8 && type != HMCReqType::EQ16;
+}
+
+// data bytes of a read or write
+static uint32_t ReqBytes(HMCReqType type) {
+    int index = static_cast<int>(type);
+    if (type >= HMCReqType::P_WR16 && type <= HMCReqType::P_WR256) {
+        index -= static_cast<int>(HMCReqType::P_WR16) - 1;
+    } else if (type >= HMCReqType::WR0 && type <= HMCReqType::WR256) {
+        index -= static_cast<int>(HMCReqType::WR0);
+    } else if (type > HMCReqType::RD256) {
+        return 0;
+    }
+    // RD16 to RD128 go in steps of 16 bytes, then RD256
+    return index == 9 ? 256 : index * 16;
+}
+
+static HMCReqType AtomicReqType(AtomicOp op) {
+    return static_cast<HMCReqType>(static_cast<int>(HMCReqType::ADD8) +
+                                   static_cast<int>(op) - 1);
+}
+
+HMCRequest::HMCRequest(HMCReqType req_type, uint64_t hex_addr1, int vault,
+                       uint64_t hex_addr2, uint64_t hex_addr3)
+    : type(req_type),
+      mem_operand1(hex_addr1),
+      mem_operand2(hex_addr2),
+      mem_operand3(hex_addr3),
+      cim_op(0),
+      cim_count(1),
+      cim_stride(0),
+      link(0),
+      quad(0),
+      vault(vault),
+      cube(0),
+      at_cube(0),
+      req_id(0),
+      tag(0),
+      source_id(0),
+      priority(0),
+      is_tagged(false) {
     is_write = type >= HMCReqType::WR0 && type <= HMCReqType::P_WR256;
     is_read = type >= HMCReqType::RD0 && type <= HMCReqType::RD256;
 
-    
-    // given that vaults could be 16 (Gen1) or 32(Gen2), using % 4
-    // to partition vaults to quads
-   
-    quad = vault % 4;
     switch (req_type) {
         case HMCReqType::RD0:
         case HMCReqType::WR0:
@@ -107,11 +150,7 @@ HMCRequest::HMCRequest(HMCReqType req_type, uint64_t hex_addr1, int vault, uint6
         case HMCReqType::SWAP16:
             flits = 2;
             break;
-        case HMCReqType::CIM_FETCH:
-        case HMCReqType::CIM_STORE:
-        case HMCReqType::CIM_ADD:
-        case HMCReqType::CIM_SWAP:
-        case HMCReqType::CIM_XOR:
+        case HMCReqType::CIM:
             flits = 2;
             break;
         default:
@@ -122,7 +161,15 @@ HMCRequest::HMCRequest(HMCReqType req_type, uint64_t hex_addr1, int vault, uint6
 
 HMCResponse::HMCResponse(uint64_t id, HMCReqType req_type, int dest_link,
                          int src_quad)
-    : resp_id(id), link(dest_link), quad(src_quad) {
+    : resp_id(id),
+      link(dest_link),
+      quad(src_quad),
+      at_cube(0),
+      tag(0),
+      source_id(0),
+      is_tagged(false),
+      is_atomic(IsAtomic(req_type)),
+      issue_time(0) {
     switch (req_type) {
         case HMCReqType::RD0:
             type = HMCRespType::RD_RS;
@@ -244,26 +291,6 @@ HMCResponse::HMCResponse(uint64_t id, HMCReqType req_type, int dest_link,
             type = HMCRespType::RD_RS;
             flits = 2;
             break;
-        case HMCReqType::CIM_FETCH:
-            type = HMCRespType :: CIM_FETCH_RS;
-            flits = 0;
-            break;
-        case HMCReqType::CIM_STORE:
-            type = HMCRespType::CIM_STORE_RS;
-            flits = 0;
-            break;
-        case HMCReqType::CIM_ADD:
-            type = HMCRespType::CIM_ADD_RS;
-            flits = 0;
-            break;
-        case HMCReqType::CIM_SWAP:
-            type = HMCRespType::CIM_SWAP_RS;
-            flits = 0;
-            break;
-        case HMCReqType::CIM_XOR:
-            type = HMCRespType::CIM_XOR_RS;
-            flits = 0;
-            break;
         default:
             AbruptExit(__FILE__, __LINE__);
             break;
@@ -271,6 +298,84 @@ HMCResponse::HMCResponse(uint64_t id, HMCReqType req_type, int dest_link,
     return;
 }
 
+VaultWorkers::VaultWorkers(std::vector<Controller *> &ctrls, int threads)
+    : ctrls_(ctrls),
+      ranges_(std::min<int>(threads, ctrls.size())),
+      cycle_(0),
+      running_(0),
+      stop_(false),
+      sleeping_(0) {
+    for (int i = 1; i < ranges_; i++) {
+        threads_.emplace_back(&VaultWorkers::Work, this, i);
+    }
+}
+
+VaultWorkers::~VaultWorkers() {
+    stop_.store(true);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_.notify_all();
+    }
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+void VaultWorkers::TickRange(int range) {
+    size_t begin = ctrls_.size() * range / ranges_;
+    size_t end = ctrls_.size() * (range + 1) / ranges_;
+    for (size_t i = begin; i < end; i++) {
+        ctrls_[i]->ClockTick();
+    }
+}
+
+void VaultWorkers::ClockTick() {
+    // the release on cycle_ hands the vaults as the xbar left them to the
+    // workers, the one on running_ hands them back
+    running_.store(ranges_ - 1, std::memory_order_relaxed);
+    cycle_.fetch_add(1);
+    if (sleeping_.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_.notify_all();
+    }
+    TickRange(0);
+    while (running_.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+void VaultWorkers::Work(int range) {
+    // the xbar phases between DRAM cycles are short, a worker spins through
+    // them but sleeps through longer idle stretches
+    const int kSpinRounds = 1024;
+    uint64_t done = 0;
+    int spins = 0;
+    while (true) {
+        uint64_t cycle = cycle_.load(std::memory_order_acquire);
+        if (cycle == done) {
+            if (stop_.load(std::memory_order_relaxed)) {
+                return;
+            }
+            if (++spins < kSpinRounds) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            sleeping_.fetch_add(1);
+            wake_.wait(lock, [this, done] {
+                return cycle_.load() != done || stop_.load();
+            });
+            sleeping_.fetch_sub(1);
+            spins = 0;
+            continue;
+        }
+        spins = 0;
+        TickRange(range);
+        done = cycle;
+        running_.fetch_sub(1, std::memory_order_release);
+    }
+}
+
 HMCMemorySystem::HMCMemorySystem(Config &config, const std::string &output_dir,
                                  std::function<void(uint64_t)> read_callback,
                                  std::function<void(uint64_t)> write_callback)
@@ -279,7 +384,15 @@ HMCMemorySystem::HMCMemorySystem(Config &config, const std::string &output_dir,
       logic_ps_(0),
       dram_ps_(0),
       next_link_(0),
-      req_id_(1000){
+      req_packets_(0),
+      resp_packets_(0),
+      req_busy_clk_(0),
+      resp_busy_clk_(0),
+      age_queue_len_(0),
+      stats_start_logic_clk_(0),
+      link_rng_(0x9E3779B97F4A7C15ull),
+      atomic_stats_(),
+      cim_(config_, ctrls_) {
     // sanity check, this constructor should only be intialized using HMC
     if (!config_.IsHMC()) {
         std::cerr << "Initialzed an HMC system without an HMC config file!"
@@ -290,8 +403,21 @@ HMCMemorySystem::HMCMemorySystem(Config &config, const std::string &output_dir,
     // setting up clock
     SetClockRatio();
 
-    ctrls_.reserve(config_.channels);
-    for (int i = 0; i < config_.channels; i++) {
+    // the vaults of all chained cubes, cube by cube
+    cubes_ = config_.num_cubes;
+#ifdef THERMAL
+    if (cubes_ > 1) {
+        std::cerr << "Thermal modeling covers a single HMC cube" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    // the vaults share the thermal calculator
+    if (config_.vault_threads > 1) {
+        std::cerr << "Thermal modeling needs vault_threads = 1" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+#endif  // THERMAL
+    ctrls_.reserve(config_.channels * cubes_);
+    for (int i = 0; i < config_.channels * cubes_; i++) {
 #ifdef THERMAL
         ctrls_.push_back(new Controller(i, config_, timing_, thermal_calc_));
 #else
@@ -304,21 +430,35 @@ HMCMemorySystem::HMCMemorySystem(Config &config, const std::string &output_dir,
     // (each quadrant has 8 vaults and each quadrant can access any ohter
     // quadrant)
     queue_depth_ = static_cast<size_t>(config_.xbar_queue_depth);
+    xbar_bandwidth_ = config_.xbar_bandwidth;
     links_ = config_.num_links;
+    quads_ = config_.num_quads;
     link_req_queues_.reserve(links_);
     link_resp_queues_.reserve(links_);
     for (int i = 0; i < links_; i++) {
-        link_req_queues_.push_back(std::vector<HMCRequest *>());
-        link_resp_queues_.push_back(std::vector<HMCResponse *>());
+        link_req_queues_.push_back(RingBuffer<HMCRequest *>(queue_depth_));
+        link_resp_queues_.push_back(RingBuffer<HMCResponse *>(queue_depth_));
     }
 
-    // don't want to hard coding it but there are 4 quads so it's kind of fixed
-    quad_req_queues_.reserve(4);
-    quad_resp_queues_.reserve(4);
-    for (int i = 0; i < 4; i++) {
-        quad_req_queues_.push_back(std::vector<HMCRequest *>());
-        quad_resp_queues_.push_back(std::vector<HMCResponse *>());
+    // vaults are partitioned to quads by vault % quads, Gen1/Gen2 parts
+    // have 4 quads of 4 or 8 vaults
+    int all_quads = quads_ * cubes_;
+    quad_req_queues_.reserve(all_quads);
+    quad_resp_queues_.reserve(all_quads);
+    for (int i = 0; i < all_quads; i++) {
+        quad_req_queues_.push_back(RingBuffer<HMCRequest *>(queue_depth_));
+        quad_resp_queues_.push_back(RingBuffer<HMCResponse *>(queue_depth_));
     }
+    quad_busy_.assign(all_quads, 0);
+    quad_age_counter_.assign(all_quads, 0);
+    age_queue_.resize(std::max(links_, all_quads));
+
+    for (int i = 0; i < cubes_; i++) {
+        dev_req_queues_.push_back(RingBuffer<HMCRequest *>(queue_depth_));
+        dev_resp_queues_.push_back(RingBuffer<HMCResponse *>(queue_depth_));
+    }
+    dev_req_busy_.assign(cubes_, 0);
+    dev_resp_busy_.assign(cubes_, 0);
 
     link_busy_.reserve(links_);
     link_age_counter_.reserve(links_);
@@ -326,14 +466,416 @@ HMCMemorySystem::HMCMemorySystem(Config &config, const std::string &output_dir,
         link_busy_.push_back(0);
         link_age_counter_.push_back(0);
     }
+
+    req_tx_free_.assign(links_, 0);
+    resp_tx_free_.assign(links_, 0);
+    link_tokens_.assign(links_, config_.link_tokens);
+    for (int i = 0; i < links_; i++) {
+        token_returns_.push_back(
+            RingBuffer<std::pair<uint64_t, int>>(queue_depth_));
+    }
+    link_stats_.assign(links_, HMCLinkStats());
+    atomic_unit_ = RingBuffer<uint32_t>(queue_depth_);
+    if (config_.vault_threads > 1) {
+        vault_workers_.reset(new VaultWorkers(ctrls_, config_.vault_threads));
+    }
 }
 
 HMCMemorySystem::~HMCMemorySystem() {
+    vault_workers_.reset();
     for (auto &&vault_ptr : ctrls_) {
         delete (vault_ptr);
     }
 }
 
+// xbar buffers hold pointers, so packets are checkpointed by value
+// cycles logic cycles of a busy port draining bandwidth flits per cycle
+static void DrainBusy(std::vector<int> &busy, int bandwidth,
+                      uint64_t cycles) {
+    for (auto &&i : busy) {
+        if (i > 0) {
+            uint64_t steps = (i + bandwidth - 1) / bandwidth;
+            i -= static_cast<int>(std::min(cycles, steps)) * bandwidth;
+        }
+    }
+}
+
+static void SavePacket(CheckpointWriter &ckpt, const HMCRequest *req) {
+    ckpt.Write(req->type);
+    ckpt.Write(req->mem_operand1);
+    ckpt.Write(req->mem_operand2);
+    ckpt.Write(req->mem_operand3);
+    ckpt.Write(req->cim_op);
+    ckpt.Write(req->cim_count);
+    ckpt.Write(req->cim_stride);
+    ckpt.Write(req->link);
+    ckpt.Write(req->quad);
+    ckpt.Write(req->vault);
+    ckpt.Write(req->cube);
+    ckpt.Write(req->at_cube);
+    ckpt.Write(req->flits);
+    ckpt.Write(req->is_write);
+    ckpt.Write(req->is_read);
+    ckpt.Write(req->exit_time);
+    ckpt.Write(req->req_id);
+    ckpt.Write(req->tag);
+    ckpt.Write(req->source_id);
+    ckpt.Write(req->priority);
+    ckpt.Write(req->is_tagged);
+}
+
+static void LoadPacket(CheckpointReader &ckpt, HMCRequest *req) {
+    ckpt.Read(req->type);
+    ckpt.Read(req->mem_operand1);
+    ckpt.Read(req->mem_operand2);
+    ckpt.Read(req->mem_operand3);
+    ckpt.Read(req->cim_op);
+    ckpt.Read(req->cim_count);
+    ckpt.Read(req->cim_stride);
+    ckpt.Read(req->link);
+    ckpt.Read(req->quad);
+    ckpt.Read(req->vault);
+    ckpt.Read(req->cube);
+    ckpt.Read(req->at_cube);
+    ckpt.Read(req->flits);
+    ckpt.Read(req->is_write);
+    ckpt.Read(req->is_read);
+    ckpt.Read(req->exit_time);
+    ckpt.Read(req->req_id);
+    ckpt.Read(req->tag);
+    ckpt.Read(req->source_id);
+    ckpt.Read(req->priority);
+    ckpt.Read(req->is_tagged);
+}
+
+static void SavePacket(CheckpointWriter &ckpt, const HMCResponse *resp) {
+    ckpt.Write(resp->resp_id);
+    ckpt.Write(resp->type);
+    ckpt.Write(resp->link);
+    ckpt.Write(resp->quad);
+    ckpt.Write(resp->at_cube);
+    ckpt.Write(resp->flits);
+    ckpt.Write(resp->exit_time);
+    ckpt.Write(resp->tag);
+    ckpt.Write(resp->source_id);
+    ckpt.Write(resp->is_tagged);
+    ckpt.Write(resp->is_atomic);
+    ckpt.Write(resp->issue_time);
+}
+
+static void LoadPacket(CheckpointReader &ckpt, HMCResponse *resp) {
+    ckpt.Read(resp->resp_id);
+    ckpt.Read(resp->type);
+    ckpt.Read(resp->link);
+    ckpt.Read(resp->quad);
+    ckpt.Read(resp->at_cube);
+    ckpt.Read(resp->flits);
+    ckpt.Read(resp->exit_time);
+    ckpt.Read(resp->tag);
+    ckpt.Read(resp->source_id);
+    ckpt.Read(resp->is_tagged);
+    ckpt.Read(resp->is_atomic);
+    ckpt.Read(resp->issue_time);
+}
+
+template <typename T>
+static void SaveQueues(CheckpointWriter &ckpt,
+                       const std::vector<RingBuffer<T *>> &queues) {
+    for (const auto &queue : queues) {
+        ckpt.Write(static_cast<uint64_t>(queue.size()));
+        for (size_t i = 0; i < queue.size(); i++) {
+            SavePacket(ckpt, queue[i]);
+        }
+    }
+}
+
+template <typename T, typename... Args>
+static void LoadQueues(CheckpointReader &ckpt,
+                       std::vector<RingBuffer<T *>> &queues,
+                       ObjectPool<T> &pool, Args... blank) {
+    for (auto &queue : queues) {
+        while (!queue.empty()) {
+            pool.Delete(queue.front());
+            queue.pop_front();
+        }
+        uint64_t size = 0;
+        ckpt.Read(size);
+        for (uint64_t i = 0; i < size && ckpt.Good(); i++) {
+            T *packet = pool.New(blank...);
+            LoadPacket(ckpt, packet);
+            queue.push_back(packet);
+        }
+    }
+}
+
+bool HMCMemorySystem::IsIdle() const {
+    if (free_resp_ids_.size() != resp_table_.size() || !cim_.IsIdle()) {
+        return false;
+    }
+    for (int i = 0; i < links_; i++) {
+        if (!link_req_queues_[i].empty() || !link_resp_queues_[i].empty()) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < quad_req_queues_.size(); i++) {
+        if (!quad_req_queues_[i].empty() || !quad_resp_queues_[i].empty()) {
+            return false;
+        }
+    }
+    for (int i = 0; i < cubes_; i++) {
+        if (!dev_req_queues_[i].empty() || !dev_resp_queues_[i].empty()) {
+            return false;
+        }
+    }
+    return BaseDRAMSystem::IsIdle();
+}
+
+void HMCMemorySystem::SaveState(CheckpointWriter &ckpt) const {
+    BaseDRAMSystem::SaveState(ckpt);
+    ckpt.Write(logic_clk_);
+    ckpt.Write(logic_ps_);
+    ckpt.Write(dram_ps_);
+    ckpt.Write(next_link_);
+    ckpt.Write(static_cast<uint64_t>(resp_table_.size()));
+    for (const auto resp : resp_table_) {
+        ckpt.Write(resp != nullptr);
+        if (resp != nullptr) {
+            SavePacket(ckpt, resp);
+        }
+    }
+    ckpt.Write(free_resp_ids_);
+    SaveQueues(ckpt, link_req_queues_);
+    SaveQueues(ckpt, link_resp_queues_);
+    SaveQueues(ckpt, quad_req_queues_);
+    SaveQueues(ckpt, quad_resp_queues_);
+    SaveQueues(ckpt, dev_req_queues_);
+    SaveQueues(ckpt, dev_resp_queues_);
+    ckpt.Write(req_tx_free_);
+    ckpt.Write(resp_tx_free_);
+    ckpt.Write(link_tokens_);
+    for (const auto &returns : token_returns_) {
+        ckpt.Write(static_cast<uint64_t>(returns.size()));
+        for (size_t i = 0; i < returns.size(); i++) {
+            ckpt.Write(returns[i]);
+        }
+    }
+    for (const auto &stats : link_stats_) {
+        for (const auto *dir : {&stats.req, &stats.resp}) {
+            ckpt.Write(dir->packets);
+            ckpt.Write(dir->flits);
+            ckpt.Write(dir->busy_cycles);
+            ckpt.Write(dir->retries);
+        }
+        ckpt.Write(stats.stall_buffer_full);
+        ckpt.Write(stats.stall_no_tokens);
+        ckpt.Write(stats.stall_xbar);
+        ckpt.Write(stats.stall_link_busy);
+    }
+    ckpt.Write(stats_start_logic_clk_);
+    ckpt.Write(link_rng_);
+    // busy counters as of now, an idle side has yet to catch up on them
+    std::vector<int> busy = link_busy_;
+    DrainBusy(busy, xbar_bandwidth_, logic_clk_ - resp_busy_clk_);
+    ckpt.Write(busy);
+    busy = quad_busy_;
+    DrainBusy(busy, xbar_bandwidth_, logic_clk_ - req_busy_clk_);
+    ckpt.Write(busy);
+    busy = dev_req_busy_;
+    DrainBusy(busy, config_.dev_link_bandwidth, logic_clk_ - req_busy_clk_);
+    ckpt.Write(busy);
+    busy = dev_resp_busy_;
+    DrainBusy(busy, config_.dev_link_bandwidth, logic_clk_ - resp_busy_clk_);
+    ckpt.Write(busy);
+    ckpt.Write(link_age_counter_);
+    ckpt.Write(quad_age_counter_);
+    ckpt.Write(static_cast<uint64_t>(atomics_.size()));
+    for (const auto &atomic : atomics_) {
+        ckpt.Write(atomic.type);
+        ckpt.Write(atomic.addr);
+        ckpt.Write(atomic.vault);
+        ckpt.Write(atomic.writing);
+        ckpt.Write(atomic.due);
+    }
+    ckpt.Write(static_cast<uint64_t>(atomic_unit_.size()));
+    for (size_t i = 0; i < atomic_unit_.size(); i++) {
+        ckpt.Write(atomic_unit_[i]);
+    }
+    ckpt.Write(atomic_stats_.returned);
+    ckpt.Write(atomic_stats_.posted);
+    ckpt.Write(atomic_stats_.flits);
+    ckpt.Write(atomic_stats_.host_flits);
+    ckpt.Write(atomic_stats_.latency);
+    cim_.SaveState(ckpt, clk_);
+}
+
+void HMCMemorySystem::LoadState(CheckpointReader &ckpt) {
+    BaseDRAMSystem::LoadState(ckpt);
+    ckpt.Read(logic_clk_);
+    ckpt.Read(logic_ps_);
+    ckpt.Read(dram_ps_);
+    ckpt.Read(next_link_);
+    for (auto resp : resp_table_) {
+        if (resp != nullptr) {
+            resp_pool_.Delete(resp);
+        }
+    }
+    uint64_t num_slots = 0;
+    ckpt.Read(num_slots);
+    resp_table_.assign(ckpt.Good() ? num_slots : 0, nullptr);
+    for (auto &resp : resp_table_) {
+        bool in_use = false;
+        ckpt.Read(in_use);
+        if (in_use && ckpt.Good()) {
+            resp = resp_pool_.New(0, HMCReqType::RD0, 0, 0);
+            LoadPacket(ckpt, resp);
+        }
+    }
+    ckpt.Read(free_resp_ids_);
+    LoadQueues(ckpt, link_req_queues_, req_pool_, HMCReqType::RD0, 0, 0);
+    LoadQueues(ckpt, link_resp_queues_, resp_pool_, 0, HMCReqType::RD0, 0,
+               0);
+    LoadQueues(ckpt, quad_req_queues_, req_pool_, HMCReqType::RD0, 0, 0);
+    LoadQueues(ckpt, quad_resp_queues_, resp_pool_, 0, HMCReqType::RD0, 0,
+               0);
+    LoadQueues(ckpt, dev_req_queues_, req_pool_, HMCReqType::RD0, 0, 0);
+    LoadQueues(ckpt, dev_resp_queues_, resp_pool_, 0, HMCReqType::RD0, 0,
+               0);
+    ckpt.Read(req_tx_free_);
+    ckpt.Read(resp_tx_free_);
+    ckpt.Read(link_tokens_);
+    for (auto &returns : token_returns_) {
+        returns.clear();
+        uint64_t size = 0;
+        ckpt.Read(size);
+        for (uint64_t i = 0; i < size && ckpt.Good(); i++) {
+            std::pair<uint64_t, int> item;
+            ckpt.Read(item);
+            returns.push_back(item);
+        }
+    }
+    for (auto &stats : link_stats_) {
+        for (auto *dir : {&stats.req, &stats.resp}) {
+            ckpt.Read(dir->packets);
+            ckpt.Read(dir->flits);
+            ckpt.Read(dir->busy_cycles);
+            ckpt.Read(dir->retries);
+        }
+        ckpt.Read(stats.stall_buffer_full);
+        ckpt.Read(stats.stall_no_tokens);
+        ckpt.Read(stats.stall_xbar);
+        ckpt.Read(stats.stall_link_busy);
+    }
+    ckpt.Read(stats_start_logic_clk_);
+    ckpt.Read(link_rng_);
+    ckpt.Read(link_busy_);
+    ckpt.Read(quad_busy_);
+    ckpt.Read(dev_req_busy_);
+    ckpt.Read(dev_resp_busy_);
+    req_busy_clk_ = logic_clk_;
+    resp_busy_clk_ = logic_clk_;
+    req_packets_ = 0;
+    resp_packets_ = 0;
+    for (size_t i = 0; i < link_req_queues_.size(); i++) {
+        req_packets_ += link_req_queues_[i].size();
+        resp_packets_ += link_resp_queues_[i].size();
+    }
+    for (size_t i = 0; i < quad_req_queues_.size(); i++) {
+        req_packets_ += quad_req_queues_[i].size();
+        resp_packets_ += quad_resp_queues_[i].size();
+    }
+    for (size_t i = 0; i < dev_req_queues_.size(); i++) {
+        req_packets_ += dev_req_queues_[i].size();
+        resp_packets_ += dev_resp_queues_[i].size();
+    }
+    ckpt.Read(link_age_counter_);
+    ckpt.Read(quad_age_counter_);
+    uint64_t num_atomics = 0;
+    ckpt.Read(num_atomics);
+    atomics_.resize(ckpt.Good() ? num_atomics : 0);
+    atomic_addrs_.clear();
+    for (auto &atomic : atomics_) {
+        ckpt.Read(atomic.type);
+        ckpt.Read(atomic.addr);
+        ckpt.Read(atomic.vault);
+        ckpt.Read(atomic.writing);
+        ckpt.Read(atomic.due);
+        if (atomic.type != HMCReqType::SIZE) {
+            atomic_addrs_.insert(atomic.addr);
+        }
+    }
+    atomic_unit_.clear();
+    uint64_t num_computing = 0;
+    ckpt.Read(num_computing);
+    for (uint64_t i = 0; i < num_computing && ckpt.Good(); i++) {
+        uint32_t slot = 0;
+        ckpt.Read(slot);
+        atomic_unit_.push_back(slot);
+    }
+    ckpt.Read(atomic_stats_.returned);
+    ckpt.Read(atomic_stats_.posted);
+    ckpt.Read(atomic_stats_.flits);
+    ckpt.Read(atomic_stats_.host_flits);
+    ckpt.Read(atomic_stats_.latency);
+    cim_.LoadState(ckpt, clk_);
+}
+
+void HMCMemorySystem::PrintStats() {
+    BaseDRAMSystem::PrintStats();
+    double cycles = std::max<uint64_t>(logic_clk_ - stats_start_logic_clk_, 1);
+    nlohmann::json j_data;
+    for (int i = 0; i < links_; i++) {
+        const HMCLinkStats &stats = link_stats_[i];
+        nlohmann::json j_link;
+        j_link["req_packets"] = stats.req.packets;
+        j_link["req_flits"] = stats.req.flits;
+        j_link["req_retries"] = stats.req.retries;
+        j_link["req_utilization"] = stats.req.busy_cycles / cycles;
+        j_link["resp_packets"] = stats.resp.packets;
+        j_link["resp_flits"] = stats.resp.flits;
+        j_link["resp_retries"] = stats.resp.retries;
+        j_link["resp_utilization"] = stats.resp.busy_cycles / cycles;
+        j_link["stall_buffer_full"] = stats.stall_buffer_full;
+        j_link["stall_no_tokens"] = stats.stall_no_tokens;
+        j_link["stall_xbar_cycles"] = stats.stall_xbar;
+        j_link["stall_link_busy_cycles"] = stats.stall_link_busy;
+        j_data[std::to_string(i)] = j_link;
+    }
+    std::ofstream j_out(config_.output_prefix + "hmc_links.json");
+    j_out << j_data.dump(4) << std::endl;
+
+    // 16 bytes per flit, bandwidth in GB/s
+    const HMCAtomicStats &atomics = atomic_stats_;
+    double flits_saved = static_cast<double>(atomics.host_flits) -
+                         static_cast<double>(atomics.flits);
+    nlohmann::json j_atomics;
+    j_atomics["returned"] = atomics.returned;
+    j_atomics["posted"] = atomics.posted;
+    j_atomics["link_flits"] = atomics.flits;
+    j_atomics["host_rmw_flits"] = atomics.host_flits;
+    j_atomics["bandwidth_saved"] =
+        flits_saved * 16 / (cycles * ps_per_logic_ / 1000.0);
+    double latency = 0, host_latency = 0;
+    if (atomics.returned > 0) {
+        // a host read-modify-write makes the round trip of the atomic
+        // without the atomic unit for its read, then again for its write
+        latency = static_cast<double>(atomics.latency) / atomics.returned;
+        double unit_cycles = static_cast<double>(config_.atomic_latency) *
+                             ps_per_dram_ / ps_per_logic_;
+        host_latency = std::max(latency, 2 * (latency - unit_cycles));
+    }
+    j_atomics["average_latency"] = latency;
+    j_atomics["host_rmw_latency_estimate"] = host_latency;
+    std::ofstream j_atomics_out(config_.output_prefix + "hmc_atomics.json");
+    j_atomics_out << j_atomics.dump(4) << std::endl;
+}
+
+void HMCMemorySystem::ResetStats() {
+    BaseDRAMSystem::ResetStats();
+    link_stats_.assign(links_, HMCLinkStats());
+    atomic_stats_ = HMCAtomicStats();
+    stats_start_logic_clk_ = logic_clk_;
+}
+
 void HMCMemorySystem::SetClockRatio() {
     // There are 3 clock domains here, Link (super fast), logic (fast), DRAM
     // (slow) We assume the logic process 1 flit per logic cycle and since the
@@ -342,6 +884,8 @@ void HMCMemorySystem::SetClockRatio() {
     ps_per_dram_ = 800;  // 800 ps
     int link_cycles_per_flit = 128 / config_.link_width;
     int logic_speed = config_.link_speed / link_cycles_per_flit;  // MHz
+    link_flit_ps_ = static_cast<uint64_t>(link_cycles_per_flit * 1000000.0 /
+                                          config_.link_speed);
     ps_per_logic_ =
         static_cast<uint64_t>(1000000 / static_cast<double>(logic_speed));
     if (ps_per_logic_ > ps_per_dram_) {
@@ -361,18 +905,43 @@ inline void HMCMemorySystem::IterateNextLink() {
 
 bool HMCMemorySystem::WillAcceptTransaction(uint64_t hex_addr,
                                             bool is_write) const {
-    bool insertable = false;
-    for (auto link_queue = link_req_queues_.begin();
-         link_queue != link_req_queues_.end(); link_queue++) {
-        if ((*link_queue).size() < queue_depth_) {
-            insertable = true;
-            break;
+    return LinkHasRoom(BlockFlits(is_write));
+}
+
+bool HMCMemorySystem::LinkHasRoom(int flits) const {
+    for (int i = 0; i < links_; i++) {
+        if (link_req_queues_[i].size() < queue_depth_ &&
+            link_tokens_[i] >= flits) {
+            return true;
         }
     }
-    return insertable;
+    return false;
 }
 
 bool HMCMemorySystem::AddTransaction(uint64_t hex_addr, bool is_write) {
+    HMCRequest *req = BlockRequest(hex_addr, is_write);
+    if (!InsertHMCReq(req)) {
+        req_pool_.Delete(req);
+        return false;
+    }
+    return true;
+}
+
+bool HMCMemorySystem::AddTransaction(uint64_t hex_addr, bool is_write,
+                                     uint64_t tag, const RequestMeta &meta) {
+    HMCRequest *req = BlockRequest(hex_addr, is_write);
+    req->tag = tag;
+    req->source_id = meta.source_id;
+    req->priority = meta.priority;
+    req->is_tagged = true;
+    if (!InsertHMCReq(req)) {
+        req_pool_.Delete(req);
+        return false;
+    }
+    return true;
+}
+
+HMCReqType HMCMemorySystem::BlockReqType(bool is_write) const {
     // to be compatible with other protocol we have this interface
     // when using this intreface the size of each transaction will be block_size
     HMCReqType req_type;
@@ -421,154 +990,211 @@ bool HMCMemorySystem::AddTransaction(uint64_t hex_addr, bool is_write) {
                 break;
         }
     }
-    int vault = GetChannel(hex_addr);
-    HMCRequest *req = new HMCRequest(req_type, hex_addr, vault);
-    return InsertHMCReq(req);
+    return req_type;
 }
 
-/*Overloading for CIM*/
-bool HMCMemorySystem::WillAcceptTransaction(Transaction& trans) const {
-    /* */
-    /* CIM for certain commands we need two or more request*/
-    int no_of_requests = 1;
-    if (trans.is_cim_add || trans.is_cim_xor) {
-        no_of_requests = 3; //2 CIM_FETCH and 1 CIM_STORE
+HMCRequest *HMCMemorySystem::BlockRequest(uint64_t hex_addr,
+                                          bool is_write) {
+    return req_pool_.New(BlockReqType(is_write), hex_addr,
+                         GetChannel(hex_addr));
+}
+
+HMCReqType HMCMemorySystem::SizedReqType(uint32_t size,
+                                         bool is_write) const {
+    if (size > 256) {
+        std::cerr << "HMC requests carry at most 256 bytes, got " << size
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
     }
-    if (trans.is_cim_swap)
-    {
-        no_of_requests = 4; //2 CIM_FETCH and 2 CIM_STORE
+    int index = size > 128 ? 9 : (size + 15) / 16;
+    HMCReqType base = is_write ? HMCReqType::WR0 : HMCReqType::RD0;
+    return static_cast<HMCReqType>(static_cast<int>(base) + index);
+}
+
+int HMCMemorySystem::BlockFlits(bool is_write) const {
+    return HMCRequest(BlockReqType(is_write), 0, 0).flits;
+}
+
+int HMCMemorySystem::HostRMWFlits(bool posted) const {
+    // a block read and its response, then a block write, posted or not
+    HMCReqType read = BlockReqType(false);
+    HMCReqType write = BlockReqType(true);
+    int flits = HMCRequest(read, 0, 0).flits +
+                HMCResponse(0, read, 0, 0).flits + BlockFlits(true);
+    if (!posted) {
+        flits += HMCResponse(0, write, 0, 0).flits;
     }
+    return flits;
+}
 
-    /* */
-    bool insertable = false;
-    for (auto link_queue = link_req_queues_.begin();
-        link_queue != link_req_queues_.end(); link_queue++) {
-        if ((*link_queue).size()+ no_of_requests < queue_depth_) {
-            insertable = true;
-            break;
+bool HMCMemorySystem::WillAcceptTransaction(Transaction &trans) const {
+    // a CiM operation travels as one packet, the vault checks its operands
+    if (trans.atomic_op != AtomicOp::NONE) {
+        return LinkHasRoom(
+            HMCRequest(AtomicReqType(trans.atomic_op), 0, 0).flits);
+    } else if (trans.cim_op == 0) {
+        if (trans.size == 0) {
+            return WillAcceptTransaction(trans.addr, trans.is_write);
         }
+        return LinkHasRoom(
+            HMCRequest(SizedReqType(trans.size, trans.is_write), 0, 0).flits);
     }
-
-    return insertable;
+    return LinkHasRoom(HMCRequest(HMCReqType::CIM, 0, 0).flits);
 }
 
-/*Overloading for CIM*/
-bool HMCMemorySystem::AddTransaction(Transaction& trans) {
-    // to be compatible with other protocol we have this interface
-    // when using this intreface the size of each transaction will be block_size
-    HMCReqType req_type;
-    if (trans.is_write) {
-        switch (config_.block_size) {
-        case 0:
-            req_type = HMCReqType::WR0;
-            break;
-        case 32:
-            req_type = HMCReqType::WR32;
-            break;
-        case 64:
-            req_type = HMCReqType::WR64;
-            break;
-        case 128:
-            req_type = HMCReqType::WR128;
-            break;
-        case 256:
-            req_type = HMCReqType::WR256;
-            break;
-        default:
-            req_type = HMCReqType::SIZE;
-            AbruptExit(__FILE__, __LINE__);
-            break;
+bool HMCMemorySystem::AddTransaction(Transaction &trans) {
+    if (trans.pim_op != PIMOp::NONE || trans.clone_op != RowCloneOp::NONE) {
+        std::cerr << "PIM and RowClone operations are not modeled by HMC"
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    if (trans.atomic_op != AtomicOp::NONE) {
+        return AddRequest(AtomicReqType(trans.atomic_op), trans);
+    }
+    if (trans.cim_op == 0) {
+        if (trans.size == 0) {
+            if (trans.is_tagged) {
+                return AddTransaction(
+                    trans.addr, trans.is_write, trans.tag,
+                    RequestMeta(trans.source_id, trans.priority));
+            }
+            return AddTransaction(trans.addr, trans.is_write);
         }
+        return AddRequest(SizedReqType(trans.size, trans.is_write), trans);
     }
-
-    else if(trans.is_read) {
-        switch (config_.block_size) {
-        case 0:
-            req_type = HMCReqType::RD0;
-            break;
-        case 32:
-            req_type = HMCReqType::RD32;
-            break;
-        case 64:
-            req_type = HMCReqType::RD64;
-            break;
-        case 128:
-            req_type = HMCReqType::RD128;
-            break;
-        case 256:
-            req_type = HMCReqType::RD256;
-            break;
-        default:
-            req_type = HMCReqType::SIZE;
+    // every operand of every element, the cube bits are above the span of
+    // a vector so its first and last elements cover it
+    uint64_t stride =
+        trans.cim_stride == 0 ? config_.request_size_bytes : trans.cim_stride;
+    uint64_t last = (trans.cim_count > 1 ? trans.cim_count - 1 : 0) * stride;
+    for (auto operand : {trans.addr, trans.addr2, trans.addr3}) {
+        if (CubeOf(operand) != 0 || CubeOf(operand + last) != 0) {
+            std::cerr << "CiM operations are only modeled in the first HMC "
+                         "cube"
+                      << std::endl;
             AbruptExit(__FILE__, __LINE__);
-            break;
         }
     }
-    else {
-        if (trans.is_cim_fetch)
-            req_type = HMCReqType::CIM_FETCH;
-        if (trans.is_cim_store)
-            req_type = HMCReqType::CIM_STORE;
-        if (trans.is_cim_add)
-            req_type = HMCReqType::CIM_ADD;
-        if (trans.is_cim_swap)
-            req_type = HMCReqType::CIM_SWAP;
-        if (trans.is_cim_xor)
-            req_type = HMCReqType::CIM_XOR;
-    }
-    if (trans.is_write || trans.is_read || trans.is_cim_fetch || trans.is_cim_store) {
-        int vault = GetChannel(trans.addr);
-        HMCRequest* req = new HMCRequest(req_type, trans.addr, vault);
-        return InsertHMCReq(req);
-    }
-    else if(trans.is_cim_add || trans.is_cim_xor){
-        int vault = GetChannel(trans.addr);
-        /* Sanity check. Both the mem operands must be in the same vault*/
-        /*if (vault != GetChannel(trans.addr2)) {
-            AbruptExit(__FILE__, __LINE__);
-        }*/
-        HMCRequest* req = new HMCRequest(req_type, trans.addr, vault, trans.addr2, trans.addr3);
-        return InsertHMCReq(req);
+    HMCRequest *req = req_pool_.New(HMCReqType::CIM, trans.addr,
+                                    GetChannel(trans.addr), trans.addr2,
+                                    trans.addr3);
+    req->cim_op = trans.cim_op;
+    req->cim_count = trans.cim_count;
+    req->cim_stride = trans.cim_stride;
+    if (!InsertHMCReq(req)) {
+        req_pool_.Delete(req);
+        return false;
     }
-    else if (trans.is_cim_swap) {
-        int vault = GetChannel(trans.addr);
-        HMCRequest* req = new HMCRequest(req_type, trans.addr, vault, trans.addr2, trans.addr3);
-        return InsertHMCReq(req);
+    return true;
+}
+
+bool HMCMemorySystem::AddRequest(HMCReqType type, const Transaction &trans) {
+    HMCRequest *req = req_pool_.New(type, trans.addr, GetChannel(trans.addr));
+    req->tag = trans.tag;
+    req->source_id = trans.source_id;
+    req->priority = trans.priority;
+    req->is_tagged = trans.is_tagged;
+    if (!InsertHMCReq(req)) {
+        req_pool_.Delete(req);
+        return false;
     }
+    return true;
 }
 
-/* ****** */
+Transaction HMCMemorySystem::CiMTransaction(const HMCRequest *req) const {
+    Transaction trans(req->mem_operand1, false);
+    trans.is_read = false;
+    trans.addr2 = req->mem_operand2;
+    trans.addr3 = req->mem_operand3;
+    trans.cim_op = req->cim_op;
+    trans.cim_count = req->cim_count;
+    trans.cim_stride = req->cim_stride;
+    return trans;
+}
 
 bool HMCMemorySystem::InsertReqToLink(HMCRequest *req, int link) {
     // These things need to happen when an HMC request is inserted to a link:
-    // 1. check if link queue full
-    // 2. set link field in the request packet
+    // 1. check if link queue full or out of tokens
+    // 2. set link field in the request packet, serialize it
     // 3. create corresponding response
     // 4. increment link_age_counter_ so that arbitrate logic works
-    if (link_req_queues_[link].size() < queue_depth_) {
+    if (link_req_queues_[link].size() >= queue_depth_ ||
+        link_tokens_[link] < req->flits) {
+        return false;
+    } else {
         req->link = link;
+        link_tokens_[link] -= req->flits;
+        req->exit_time =
+            SendOverLink(link_stats_[link].req, req_tx_free_[link], req->flits);
         link_req_queues_[link].push_back(req);
-            HMCResponse* resp =
-                new HMCResponse(req->mem_operand1, req->type, link, req->quad);
-            resp_lookup_table_.insert(
-                std::pair<uint64_t, HMCResponse*>(resp->resp_id, resp));
-
-
-            link_age_counter_[link] = 1;
-            // stats_.interarrival_latency.AddValue(clk_ - last_req_clk_);
-            last_req_clk_ = clk_;
+        req_packets_++;
+        if (req->type != HMCReqType::CIM) {
+            HMCResponse *resp = resp_pool_.New(req->mem_operand1, req->type,
+                                               link, req->quad);
+            resp->tag = req->tag;
+            resp->source_id = req->source_id;
+            resp->is_tagged = req->is_tagged;
+            resp->at_cube = req->cube;
+            if (resp->is_atomic) {
+                resp->issue_time = logic_clk_;
+                atomic_stats_.flits += req->flits + resp->flits;
+                atomic_stats_.host_flits +=
+                    HostRMWFlits(resp->type == HMCRespType::NONE);
+            }
+            if (free_resp_ids_.empty()) {
+                req->req_id = resp_table_.size();
+                resp_table_.push_back(resp);
+            } else {
+                req->req_id = free_resp_ids_.back();
+                free_resp_ids_.pop_back();
+                resp_table_[req->req_id] = resp;
+            }
+        }
+        link_age_counter_[link] = 1;
+        // stats_.interarrival_latency.AddValue(clk_ - last_req_clk_);
+        last_req_clk_ = clk_;
         return true;
-    } else {
-        return false;
     }
 }
 
+uint64_t HMCMemorySystem::SendOverLink(HMCLinkDirStats &stats,
+                                       uint64_t &tx_free, int flits) {
+    uint64_t ser_cycles =
+        (flits * link_flit_ps_ + ps_per_logic_ - 1) / ps_per_logic_;
+    uint64_t done = std::max(logic_clk_, tx_free) + ser_cycles;
+    stats.packets++;
+    stats.flits += flits;
+    stats.busy_cycles += ser_cycles;
+    if (config_.link_error_rate > 0) {
+        link_rng_ ^= link_rng_ >> 12;
+        link_rng_ ^= link_rng_ << 25;
+        link_rng_ ^= link_rng_ >> 27;
+        double draw = (link_rng_ * 0x2545F4914F6CDD1Dull >> 11) /
+                      9007199254740992.0;  // 2^53
+        if (draw < config_.link_error_rate) {
+            // the receiver drops the packet on a CRC error and the link
+            // stalls until the sender replays it from its retry buffer
+            stats.retries++;
+            stats.busy_cycles += ser_cycles;
+            done += config_.link_retry_latency + ser_cycles;
+        }
+    }
+    tx_free = done;
+    return done + config_.serdes_latency;
+}
+
 bool HMCMemorySystem::InsertHMCReq(HMCRequest *req) {
     // most CPU models does not support simultaneous insertions
     // if you want to actually simulate the multi-link feature
     // then you have to call this function multiple times in 1 cycle
     // TODO put a cap limit on how many times you can call this function per
     // cycle
+    // the vault of the request is the one within its cube so far
+    int vault = req->vault;
+    req->cube = CubeOf(req->mem_operand1);
+    req->at_cube = 0;
+    req->vault = req->cube * config_.channels + vault;
+    req->quad = req->cube * quads_ + vault % quads_;
     bool is_inserted = InsertReqToLink(req, next_link_);
     if (!is_inserted) {
         int start_link = next_link_;
@@ -581,6 +1207,14 @@ bool HMCMemorySystem::InsertHMCReq(HMCRequest *req) {
                 IterateNextLink();
             }
         }
+        // refused by every link, counted once on the link it was offered
+        // first
+        if (link_req_queues_[start_link].size() >= queue_depth_) {
+            link_stats_[start_link].stall_buffer_full++;
+        } else {
+            link_stats_[start_link].stall_no_tokens++;
+        }
+        req->vault = vault;
         return false;
     } else {
         IterateNextLink();
@@ -588,61 +1222,124 @@ bool HMCMemorySystem::InsertHMCReq(HMCRequest *req) {
     }
 }
 
+void HMCMemorySystem::ReturnTokens(uint64_t clk) {
+    for (int i = 0; i < links_; i++) {
+        auto &returns = token_returns_[i];
+        while (!returns.empty() && returns.front().first <= clk) {
+            link_tokens_[i] += returns.front().second;
+            returns.pop_front();
+        }
+    }
+}
+
+uint64_t HMCMemorySystem::NextLogicEvent() const {
+    // quad responses only wait for the link, xbar and device link ports
+    // drain every cycle, so only packets still on a wire let cycles go by
+    // without a change; the tokens returned meanwhile are only spent by the
+    // host, ReturnTokens catches up on them before it sends again
+    uint64_t next = std::numeric_limits<uint64_t>::max();
+    for (const auto &queue : quad_resp_queues_) {
+        if (!queue.empty()) {
+            return logic_clk_;
+        }
+    }
+    for (const auto &queue : link_req_queues_) {
+        if (!queue.empty()) {
+            next = std::min(next, queue.front()->exit_time);
+        }
+    }
+    for (const auto &queue : quad_req_queues_) {
+        if (!queue.empty()) {
+            next = std::min(next, queue.front()->exit_time);
+        }
+    }
+    for (const auto &queue : link_resp_queues_) {
+        if (!queue.empty()) {
+            next = std::min(next, queue.front()->exit_time);
+        }
+    }
+    for (int i = 1; i < cubes_; i++) {
+        if (!dev_req_queues_[i].empty()) {
+            next = std::min(next, dev_req_queues_[i].front()->exit_time);
+        }
+        if (!dev_resp_queues_[i].empty()) {
+            next = std::min(next, dev_resp_queues_[i].front()->exit_time);
+        }
+    }
+    return std::max(next, logic_clk_);
+}
+
 void HMCMemorySystem::DrainRequests() {
+    // tokens back at the host
+    ReturnTokens(logic_clk_);
+    if (req_packets_ == 0) {
+        return;
+    }
+
     // drain quad request queue to vaults
-    for (int i = 0; i < 4; i++) {
-        if (!quad_req_queues_[i].empty() &&
+    for (size_t i = 0; i < quad_req_queues_.size(); i++) {
+        size_t n = NextQuadRequest(quad_req_queues_[i]);
+        if (n < quad_req_queues_[i].size() &&
             quad_resp_queues_[i].size() < queue_depth_) {
-            HMCRequest *req = quad_req_queues_[i].front();
+            HMCRequest *req = quad_req_queues_[i][n];
             if (req->exit_time <= logic_clk_) {
-                /*CIM*/
-                //Check how many read and write transactions a given request requires
-                int no_of_reads = 0, no_of_writes = 0;
-                if (req->is_read || req->type == HMCReqType::CIM_FETCH)
-                    no_of_reads = 1;
-                if (req->is_write || req->type == HMCReqType::CIM_STORE)
-                    no_of_writes = 1;
-                if (req->type == HMCReqType::CIM_ADD) {
-                    no_of_reads = 2;
-                    no_of_writes = 1;
-                }
-                if (req->type == HMCReqType::CIM_SWAP) {
-                    no_of_reads = 2;
-                    no_of_writes = 2;
-                }
-                if (req->type == HMCReqType::CIM_XOR) {
-                    no_of_reads = 2;
-                    no_of_writes = 1;
+                bool accepted;
+                if (req->type == HMCReqType::CIM) {
+                    accepted = cim_.WillAcceptTransaction(CiMTransaction(req));
+                } else if (IsAtomic(req->type)) {
+                    // the write is issued later by the atomic unit, which
+                    // waits for room in the write buffer itself
+                    accepted = ctrls_[req->vault]->WillAcceptTransaction(
+                        req->mem_operand1, false);
+                } else {
+                    // the vault splits larger requests into bursts
+                    int bursts = config_.Bursts(ReqBytes(req->type));
+                    accepted = ctrls_[req->vault]->WillAcceptTransaction(
+                        req->mem_operand1, req->is_read ? bursts : 0,
+                        req->is_write ? bursts : 0);
                 }
-                if (ctrls_[req->vault]->WillAcceptTransaction(req->mem_operand1, no_of_reads, no_of_writes)) {
+                if (accepted) {
                     InsertReqToDRAM(req);
-                    delete (req);
-                    quad_req_queues_[i].erase(quad_req_queues_[i].begin());
+                    req_pool_.Delete(req);
+                    quad_req_queues_[i].erase(n);
+                    req_packets_--;
                 }
             }
         }
     }
 
-    // drain xbar
-    for (auto &&i : quad_busy_) {
-        if (i > 0) {
-            i -= 2;
-        }
-    }
-
-    // drain requests from link to quad buffers
-    std::vector<int> age_queue = BuildAgeQueue(link_age_counter_);
-    while (!age_queue.empty()) {
-        int src_link = age_queue.front();
-        int dest_quad = link_req_queues_[src_link].front()->quad;
-        if (quad_req_queues_[dest_quad].size() < queue_depth_ &&
-            quad_busy_[dest_quad] <= 0) {
-            HMCRequest *req = link_req_queues_[src_link].front();
-            link_req_queues_[src_link].erase(
-                link_req_queues_[src_link].begin());
-            quad_req_queues_[dest_quad].push_back(req);
-            quad_busy_[dest_quad] = req->flits;
-            req->exit_time = logic_clk_ + req->flits;
+    // drain xbar, along with the cycles this side sat idle
+    uint64_t cycles = logic_clk_ + 1 - req_busy_clk_;
+    DrainBusy(quad_busy_, xbar_bandwidth_, cycles);
+    DrainBusy(dev_req_busy_, config_.dev_link_bandwidth, cycles);
+    req_busy_clk_ = logic_clk_ + 1;
+
+    // requests arriving at the far end of a device-to-device link pass
+    // through the cube or enter its quads
+    for (int i = 1; i < cubes_; i++) {
+        if (!dev_req_queues_[i].empty() &&
+            dev_req_queues_[i].front()->exit_time <= logic_clk_) {
+            HMCRequest *req = dev_req_queues_[i].front();
+            req->at_cube = i;
+            if (ForwardRequest(req)) {
+                dev_req_queues_[i].pop_front();
+            }
+        }
+    }
+
+    // drain requests from link to quad buffers, or to the link towards
+    // their cube
+    BuildAgeQueue(link_age_counter_);
+    for (int n = 0; n < age_queue_len_; n++) {
+        int src_link = age_queue_[n];
+        HMCRequest *req = link_req_queues_[src_link].front();
+        if (req->exit_time > logic_clk_) {  // still on the wire
+            continue;
+        }
+        if (ForwardRequest(req)) {
+            link_req_queues_[src_link].pop_front();
+            token_returns_[src_link].push_back(
+                std::make_pair(logic_clk_ + config_.serdes_latency, req->flits));
             if (link_req_queues_[src_link].empty()) {
                 link_age_counter_[src_link] = 0;
             } else {
@@ -650,53 +1347,70 @@ void HMCMemorySystem::DrainRequests() {
             }
         } else {  // stalled this cycle, update age counter
             link_age_counter_[src_link]++;
+            link_stats_[src_link].stall_xbar++;
         }
-        age_queue.erase(age_queue.begin());
     }
-    age_queue.clear();
 }
 
 void HMCMemorySystem::DrainResponses() {
+    if (resp_packets_ == 0) {
+        return;
+    }
     // Link resp to CPU
     for (int i = 0; i < links_; i++) {
         if (!link_resp_queues_[i].empty()) {
             HMCResponse *resp = link_resp_queues_[i].front();
+            // a response leaves the link only once all its flits are out
+            if (resp->exit_time <= logic_clk_) {
+                if (resp->is_atomic) {
+                    atomic_stats_.returned++;
+                    atomic_stats_.latency += logic_clk_ - resp->issue_time;
+                }
+                if (resp->is_tagged) {
+                    Completion completion;
+                    completion.tag = resp->tag;
+                    completion.addr = resp->resp_id;
+                    completion.source_id = resp->source_id;
+                    completion.is_write = resp->type != HMCRespType::RD_RS;
+                    DeliverCompletion(completion);
+                } else if (resp->type == HMCRespType::RD_RS) {
+                    read_callback_(resp->resp_id);
+                } else {
+                    write_callback_(resp->resp_id);
+                }
+                resp_pool_.Delete(resp);
+                link_resp_queues_[i].pop_front();
+                resp_packets_--;
+            }
+        }
+    }
 
+    // drain xbar, along with the cycles this side sat idle
+    uint64_t cycles = logic_clk_ + 1 - resp_busy_clk_;
+    DrainBusy(link_busy_, xbar_bandwidth_, cycles);
+    DrainBusy(dev_resp_busy_, config_.dev_link_bandwidth, cycles);
+    resp_busy_clk_ = logic_clk_ + 1;
 
-                if (resp->exit_time <= logic_clk_) {
-                    if (resp->type == HMCRespType::RD_RS) {
-                        read_callback_(resp->resp_id);
-                    }
-                    else {
-                        write_callback_(resp->resp_id);
-                    }
-                }
-                delete (resp);
-                link_resp_queues_[i].erase(link_resp_queues_[i].begin());
-            
+    // responses arriving back over a device-to-device link
+    for (int i = 1; i < cubes_; i++) {
+        if (!dev_resp_queues_[i].empty() &&
+            dev_resp_queues_[i].front()->exit_time <= logic_clk_) {
+            HMCResponse *resp = dev_resp_queues_[i].front();
+            resp->at_cube = ParentCube(i);
+            if (ForwardResponse(resp)) {
+                dev_resp_queues_[i].pop_front();
+            }
         }
     }
 
-    // drain xbar
-    for (auto &&i : link_busy_) {
-        if (i > 0) {
-            i -= 2;
-        }
-    }
-
-    // drain responses from quad to link buffers
-    auto age_queue = BuildAgeQueue(quad_age_counter_);
-    while (!age_queue.empty()) {
-        int src_quad = age_queue.front();
-        int dest_link = quad_resp_queues_[src_quad].front()->link;
-        if (link_resp_queues_[dest_link].size() < queue_depth_ &&
-            link_busy_[dest_link] <= 0) {
-            HMCResponse *resp = quad_resp_queues_[src_quad].front();
-            quad_resp_queues_[src_quad].erase(
-                quad_resp_queues_[src_quad].begin());
-            link_resp_queues_[dest_link].push_back(resp);
-            link_busy_[dest_link] = resp->flits;
-            resp->exit_time = logic_clk_ + resp->flits;
+    // drain responses from quad to link buffers, or to the link towards
+    // the host
+    BuildAgeQueue(quad_age_counter_);
+    for (int n = 0; n < age_queue_len_; n++) {
+        int src_quad = age_queue_[n];
+        HMCResponse *resp = quad_resp_queues_[src_quad].front();
+        if (ForwardResponse(resp)) {
+            quad_resp_queues_[src_quad].pop_front();
             if (quad_resp_queues_[src_quad].size() == 0) {
                 quad_age_counter_[src_quad] = 0;
             } else {
@@ -705,35 +1419,96 @@ void HMCMemorySystem::DrainResponses() {
         } else {  // stalled this cycle, update age counter
             quad_age_counter_[src_quad]++;
         }
-        age_queue.erase(age_queue.begin());
     }
-    age_queue.clear();
+}
+
+int HMCMemorySystem::CubeOf(uint64_t hex_addr) const {
+    hex_addr >>= config_.shift_bits;
+    return (hex_addr >> config_.cube_pos) & (cubes_ - 1);
+}
+
+int HMCMemorySystem::ParentCube(int cube) const {
+    return config_.chain_topology == HMCTopology::DAISY ? cube - 1 : 0;
+}
+
+bool HMCMemorySystem::ForwardRequest(HMCRequest *req) {
+    if (req->at_cube == req->cube) {
+        int quad = req->quad;
+        if (quad_req_queues_[quad].size() >= queue_depth_ ||
+            quad_busy_[quad] > 0) {
+            return false;
+        }
+        quad_req_queues_[quad].push_back(req);
+        quad_busy_[quad] = req->flits;
+        req->exit_time = logic_clk_ + req->flits;
+        return true;
+    }
+    // the next cube on the way, a star hub links every cube directly
+    int next = config_.chain_topology == HMCTopology::DAISY ? req->at_cube + 1
+                                                            : req->cube;
+    if (dev_req_queues_[next].size() >= queue_depth_ ||
+        dev_req_busy_[next] > 0) {
+        return false;
+    }
+    int bw = config_.dev_link_bandwidth;
+    dev_req_queues_[next].push_back(req);
+    dev_req_busy_[next] = req->flits;
+    req->exit_time =
+        logic_clk_ + config_.pass_through_latency + (req->flits + bw - 1) / bw;
+    return true;
+}
+
+bool HMCMemorySystem::ForwardResponse(HMCResponse *resp) {
+    if (resp->at_cube == 0) {
+        int link = resp->link;
+        if (link_resp_queues_[link].size() >= queue_depth_ ||
+            link_busy_[link] > 0) {
+            link_stats_[link].stall_link_busy++;
+            return false;
+        }
+        link_resp_queues_[link].push_back(resp);
+        link_busy_[link] = resp->flits;
+        resp->exit_time = SendOverLink(link_stats_[link].resp,
+                                       resp_tx_free_[link], resp->flits);
+        return true;
+    }
+    int cube = resp->at_cube;
+    if (dev_resp_queues_[cube].size() >= queue_depth_ ||
+        dev_resp_busy_[cube] > 0) {
+        return false;
+    }
+    int bw = config_.dev_link_bandwidth;
+    dev_resp_queues_[cube].push_back(resp);
+    dev_resp_busy_[cube] = resp->flits;
+    resp->exit_time = logic_clk_ + config_.pass_through_latency +
+                      (resp->flits + bw - 1) / bw;
+    return true;
 }
 
 void HMCMemorySystem::DRAMClockTick() {
 
     for (size_t i = 0; i < ctrls_.size(); i++) {
         // look ahead and return earlier
-        while (true) {
-            auto pair = ctrls_[i]->ReturnDoneTrans(clk_);
-            if (pair.second == 1) {  // write
-                VaultCallback(pair.first);
-            } else if (pair.second == 0) {  // read
-                VaultCallback(pair.first);
-            }
-            else if (pair.second == CIM) {
-                VaultCallback(pair.first);
-            }
-            else {
-                //use a map to see if all the transactions have been completed for the given request id;
-                //update the stats file 
-                //std::cout << "Neither read nor write\n";
-                break;
+        Transaction trans;
+        while (ctrls_[i]->ReturnDoneTrans(clk_, trans)) {
+            if (trans.is_cim) {
+                cim_.TransactionDone(trans, clk_);
+            } else {
+                VaultCallback(trans.req_id);
             }
         }
     }
-    for (size_t i = 0; i < ctrls_.size(); i++) {
-        ctrls_[i]->ClockTick();
+    AtomicClockTick();
+    cim_.ClockTick(clk_);
+    // callbacks above run in vault order on this thread, only the
+    // controller ticks go to the workers
+    // waking the workers costs more than ticking idle vaults here
+    if (vault_workers_ && !VaultsDrained()) {
+        vault_workers_->ClockTick();
+    } else {
+        for (size_t i = 0; i < ctrls_.size(); i++) {
+            ctrls_[i]->ClockTick();
+        }
     }
     clk_++;
 
@@ -743,6 +1518,15 @@ void HMCMemorySystem::DRAMClockTick() {
     return;
 }
 
+bool HMCMemorySystem::VaultsDrained() const {
+    for (const auto ctrl : ctrls_) {
+        if (!ctrl->IsDrained()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void HMCMemorySystem::ClockTick() {
     if (dram_ps_ == logic_ps_) {
         DrainResponses();
@@ -753,7 +1537,20 @@ void HMCMemorySystem::ClockTick() {
     } else {
         DRAMClockTick();
     }
-    while (logic_ps_ < dram_ps_ + ps_per_dram_) {
+    uint64_t end_ps = dram_ps_ + ps_per_dram_;
+    while (logic_ps_ < end_ps) {
+        uint64_t next = config_.skip_idle_logic ? NextLogicEvent() : logic_clk_;
+        if (next > logic_clk_) {
+            // nothing can move until a packet gets off its wire, the next
+            // DRAM cycle or host request, jump to the earliest of them
+            uint64_t cycles =
+                (end_ps - logic_ps_ + ps_per_logic_ - 1) / ps_per_logic_;
+            cycles = std::min(cycles, next - logic_clk_);
+            logic_ps_ += cycles * ps_per_logic_;
+            logic_clk_ += cycles;
+            ReturnTokens(logic_clk_ - 1);
+            continue;
+        }
         DrainResponses();
         DrainRequests();
         logic_ps_ += ps_per_logic_;
@@ -763,190 +1560,139 @@ void HMCMemorySystem::ClockTick() {
     return;
 }
 
-std::vector<int> HMCMemorySystem::BuildAgeQueue(std::vector<int> &age_counter) {
-    // return a vector of indices sorted in decending order
-    // meaning that the oldest age link/quad should be processed first
-    std::vector<int> age_queue;
+void HMCMemorySystem::BuildAgeQueue(const std::vector<int> &age_counter) {
+    // fill age_queue_ with the waiting links/quads, oldest first, ties in
+    // round robin order; ports are picked from a bit mask of those waiting
     int queue_len = age_counter.size();
-    age_queue.reserve(queue_len);
-    int start_pos = logic_clk_ % queue_len;  // round robin start pos
+    uint64_t waiting = 0;
     for (int i = 0; i < queue_len; i++) {
-        int pos = (i + start_pos) % queue_len;
-        if (age_counter[pos] > 0) {
-            bool is_inserted = false;
-            for (auto it = age_queue.begin(); it != age_queue.end(); it++) {
-                if (age_counter[pos] > *it) {
-                    age_queue.insert(it, pos);
-                    is_inserted = true;
-                    break;
+        if (age_counter[i] > 0) {
+            waiting |= 1ull << i;
+        }
+    }
+    int start_pos = logic_clk_ % queue_len;  // round robin start pos
+    uint64_t after_start = ~0ull << start_pos;
+    age_queue_len_ = 0;
+    while (waiting != 0) {
+        int oldest = -1;
+        for (auto part : {waiting & after_start, waiting & ~after_start}) {
+            while (part != 0) {
+                int pos = __builtin_ctzll(part);
+                part &= part - 1;
+                if (oldest < 0 || age_counter[pos] > age_counter[oldest]) {
+                    oldest = pos;
                 }
             }
-            if (!is_inserted) {
-                age_queue.push_back(pos);
-            }
         }
+        age_queue_[age_queue_len_++] = oldest;
+        waiting &= ~(1ull << oldest);
     }
-    return age_queue;
 }
 
 void HMCMemorySystem::InsertReqToDRAM(HMCRequest *req) {
-    std::cout << "";//For some reason the code does not work properly without this 
-    //Transaction trans(req->mem_operand1, req->is_write);
-    /* Rewriting for CIM transactions */
-    //Steps:
-    //1) Break the HMC requests into reads and writes
-    //2) Maintain an ID(req_id_) to keep track of transactions belonging to a particular request.
-    //   This is a global ID. Have to come up with someother way to keep track.
-    if (req->type == HMCReqType::CIM_FETCH || req->type == HMCReqType::CIM_STORE) {
-        //Store => write
-        //Fetch => read
-        int req_id = req_id_;
-        Transaction trans(req->mem_operand1, req->type == HMCReqType::CIM_STORE);
-        trans.is_cim = true;
-        trans.is_cim_fetch = req->type == HMCReqType::CIM_FETCH;
-        trans.is_cim_store = req->type == HMCReqType::CIM_STORE;
-        trans.req_id = req_id;
-        trans.is_cim_add = false;
-        trans.is_cim_xor = false;
-        trans.is_cim_swap = false;
-        ctrls_[req->vault]->cim_transactions[req_id] = 1;
-        ctrls_[req->vault]->AddTransaction(trans);
-        id_to_cim_mappings[req_id] = (req->type == HMCReqType::CIM_FETCH) ? HMCReqType::CIM_FETCH : HMCReqType::CIM_STORE;
-        req_id_++;
+    if (req->type == HMCReqType::CIM) {
+        cim_.AddTransaction(CiMTransaction(req), clk_);
         return;
     }
-    else if (req->type == HMCReqType::CIM_ADD || req->type == HMCReqType::CIM_XOR) { //2 reads followed by 1 write
-        int req_id = req_id_;
-        uint64_t address;
-        ctrls_[req->vault]->cim_transactions[req_id] = 0;
-        clock_cycle_recordings[req_id].push_back(logic_clk_);
-        for (int i = 0; i < 3; i++) {
-            if (i == 1)
-                address = req->mem_operand1;
-            else if(i == 2)
-                address = req->mem_operand2;
-            else
-                address = req->mem_operand3;
-            Transaction trans(address, i > 1);
-            trans.is_cim_add = req->type == HMCReqType::CIM_ADD;
-            trans.is_cim_xor = req->type == HMCReqType::CIM_XOR;
-            trans.req_id = req_id;
-            trans.is_cim = true;
-            trans.is_cim_fetch = false;
-            trans.is_cim_store = false;
-            trans.is_cim_swap = false;
-            ctrls_[req->vault]->AddTransaction(trans);
-            ctrls_[req->vault]->cim_transactions[req_id]++;
-        }
-        id_to_cim_mappings[req_id] = (req->type == HMCReqType::CIM_ADD) ? HMCReqType::CIM_ADD : HMCReqType::CIM_XOR;
-        req_id_++;
-
-    }
-    else if (req->type == HMCReqType::CIM_SWAP) {
-        int req_id = req_id_;
-        uint64_t address;
-        for (int i = 0; i < 2; i++) {
-            if (i == 0) {
-                address = req->mem_operand1;
-                cim_swap_store_addresses[req_id].first = address;
-            }
-            else {
-                address = req->mem_operand2;
-                cim_swap_store_addresses[req_id].second = address;
-            }
-            Transaction trans(address, false); //Read the values, swap happens in the vault callback function
-            trans.is_cim = true;
-            trans.is_cim_swap = true;
-            trans.is_cim_fetch = trans.is_cim_store = trans.is_cim_add= trans.is_cim_xor=false;
-            trans.req_id = req_id;
-            ctrls_[req->vault]->AddTransaction(trans);
-            ctrls_[req->vault]->cim_transactions[req_id]++;
-        }
-        id_to_cim_mappings[req_id] = HMCReqType::CIM_SWAP;
-        cim_swap_call_backs[req_id] = 2;
-        req_to_vault[req_id_] = req->vault;
-        clock_cycle_recordings[req_id].push_back(logic_clk_);
-        req_id_++;
-    }
-    else if (req->is_write || req->is_read) {
-        Transaction trans(req->mem_operand1, req->is_write);
-        trans.is_cim = false;
-        trans.is_cim_fetch = trans.is_cim_store = trans.is_cim_add = trans.is_cim_xor = trans.is_cim_swap = false;
-        if (req->is_read) {
-            trans.is_write = false;
-            trans.is_read = true;
-        }
-        else {
-            trans.is_write = true;
-            trans.is_read = false;
-        }
-        ctrls_[req->vault]->AddTransaction(trans);
-        return;
-    }
-    else {
-    AbruptExit(__FILE__, __LINE__);
+    // an atomic starts with the read of its operand
+    Transaction trans(req->mem_operand1, req->is_write);
+    trans.size = ReqBytes(req->type);
+    trans.priority = req->priority;
+    trans.req_id = req->req_id;
+    if (IsAtomic(req->type)) {
+        if (atomics_.size() <= req->req_id) {
+            atomics_.resize(req->req_id + 1,
+                            HMCAtomic{HMCReqType::SIZE, 0, 0, false, 0});
+        }
+        atomics_[req->req_id] =
+            HMCAtomic{req->type, req->mem_operand1, req->vault, false, 0};
+        atomic_addrs_.insert(req->mem_operand1);
     }
+    ctrls_[req->vault]->AddTransaction(trans);
     return;
 }
 
-void HMCMemorySystem::VaultCallback(uint64_t req_id) {
-    // we will use hex addr as the req_id and use a multimap to lookup the
-    // requests the vaults cannot directly talk to the CPU so this callback will
-    // be passed to the vaults and is responsible to put the responses back to
-    // response queues
-    /*CIM modifications*/
-    //1) Add cim stats
-    //2) Do not send response for CIM Operations
-    auto it = resp_lookup_table_.find(req_id);
-    HMCResponse *resp = it->second;
-    if (resp->type <= HMCRespType::SIZE) {
-        // all data from dram received, put packet in xbar and return
-        resp_lookup_table_.erase(it);
-        // put it in xbar
-        quad_resp_queues_[resp->quad].push_back(resp);
-        quad_age_counter_[resp->quad] = 1;
-    }
-    else if (id_to_cim_mappings[req_id] == HMCReqType::CIM_ADD || id_to_cim_mappings[req_id] == HMCReqType::CIM_XOR) {
-            clock_cycle_recordings[req_id].push_back(logic_clk_);
-            if (id_to_cim_mappings[req_id] == HMCReqType::CIM_ADD) {
-                std::cout << "Clock Cycles for Add: " << clock_cycle_recordings[req_id].back() - clock_cycle_recordings[req_id].front()+ add_delay << "\n";
-            }
-            else {
-                std::cout << "Clock Cycles for Xor: " << clock_cycle_recordings[req_id].back() - clock_cycle_recordings[req_id].front()+ xor_delay << "\n";
-            }
+size_t HMCMemorySystem::NextQuadRequest(
+    const RingBuffer<HMCRequest *> &queue) const {
+    // atomics on an address with one in flight wait, the requests behind
+    // them go ahead unless they touch one of those addresses
+    size_t n = 0;
+    while (n < queue.size() && IsAtomic(queue[n]->type) &&
+           AtomicPending(queue[n]->mem_operand1)) {
+        n++;
+    }
+    if (n == queue.size()) {
+        return n;
+    }
+    const HMCRequest *req = queue[n];
+    for (size_t i = 0; i < n; i++) {
+        uint64_t addr = queue[i]->mem_operand1;
+        if (req->mem_operand1 == addr ||
+            (req->type == HMCReqType::CIM &&
+             (req->mem_operand2 == addr || req->mem_operand3 == addr))) {
+            return queue.size();
         }
+    }
+    return n;
+}
 
-    else if(id_to_cim_mappings[req_id] == HMCReqType::CIM_SWAP) {//The stores are done in the callback
-            if (cim_swap_call_backs[req_id]-- == 2) {
-                //std::cout << "first call back for CiM_SWAP\n";
-                uint64_t address;
-                for (int i = 0; i < 2; i++) {
-                    if (i == 0) {
-                        address = cim_swap_store_addresses[req_id].first;
-                    }
-                    else {
-                        address = cim_swap_store_addresses[req_id].second;
-                    }
-                    Transaction trans(address, false); //Read the values, swap happens in the vault callback function
-                    trans.is_cim = true;
-                    trans.is_cim_swap = true;
-                    trans.is_cim_fetch = trans.is_cim_store = trans.is_cim_add = trans.is_cim_xor = false;
-                    trans.req_id = req_id;
-                    int vault = req_to_vault[req_id];
-                    ctrls_[vault]->AddTransaction(trans);
-                    ctrls_[vault]->cim_transactions[req_id]++;
-                }
-            }
-            else {
-                //std::cout << "second call back for CiM_SWAP\n";
-                clock_cycle_recordings[req_id].push_back(logic_clk_);
-                std::cout << "Clock cycles for CiM_Swap: " << clock_cycle_recordings[req_id].back() - clock_cycle_recordings[req_id].front() << "\n";
-            }
+bool HMCMemorySystem::AtomicPending(uint64_t hex_addr) const {
+    return atomic_addrs_.count(hex_addr) > 0;
+}
+
+void HMCMemorySystem::AtomicClockTick() {
+    // the atomic unit takes the same latency for every atomic, so they are
+    // done in the order they started; a full write buffer holds up the rest
+    while (!atomic_unit_.empty()) {
+        uint32_t slot = atomic_unit_.front();
+        HMCAtomic &atomic = atomics_[slot];
+        bool writes = AtomicWrites(atomic.type);
+        if (atomic.due > clk_ ||
+            (writes && !ctrls_[atomic.vault]->WillAcceptTransaction(
+                           atomic.addr, true))) {
+            break;
         }
-    return;
+        atomic_unit_.pop_front();
+        atomic.writing = true;
+        if (writes) {
+            Transaction trans(atomic.addr, true);
+            trans.req_id = slot;
+            ctrls_[atomic.vault]->AddTransaction(trans);
+        } else {
+            VaultCallback(slot);
+        }
+    }
 }
 
-bool ConvertCIMtoRW(Transaction& trans) {
-    return true;
+void HMCMemorySystem::VaultCallback(uint64_t req_id) {
+    // the vaults cannot directly talk to the CPU so this callback is
+    // responsible to put the responses back to response queues, req_id is
+    // the response slot the vault transaction carries
+    HMCResponse *resp = resp_table_[req_id];
+    if (req_id < atomics_.size() && atomics_[req_id].type != HMCReqType::SIZE) {
+        HMCAtomic &atomic = atomics_[req_id];
+        if (!atomic.writing) {  // operand read, on to the atomic unit
+            atomic.due = clk_ + config_.atomic_latency;
+            atomic_unit_.push_back(req_id);
+            return;
+        }
+        atomic.type = HMCReqType::SIZE;
+        atomic_addrs_.erase(atomic.addr);
+    }
+    // all data from dram received, put packet in xbar and return
+    resp_table_[req_id] = nullptr;
+    free_resp_ids_.push_back(req_id);
+    if (resp->is_atomic && resp->type == HMCRespType::NONE) {
+        // posted atomics are done once written
+        atomic_stats_.posted++;
+        resp_pool_.Delete(resp);
+        return;
+    }
+    // put it in xbar
+    quad_resp_queues_[resp->quad].push_back(resp);
+    quad_age_counter_[resp->quad] = 1;
+    resp_packets_++;
+    return;
 }
+
 }  // namespace dramsim3
@@ -1,8 +1,15 @@
 #ifndef __HMC_H
 #define __HMC_H
 
+#include <atomic>
+#include <condition_variable>
 #include <functional>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "dram_system.h"
@@ -39,22 +46,23 @@ enum class HMCReqType {
     P_WR112,
     P_WR128,
     P_WR256,
-    // TODO haven't properly implement the following atomic operations
+    // atomics, run by the vault as read, atomic unit, write; the P_ ones
+    // are posted and get no response
     ADD8,  // 2ADD8, cannot name it like that in c++...
     ADD16,
     P_2ADD8,  // 2 8Byte imm operands + 8 8Byte mem operands read then write
     P_ADD16,
-    ADDS8R,  // 2ADD8, cannot name it like that...
+    ADDS8R,  // 2ADDS8R, cannot name it like that...
     ADDS16R,
     INC8,  // read, return(the original), then write
     P_INC8, // read, return(the original), then posted write
     // boolean op on imm operand and mem operand, read update write
-    XOR16,  
+    XOR16,
     OR16,
     NOR16,
     AND16,
     NAND16,
-    // comparison instructions, not sure if there's write untill read done
+    // compare and swap, data is not modeled so the swap always writes
     CASGT8,
     CASGT16,
     CASLT8,
@@ -69,39 +77,49 @@ enum class HMCReqType {
     BWR8R,  // bit write with return
     SWAP16,  // swap imm operand and mem operand, read then write
     SIZE,
-    //Adding Commands for CiM operations
-     CIM_FETCH,
-    CIM_STORE,
-    CIM_ADD,
-    CIM_SWAP,
-    CIM_XOR
+    // compute-in-memory operation run by the vault logic, see cim.h; it
+    // carries its operands and gets no response
+    CIM
 };
 
-//enum class HMCRespType { NONE, RD_RS, WR_RS, ERR, SIZE };
-
-//Modifiying for CiM
-enum class HMCRespType { NONE, RD_RS, WR_RS, ERR, SIZE, CIM_FETCH_RS, CIM_STORE_RS, CIM_ADD_RS,CIM_SWAP_RS, CIM_XOR_RS }; //Adding new response types
-// for future use
+enum class HMCRespType { NONE, RD_RS, WR_RS, ERR, SIZE };
+// host links of cube 0, and pass-through links between chained cubes
 enum class HMCLinkType { HOST_TO_DEV, DEV_TO_DEV, SIZE };
 
-//The new request can contain two address values depending on the type. CiM operations
-//mostly have two addresses which are used as operands.
+// CiM requests carry up to 3 memory operands, all other requests only the
+// first one
 class HMCRequest {
    public:
-    HMCRequest(HMCReqType req_type, uint64_t hex_addr1,int vault, uint64_t hex_addr2=0,uint64_t hex_addr3=0);
+    HMCRequest(HMCReqType req_type, uint64_t hex_addr1, int vault,
+               uint64_t hex_addr2 = 0, uint64_t hex_addr3 = 0);
     HMCReqType type;
     uint64_t mem_operand1;
     uint64_t mem_operand2;
     uint64_t mem_operand3;
+    uint64_t cim_op;
+    uint32_t cim_count;
+    uint64_t cim_stride;
     int link;
+    // quad and vault indices count over all cubes of a chain
     int quad;
     int vault;
+    // cube it goes to and the one it has reached
+    int cube;
+    int at_cube;
     int flits;
     bool is_write;
-    //Adding more boolean variables for CIM
     bool is_read;
-    // this exit_time is the time to exit xbar to vaults
+    // this exit_time is the time to exit xbar to vaults, or the far end of
+    // a device-to-device link
     uint64_t exit_time;
+    // slot of its response in the response table, carried by the vault
+    // transaction
+    uint32_t req_id;
+    // caller supplied tag and metadata, handed over to the response
+    uint64_t tag;
+    int source_id;
+    int priority;
+    bool is_tagged;
 };
 class HMCResponse {
    public:
@@ -110,9 +128,165 @@ class HMCResponse {
     HMCRespType type;
     int link;
     int quad;
+    int at_cube;
     int flits;
-    // this exit_time is the time to exit xbar to cpu
+    // this exit_time is the time to exit xbar to cpu, or the far end of a
+    // device-to-device link
     uint64_t exit_time;
+    uint64_t tag;
+    int source_id;
+    bool is_tagged;
+    // atomics are timed from the logic cycle their request got on the link
+    bool is_atomic;
+    uint64_t issue_time;
+};
+
+// Traffic of one direction of a host link
+struct HMCLinkDirStats {
+    uint64_t packets;
+    uint64_t flits;
+    uint64_t busy_cycles;  // logic cycles serializing, replays included
+    uint64_t retries;
+};
+
+// Host link layer stats, stalls are counted per refused request and per
+// logic cycle a packet waits for the link or the xbar
+struct HMCLinkStats {
+    HMCLinkDirStats req;
+    HMCLinkDirStats resp;
+    uint64_t stall_buffer_full;
+    uint64_t stall_no_tokens;
+    uint64_t stall_xbar;
+    uint64_t stall_link_busy;
+};
+
+// An atomic request in its vault, indexed by its response slot, type is
+// SIZE for slots without one
+struct HMCAtomic {
+    HMCReqType type;
+    uint64_t addr;
+    int vault;
+    bool writing;  // read done and result computed
+    uint64_t due;  // DRAM cycle the atomic unit is done
+};
+
+// Atomics against the host reads and writes doing the same work, flits are
+// counted on the host links when a request is sent, latencies are logic
+// cycles from the request to its response
+struct HMCAtomicStats {
+    uint64_t returned;
+    uint64_t posted;
+    uint64_t flits;
+    uint64_t host_flits;
+    uint64_t latency;  // summed over the returned ones
+};
+
+// FIFO of packet pointers over a fixed array, sized for the xbar queue depth.
+// It only grows if more is pushed than that, e.g. responses of all the
+// requests in flight in a vault.
+template <typename T>
+class RingBuffer {
+   public:
+    explicit RingBuffer(size_t capacity = 1)
+        : buf_(capacity > 0 ? capacity : 1), head_(0), size_(0) {}
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T &front() { return buf_[head_]; }
+    const T &front() const { return buf_[head_]; }
+    const T &operator[](size_t i) const {
+        return buf_[(head_ + i) % buf_.size()];
+    }
+    void push_back(const T &item) {
+        if (size_ == buf_.size()) {
+            std::vector<T> buf(buf_.size() * 2);
+            for (size_t i = 0; i < size_; i++) {
+                buf[i] = (*this)[i];
+            }
+            buf_.swap(buf);
+            head_ = 0;
+        }
+        buf_[(head_ + size_) % buf_.size()] = item;
+        size_++;
+    }
+    void pop_front() {
+        head_ = (head_ + 1) % buf_.size();
+        size_--;
+    }
+    // removes item i, the items in front of it move back one place
+    void erase(size_t i) {
+        size_t n = buf_.size();
+        for (; i > 0; i--) {
+            buf_[(head_ + i) % n] = buf_[(head_ + i - 1) % n];
+        }
+        pop_front();
+    }
+    void clear() {
+        head_ = 0;
+        size_ = 0;
+    }
+
+   private:
+    std::vector<T> buf_;
+    size_t head_;
+    size_t size_;
+};
+
+// Packets are taken from slabs of kSlabSize and recycled, so the xbar does
+// not allocate once it has seen its peak load.
+template <typename T>
+class ObjectPool {
+   public:
+    template <typename... Args>
+    T *New(Args &&... args) {
+        if (free_.empty()) {
+            slabs_.emplace_back(new Storage[kSlabSize]);
+            for (size_t i = 0; i < kSlabSize; i++) {
+                free_.push_back(reinterpret_cast<T *>(&slabs_.back()[i]));
+            }
+        }
+        T *obj = free_.back();
+        free_.pop_back();
+        return new (obj) T(std::forward<Args>(args)...);
+    }
+    void Delete(T *obj) {
+        obj->~T();
+        free_.push_back(obj);
+    }
+
+   private:
+    static const size_t kSlabSize = 64;
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+    std::vector<std::unique_ptr<Storage[]>> slabs_;
+    std::vector<T *> free_;
+};
+
+// Ticks the vault controllers on worker threads between xbar exchanges.
+// Each thread owns a contiguous range of vaults and the calling thread takes
+// the first one. Vaults share no state while they tick, so the result is the
+// same as ticking them in order. Idle workers spin on the cycle counter and
+// yield for a while, then sleep until the next cycle.
+class VaultWorkers {
+   public:
+    VaultWorkers(std::vector<Controller *> &ctrls, int threads);
+    ~VaultWorkers();
+    // ClockTick of every controller, returns once all are done
+    void ClockTick();
+
+   private:
+    void TickRange(int range);
+    void Work(int range);
+
+    std::vector<Controller *> &ctrls_;
+    int ranges_;
+    std::vector<std::thread> threads_;
+    std::atomic<uint64_t> cycle_;
+    std::atomic<int> running_;
+    std::atomic<bool> stop_;
+    // workers blocked on wake_, the cycle counter and stop_ are also
+    // checked under mutex_ before blocking so no wake up is lost
+    std::atomic<int> sleeping_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
 };
 
 class HMCMemorySystem : public BaseDRAMSystem {
@@ -125,63 +299,141 @@ class HMCMemorySystem : public BaseDRAMSystem {
     // we can unify them as one but then we'll have to convert all the
     // slow dram time units to faster logic units...
     void ClockTick() override;
+    bool IsIdle() const override;
 
     // had to have 3 insert interfaces cuz HMC is so different...
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const override;
     bool AddTransaction(uint64_t hex_addr, bool is_write) override;
+    bool AddTransaction(uint64_t hex_addr, bool is_write, uint64_t tag,
+                        const RequestMeta& meta) override;
     bool InsertReqToLink(HMCRequest* req, int link);
     bool InsertHMCReq(HMCRequest* req);
-    //Overloading functions for CIM
+    // CiM operations
     bool WillAcceptTransaction(Transaction& trans) const override;
     bool AddTransaction(Transaction& trans) override;
-    bool ConvertCIMtoRW(Transaction& trans);
-    
+    void SaveState(CheckpointWriter& ckpt) const override;
+    void LoadState(CheckpointReader& ckpt) override;
+    // also writes the host link stats to <output prefix>hmc_links.json and
+    // the atomic stats to <output prefix>hmc_atomics.json
+    void PrintStats() override;
+    void ResetStats() override;
 
    private:
     uint64_t logic_clk_, ps_per_dram_, ps_per_logic_, logic_ps_, dram_ps_;
 
     void SetClockRatio();
+    HMCReqType BlockReqType(bool is_write) const;
+    HMCRequest* BlockRequest(uint64_t hex_addr, bool is_write);
+    // smallest read or write that carries size bytes, at most 256
+    HMCReqType SizedReqType(uint32_t size, bool is_write) const;
+    // a request of type for trans, with its tag and metadata
+    bool AddRequest(HMCReqType type, const Transaction& trans);
     void DRAMClockTick();
     void DrainRequests();
     void DrainResponses();
+    // host link tokens due back by logic cycle clk
+    void ReturnTokens(uint64_t clk);
+    // first logic cycle at which a packet in the xbar or on a link can move,
+    // logic_clk_ if one can move now
+    uint64_t NextLogicEvent() const;
+    bool VaultsDrained() const;
     void InsertReqToDRAM(HMCRequest* req);
     void VaultCallback(uint64_t req_id);
-    std::vector<int> BuildAgeQueue(std::vector<int>& age_counter);
+    Transaction CiMTransaction(const HMCRequest* req) const;
+    // atomics run a read, then the atomic unit, then a write, one at a time
+    // per address
+    bool AtomicPending(uint64_t hex_addr) const;
+    // position of the request a quad sends to its vault next, queue.size()
+    // if all of them wait for atomics
+    size_t NextQuadRequest(const RingBuffer<HMCRequest*>& queue) const;
+    void AtomicClockTick();
+    int HostRMWFlits(bool posted) const;
+    void BuildAgeQueue(const std::vector<int>& age_counter);
+    // cube chaining: device-to-device link d connects cube d to
+    // ParentCube(d), on the way to the host
+    int CubeOf(uint64_t hex_addr) const;
+    int ParentCube(int cube) const;
+    // moves a packet one step from the cube it is at, false if the next
+    // buffer is full or busy
+    bool ForwardRequest(HMCRequest* req);
+    bool ForwardResponse(HMCResponse* resp);
+    // serializes a packet on a host link direction, returns the logic cycle
+    // it is received at
+    uint64_t SendOverLink(HMCLinkDirStats& stats, uint64_t& tx_free,
+                          int flits);
+    int BlockFlits(bool is_write) const;
+    bool LinkHasRoom(int flits) const;
     void XbarArbitrate();
     inline void IterateNextLink();
 
     int next_link_;
     int links_;
+    int quads_;  // per cube
+    int cubes_;
     size_t queue_depth_;
 
     // number of flits xbar can process per logic cycle
-    const int xbar_bandwidth_ = 2;
+    int xbar_bandwidth_;
 
-    // had to use a multimap because the controller callback return hex addr
-    // instead of unique id
-    std::multimap<uint64_t, HMCResponse*> resp_lookup_table_;
+    // responses waiting for their vault, indexed by req_id, free slots are
+    // reused
+    std::vector<HMCResponse*> resp_table_;
+    std::vector<uint32_t> free_resp_ids_;
     // these are essentially input/output buffers for xbars
-    std::vector<std::vector<HMCRequest*>> link_req_queues_;
-    std::vector<std::vector<HMCResponse*>> link_resp_queues_;
-    std::vector<std::vector<HMCRequest*>> quad_req_queues_;
-    std::vector<std::vector<HMCResponse*>> quad_resp_queues_;
+    std::vector<RingBuffer<HMCRequest*>> link_req_queues_;
+    std::vector<RingBuffer<HMCResponse*>> link_resp_queues_;
+    std::vector<RingBuffer<HMCRequest*>> quad_req_queues_;
+    std::vector<RingBuffer<HMCResponse*>> quad_resp_queues_;
+    // device-to-device links indexed by their far cube, 0 is unused
+    std::vector<RingBuffer<HMCRequest*>> dev_req_queues_;
+    std::vector<RingBuffer<HMCResponse*>> dev_resp_queues_;
+    ObjectPool<HMCRequest> req_pool_;
+    ObjectPool<HMCResponse> resp_pool_;
 
     // input/output busy indicators, since each packet could be several
     // flits, as long as this != 0 then they're busy
     std::vector<int> link_busy_;
-    std::vector<int> quad_busy_ = {0, 0, 0, 0};
+    std::vector<int> quad_busy_;
+    std::vector<int> dev_req_busy_;
+    std::vector<int> dev_resp_busy_;
+    // packets on the request and the response side of the links and xbar,
+    // a side without packets skips its logic cycles and catches up on its
+    // busy counters later, they are drained up to req/resp_busy_clk_
+    int req_packets_;
+    int resp_packets_;
+    uint64_t req_busy_clk_;
+    uint64_t resp_busy_clk_;
     // used for arbitration
     std::vector<int> link_age_counter_;
-    std::vector<int> quad_age_counter_ = {0, 0, 0, 0};
-    //Used to keep track of cim request
-    uint64_t req_id_;
-    std::unordered_map<uint64_t,HMCReqType> id_to_cim_mappings;
-    std::unordered_map<uint64_t,int> cim_swap_call_backs;
-    std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> cim_swap_store_addresses;
-    std::unordered_map<uint64_t,std::vector<int>> clock_cycle_recordings;
-    std::unordered_map<uint64_t,int> req_to_vault;
-    int add_delay = 100;
-    int xor_delay = 30;
+    std::vector<int> quad_age_counter_;
+    // links/quads in arbitration order, rebuilt every logic cycle, only the
+    // first age_queue_len_ entries are valid
+    std::vector<int> age_queue_;
+    int age_queue_len_;
+
+    // host link layer: each direction serializes one packet at a time until
+    // its tx_free cycle, requests need tokens for their flits, which come
+    // back serdes_latency after they leave the link input buffer
+    uint64_t link_flit_ps_;
+    std::vector<uint64_t> req_tx_free_;
+    std::vector<uint64_t> resp_tx_free_;
+    std::vector<int> link_tokens_;
+    std::vector<RingBuffer<std::pair<uint64_t, int>>> token_returns_;
+    std::vector<HMCLinkStats> link_stats_;
+    uint64_t stats_start_logic_clk_;
+    uint64_t link_rng_;  // xorshift state for error injection
+
+    // atomics by response slot, and those in the atomic unit in the order
+    // they are done
+    std::vector<HMCAtomic> atomics_;
+    // addresses of the atomics in flight, at most one each
+    std::unordered_set<uint64_t> atomic_addrs_;
+    RingBuffer<uint32_t> atomic_unit_;
+    HMCAtomicStats atomic_stats_;
+
+    CiMEngine cim_;
+    // set for vault_threads > 1
+    std::unique_ptr<VaultWorkers> vault_workers_;
 };
 
 }  // namespace dramsim3
@@ -1,27 +1,131 @@
 #include "memory_system.h"
 
+#include <fstream>
+#include <iostream>
+
 namespace dramsim3 {
+
+namespace {
+const uint64_t kCheckpointMagic = 0x54504b4333534452;  // "DRS3CKPT"
+const uint32_t kCheckpointVersion = 16;
+
+// everything that determines the shape of the saved state
+std::string CheckpointLayout(const Config &config) {
+    std::vector<int> params = {static_cast<int>(config.protocol),
+                               static_cast<int>(config.backend),
+                               static_cast<int>(config.fast_backend),
+                               config.channels,
+                               config.ranks,
+                               config.bankgroups,
+                               config.banks_per_group,
+                               config.rows,
+                               config.columns,
+                               config.num_links,
+                               config.num_cubes,
+                               config.num_quads,
+                               config.trans_queue_size,
+                               config.cmd_queue_size,
+                               config.unified_queue,
+                               static_cast<int>(config.cim_ops.size())};
+    std::string layout = config.queue_structure;
+    for (auto param : params) {
+        layout += "_" + std::to_string(param);
+    }
+    return layout;
+}
+
+BaseDRAMSystem *MakeAnalyticSystem(MemoryBackend backend, Config &config,
+                                   const std::string &output_dir,
+                                   std::function<void(uint64_t)> read_callback,
+                                   std::function<void(uint64_t)> write_callback) {
+    if (backend == MemoryBackend::IDEAL) {
+        return new IdealDRAMSystem(config, output_dir, read_callback,
+                                   write_callback);
+    } else if (backend == MemoryBackend::BANDWIDTH) {
+        return new BandwidthDRAMSystem(config, output_dir, read_callback,
+                                       write_callback);
+    } else if (backend == MemoryBackend::QUEUEING) {
+        return new QueueingDRAMSystem(config, output_dir, read_callback,
+                                      write_callback);
+    }
+    return nullptr;
+}
+}  // namespace
+
 MemorySystem::MemorySystem(const std::string &config_file,
                            const std::string &output_dir,
                            std::function<void(uint64_t)> read_callback,
                            std::function<void(uint64_t)> write_callback)
-    : config_(new Config(config_file, output_dir)) {
-    // TODO: ideal memory type?
-    if (config_->IsHMC()) {
+    : config_(new Config(config_file, output_dir)),
+      fast_system_(nullptr),
+      detailed_system_(nullptr),
+      detailed_(config_->backend == MemoryBackend::JEDEC),
+      detailed_idle_(true),
+      clk_(0),
+      next_switch_(0) {
+    if (config_->backend != MemoryBackend::JEDEC) {
+        dram_system_ = MakeAnalyticSystem(config_->backend, *config_,
+                                          output_dir, read_callback,
+                                          write_callback);
+    } else if (config_->IsHMC()) {
         dram_system_ = new HMCMemorySystem(*config_, output_dir, read_callback,
                                            write_callback);
     } else {
-        dram_system_ = new JedecDRAMSystem(*config_, output_dir, read_callback,
-                                           write_callback);
+        detailed_system_ = new JedecDRAMSystem(*config_, output_dir,
+                                               read_callback, write_callback);
+        dram_system_ = detailed_system_;
+    }
+    if (config_->IsHybrid()) {
+        fast_system_ = MakeAnalyticSystem(config_->fast_backend, *config_,
+                                          output_dir, read_callback,
+                                          write_callback);
+        detailed_ = false;
     }
 }
 
 MemorySystem::~MemorySystem() {
     delete (dram_system_);
+    delete (fast_system_);
     delete (config_);
 }
 
-void MemorySystem::ClockTick() { dram_system_->ClockTick(); }
+void MemorySystem::ClockTick() {
+    if (fast_system_ == nullptr) {
+        dram_system_->ClockTick();
+        return;
+    }
+    const auto &switch_cycles = config_->fidelity_switch_cycles;
+    if (next_switch_ < switch_cycles.size() &&
+        switch_cycles[next_switch_] == clk_) {
+        next_switch_++;
+        SetDetailed(!detailed_);
+    }
+    fast_system_->ClockTick();
+    if (detailed_ || !detailed_idle_) {
+        detailed_system_->ClockTick();
+        detailed_idle_ = !detailed_ && detailed_system_->IsIdle();
+    }
+    clk_++;
+}
+
+void MemorySystem::SetDetailed(bool detailed) {
+    if (fast_system_ == nullptr) {
+        std::cerr << "Switching fidelity needs fast_backend in the config"
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    if (detailed && !detailed_) {
+        // a drained detailed backend sat idle, bring it to the current cycle
+        detailed_system_->SkipTo(clk_);
+        detailed_idle_ = false;
+    }
+    // the backend left behind keeps being ticked until its requests finish
+    detailed_ = detailed;
+}
+
+BaseDRAMSystem *MemorySystem::Active() const {
+    return detailed_ || fast_system_ == nullptr ? dram_system_ : fast_system_;
+}
 
 double MemorySystem::GetTCK() const { return config_->tCK; }
 
@@ -35,20 +139,133 @@ void MemorySystem::RegisterCallbacks(
     std::function<void(uint64_t)> read_callback,
     std::function<void(uint64_t)> write_callback) {
     dram_system_->RegisterCallbacks(read_callback, write_callback);
+    if (fast_system_ != nullptr) {
+        fast_system_->RegisterCallbacks(read_callback, write_callback);
+    }
 }
 
 bool MemorySystem::WillAcceptTransaction(uint64_t hex_addr,
                                          bool is_write) const {
-    return dram_system_->WillAcceptTransaction(hex_addr, is_write);
+    return Active()->WillAcceptTransaction(hex_addr, is_write);
 }
 
 bool MemorySystem::AddTransaction(uint64_t hex_addr, bool is_write) {
-    return dram_system_->AddTransaction(hex_addr, is_write);
+    if (!detailed_ && detailed_idle_ && detailed_system_ != nullptr) {
+        detailed_system_->SkipTo(clk_);
+        detailed_system_->WarmRowBuffer(hex_addr, is_write);
+    }
+    return Active()->AddTransaction(hex_addr, is_write);
+}
+
+bool MemorySystem::AddTransaction(uint64_t hex_addr, bool is_write,
+                                  uint64_t tag, const RequestMeta &meta) {
+    if (!detailed_ && detailed_idle_ && detailed_system_ != nullptr) {
+        detailed_system_->SkipTo(clk_);
+        detailed_system_->WarmRowBuffer(hex_addr, is_write);
+    }
+    return Active()->AddTransaction(hex_addr, is_write, tag, meta);
+}
+
+void MemorySystem::RegisterCompletionCallback(
+    std::function<void(const Completion &)> completion_callback) {
+    dram_system_->RegisterCompletionCallback(completion_callback);
+    if (fast_system_ != nullptr) {
+        fast_system_->RegisterCompletionCallback(completion_callback);
+    }
+}
+
+void MemorySystem::DrainCompletions(std::vector<Completion> &completions) {
+    dram_system_->DrainCompletions(completions);
+    if (fast_system_ != nullptr) {
+        fast_system_->DrainCompletions(fast_completions_);
+        completions.insert(completions.end(), fast_completions_.begin(),
+                           fast_completions_.end());
+    }
 }
 
 void MemorySystem::PrintStats() const { dram_system_->PrintStats(); }
 
-void MemorySystem::ResetStats() { dram_system_->ResetStats(); }
+void MemorySystem::ResetStats() {
+    dram_system_->ResetStats();
+    if (fast_system_ != nullptr) {
+        fast_system_->ResetStats();
+    }
+}
+
+bool MemorySystem::SaveCheckpoint(const std::string &checkpoint_file) const {
+#ifdef THERMAL
+    std::cerr << "Checkpointing is not supported with thermal simulation"
+              << std::endl;
+    return false;
+#else
+    std::ofstream out(checkpoint_file, std::ofstream::binary);
+    if (out.fail()) {
+        std::cerr << "Cannot open checkpoint file " << checkpoint_file
+                  << std::endl;
+        return false;
+    }
+    CheckpointWriter ckpt(out);
+    ckpt.Write(kCheckpointMagic);
+    ckpt.Write(kCheckpointVersion);
+    ckpt.Write(CheckpointLayout(*config_));
+    dram_system_->SaveState(ckpt);
+    if (fast_system_ != nullptr) {
+        fast_system_->SaveState(ckpt);
+        ckpt.Write(detailed_);
+        ckpt.Write(detailed_idle_);
+        ckpt.Write(clk_);
+        ckpt.Write(next_switch_);
+    }
+    return ckpt.Good();
+#endif  // THERMAL
+}
+
+bool MemorySystem::LoadCheckpoint(const std::string &checkpoint_file) {
+#ifdef THERMAL
+    std::cerr << "Checkpointing is not supported with thermal simulation"
+              << std::endl;
+    return false;
+#else
+    std::ifstream in(checkpoint_file, std::ifstream::binary);
+    if (in.fail()) {
+        std::cerr << "Cannot open checkpoint file " << checkpoint_file
+                  << std::endl;
+        return false;
+    }
+    CheckpointReader ckpt(in);
+    uint64_t magic = 0;
+    uint32_t version = 0;
+    std::string layout;
+    ckpt.Read(magic);
+    ckpt.Read(version);
+    if (magic != kCheckpointMagic || version != kCheckpointVersion) {
+        std::cerr << checkpoint_file << " is not a compatible checkpoint"
+                  << std::endl;
+        return false;
+    }
+    ckpt.Read(layout);
+    if (layout != CheckpointLayout(*config_)) {
+        std::cerr << "Checkpoint " << checkpoint_file
+                  << " was saved with a different memory organization"
+                  << std::endl;
+        return false;
+    }
+    dram_system_->LoadState(ckpt);
+    if (fast_system_ != nullptr) {
+        fast_system_->LoadState(ckpt);
+        ckpt.Read(detailed_);
+        ckpt.Read(detailed_idle_);
+        ckpt.Read(clk_);
+        ckpt.Read(next_switch_);
+    }
+    if (!ckpt.Good()) {
+        std::cerr << "Checkpoint " << checkpoint_file << " is truncated"
+                  << std::endl;
+        return false;
+    }
+    return true;
+#endif  // THERMAL
+}
 
 MemorySystem* GetMemorySystem(const std::string &config_file, const std::string &output_dir,
                  std::function<void(uint64_t)> read_callback,
@@ -56,20 +273,26 @@ MemorySystem* GetMemorySystem(const std::string &config_file, const std::string
     return new MemorySystem(config_file, output_dir, read_callback, write_callback);
 }
 
-/*Rewrting WillAcceptTransaction and AddTransaction for CIM operations in HMC*/
 bool MemorySystem::WillAcceptTransaction(Transaction& trans) const {
-    /*if (config_->IsHMC())
-        return dram_system_->WillAcceptTransaction(trans);*/
-    if (trans.is_write || trans.is_read) {
-        return dram_system_->WillAcceptTransaction(trans.addr,trans.is_write);
+    if (!trans.IsOperation() && trans.size == 0) {
+        return WillAcceptTransaction(trans.addr, trans.is_write);
     }
     return dram_system_->WillAcceptTransaction(trans);
 }
-bool MemorySystem::AddTransaction(Transaction& trans){
-    /*if (config_->IsHMC())
-        return dram_system_->AddTransaction(trans);*/
-    if (trans.is_write || trans.is_read) {
-        return dram_system_->AddTransaction(trans.addr, trans.is_write);
+
+bool MemorySystem::AddTransaction(Transaction& trans) {
+    if (!trans.IsOperation() && trans.size == 0) {
+        if (trans.is_tagged) {
+            return AddTransaction(trans.addr, trans.is_write, trans.tag,
+                                  RequestMeta(trans.source_id, trans.priority));
+        }
+        return AddTransaction(trans.addr, trans.is_write);
+    }
+    // CiM, PIM and RowClone operations and sized reads and writes are only
+    // modeled by the detailed backend
+    if (!detailed_ && detailed_idle_ && detailed_system_ != nullptr) {
+        detailed_system_->SkipTo(clk_);
+        detailed_idle_ = false;
     }
     return dram_system_->AddTransaction(trans);
 }
@@ -11,6 +11,10 @@
 namespace dramsim3 {
 
 // This should be the interface class that deals with CPU
+// Instances share no mutable state, so any number of them can live in one
+// process and independent instances can be driven from different threads.
+// A single instance is not thread safe. If two live instances are given the
+// same output prefix, the later one writes to <prefix>_N instead.
 class MemorySystem {
    public:
     MemorySystem(const std::string &config_file, const std::string &output_dir,
@@ -27,20 +31,65 @@ class MemorySystem {
     void PrintStats() const;
     void ResetStats();
 
+    // Save/restore the complete simulator state (queues, bank states,
+    // refresh, stats) to/from a binary file. A checkpoint can only be
+    // loaded into a memory system with the same organization and queue
+    // sizes, but timing and policy parameters may differ between runs.
+    // A load that fails after the header checks, e.g. on a truncated file,
+    // leaves the state partly restored, so the memory system must be
+    // discarded.
+    bool SaveCheckpoint(const std::string &checkpoint_file) const;
+    bool LoadCheckpoint(const std::string &checkpoint_file);
+
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const;
     bool AddTransaction(uint64_t hex_addr, bool is_write);
+
+    // Tagged requests: the caller supplied tag and source id come back in a
+    // Completion instead of the address going to the read/write callbacks.
+    // Completions are passed to the completion callback if one is registered,
+    // otherwise they are buffered and the host drains them, e.g. once per
+    // tick. DrainCompletions swaps the buffer into completions, replacing its
+    // content, so reusing the same vector avoids allocations.
+    bool AddTransaction(uint64_t hex_addr, bool is_write, uint64_t tag,
+                        const RequestMeta &meta = RequestMeta());
+    void RegisterCompletionCallback(
+        std::function<void(const Completion &)> completion_callback);
+    void DrainCompletions(std::vector<Completion> &completions);
     
-    //Rewriting the above two functions for CIM in HMC
-    //The logic is implemented in the controller and hence the deduction of the transaction must happen in hmc.cc
+    // trace transactions, reads and writes (of size bytes if set), CiM
+    // operations (cim_op set), all-bank PIM operations (pim_op set),
+    // RowClone ones (clone_op set) or HMC atomics (atomic_op set)
     bool WillAcceptTransaction(Transaction& trans) const;
-    bool AddTransaction(Transaction& trans);    
+    bool AddTransaction(Transaction& trans);
+
+    // Hybrid fidelity, enabled by fast_backend in the config: new requests
+    // go to the fast analytic backend, or to the cycle accurate one after
+    // SetDetailed(true), until SetDetailed(false). fidelity_switch_cycles
+    // toggles it at fixed cycles as well. Requests in flight finish in the
+    // backend they were issued to, and the detailed backend keeps its row
+    // buffer and refresh state up to date while the fast one serves requests.
+    // Stats only cover the cycles the detailed backend was ticked.
+    void SetDetailed(bool detailed);
+    bool IsDetailed() const { return detailed_; }
 
    private:
+    BaseDRAMSystem *Active() const;
+
     // These have to be pointers because Gem5 will try to push this object
     // into container which will invoke a copy constructor, using pointers
     // here is safe
     Config *config_;
     BaseDRAMSystem *dram_system_;
+
+    // hybrid fidelity only, dram_system_ is the detailed backend then
+    BaseDRAMSystem *fast_system_;
+    JedecDRAMSystem *detailed_system_;
+    bool detailed_;
+    // detailed backend has drained and is not ticked
+    bool detailed_idle_;
+    uint64_t clk_;
+    size_t next_switch_;
+    std::vector<Completion> fast_completions_;
 };
 
 MemorySystem* GetMemorySystem(const std::string &config_file, const std::string &output_dir,
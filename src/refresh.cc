@@ -1,5 +1,7 @@
 #include "refresh.h"
 
+#include <algorithm>
+
 namespace dramsim3 {
 Refresh::Refresh(const Config &config, ChannelState &channel_state)
     : clk_(0),
@@ -20,19 +22,37 @@ Refresh::Refresh(const Config &config, ChannelState &channel_state)
 
 void Refresh::ClockTick() {
     if (clk_ % refresh_interval_ == 0 && clk_ > 0) {
-        InsertRefresh();
+        InsertRefresh(false);
     }
     clk_++;
     return;
 }
 
-void Refresh::InsertRefresh() {
+void Refresh::FastForward(uint64_t clk) {
+    // first refresh point at or after clk_, same condition as ClockTick
+    uint64_t ref_clk = (clk_ + refresh_interval_ - 1) / refresh_interval_ *
+                       refresh_interval_;
+    if (ref_clk == 0) {
+        ref_clk = refresh_interval_;
+    }
+    for (; ref_clk < clk; ref_clk += refresh_interval_) {
+        InsertRefresh(true);
+    }
+    clk_ = std::max(clk_, clk);
+    return;
+}
+
+void Refresh::InsertRefresh(bool functional) {
     switch (refresh_policy_) {
         // Simultaneous all rank refresh
         case RefreshPolicy::RANK_LEVEL_SIMULTANEOUS:
             for (auto i = 0; i < config_.ranks; i++) {
                 if (!channel_state_.IsRankSelfRefreshing(i)) {
-                    channel_state_.RankNeedRefresh(i, true);
+                    if (functional) {
+                        channel_state_.FunctionalRefresh(i, -1, -1);
+                    } else {
+                        channel_state_.RankNeedRefresh(i, true);
+                    }
                     break;
                 }
             }
@@ -40,15 +60,24 @@ void Refresh::InsertRefresh() {
         // Staggered all rank refresh
         case RefreshPolicy::RANK_LEVEL_STAGGERED:
             if (!channel_state_.IsRankSelfRefreshing(next_rank_)) {
-                channel_state_.RankNeedRefresh(next_rank_, true);
+                if (functional) {
+                    channel_state_.FunctionalRefresh(next_rank_, -1, -1);
+                } else {
+                    channel_state_.RankNeedRefresh(next_rank_, true);
+                }
             }
             IterateNext();
             break;
         // Fully staggered per bank refresh
         case RefreshPolicy::BANK_LEVEL_STAGGERED:
             if (!channel_state_.IsRankSelfRefreshing(next_rank_)) {
-                channel_state_.BankNeedRefresh(next_rank_, next_bg_, next_bank_,
-                                               true);
+                if (functional) {
+                    channel_state_.FunctionalRefresh(next_rank_, next_bg_,
+                                                     next_bank_);
+                } else {
+                    channel_state_.BankNeedRefresh(next_rank_, next_bg_,
+                                                   next_bank_, true);
+                }
             }
             IterateNext();
             break;
@@ -81,4 +110,18 @@ void Refresh::IterateNext() {
     }
 }
 
+void Refresh::SaveState(CheckpointWriter& ckpt) const {
+    ckpt.Write(clk_);
+    ckpt.Write(next_rank_);
+    ckpt.Write(next_bg_);
+    ckpt.Write(next_bank_);
+}
+
+void Refresh::LoadState(CheckpointReader& ckpt) {
+    ckpt.Read(clk_);
+    ckpt.Read(next_rank_);
+    ckpt.Read(next_bg_);
+    ckpt.Read(next_bank_);
+}
+
 }  // namespace dramsim3
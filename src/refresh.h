@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "channel_state.h"
+#include "checkpoint.h"
 #include "common.h"
 #include "configuration.h"
 
@@ -12,6 +13,10 @@ class Refresh {
    public:
     Refresh(const Config& config, ChannelState& channel_state);
     void ClockTick();
+    // skip to clk, refreshes due in between only close rows
+    void FastForward(uint64_t clk);
+    void SaveState(CheckpointWriter& ckpt) const;
+    void LoadState(CheckpointReader& ckpt);
 
    private:
     uint64_t clk_;
@@ -22,7 +27,7 @@ class Refresh {
 
     int next_rank_, next_bg_, next_bank_;
 
-    void InsertRefresh();
+    void InsertRefresh(bool functional);
 
     void IterateNext();
 };
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 
 #include "fmt/format.h"
@@ -5,6 +6,17 @@
 
 namespace dramsim3 {
 
+// stats are registered at construction, so only overwrite their values and
+// keep the existing key set (and thus print order) intact
+template <class Map>
+void LoadStatValues(CheckpointReader& ckpt, Map& stats) {
+    Map saved;
+    ckpt.Read(saved);
+    for (const auto& it : saved) {
+        stats[it.first] = it.second;
+    }
+}
+
 template <class T>
 void PrintStatText(std::ostream& where, std::string name, T value,
                    std::string description) {
@@ -37,6 +49,37 @@ SimpleStats::SimpleStats(const Config& config, int channel_id)
     InitStat("num_srefe_cmds", "counter", "Number of SREFE commands");
     InitStat("num_srefx_cmds", "counter", "Number of SREFX commands");
     InitStat("hbm_dual_cmds", "counter", "Number of cycles dual cmds issued");
+    // CiM operations are counted at the channel of their first operand
+    for (const auto& op : config_.cim_ops) {
+        std::string name = "num_" + op.name + "_done";
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        InitStat(name, "counter", "Number of " + op.name + " operations done");
+        cim_done_stats_.push_back(name);
+    }
+    InitStat("cim_bytes_saved", "counter",
+             "CiM operand bytes not moved to or from the host");
+    InitStat("num_pim_act_cmds", "counter",
+             "Number of all-bank PIM ACT commands");
+    InitStat("num_pim_compute_cmds", "counter",
+             "Number of all-bank PIM compute commands");
+    InitStat("num_pim_wb_cmds", "counter",
+             "Number of all-bank PIM write back commands");
+    InitStat("num_pim_ops_done", "counter",
+             "Number of all-bank PIM operations done");
+    InitStat("num_clone_fpm_cmds", "counter",
+             "Number of RowClone in-subarray copy commands");
+    InitStat("num_clone_psm_cmds", "counter",
+             "Number of RowClone inter-bank column copy commands");
+    InitStat("num_row_copies_done", "counter",
+             "Number of RowClone row copies done");
+    InitStat("num_row_inits_done", "counter",
+             "Number of RowClone row initializations done");
+    InitStat("clone_bytes_saved", "counter",
+             "RowClone bytes not moved to or from the host");
+    InitStat("num_split_requests", "counter",
+             "Number of requests split into bursts");
+    InitStat("num_masked_writes", "counter",
+             "Number of writes with a masked last burst");
 
     // double stats
     InitStat("act_energy", "double", "Activation energy");
@@ -44,6 +87,8 @@ SimpleStats::SimpleStats(const Config& config, int channel_id)
     InitStat("write_energy", "double", "Write energy");
     InitStat("ref_energy", "double", "Refresh energy");
     InitStat("refb_energy", "double", "Refresh-bank energy");
+    InitStat("pim_energy", "double", "All-bank PIM command energy");
+    InitStat("clone_energy", "double", "RowClone command energy");
 
     // Vector counter stats
     InitVecStat("all_bank_idle_cycles", "vec_counter",
@@ -66,6 +111,12 @@ SimpleStats::SimpleStats(const Config& config, int channel_id)
     InitHistoStat("write_latency", "Write cmd latency (cycles)", 0, 200, 10);
     InitHistoStat("interarrival_latency",
                   "Request interarrival latency (cycles)", 0, 100, 10);
+    InitHistoStat("cim_operand_latency",
+                  "CiM issue to operands read latency (cycles)", 0, 200, 10);
+    InitHistoStat("cim_compute_latency", "CiM compute latency (cycles)", 0,
+                  200, 10);
+    InitHistoStat("cim_writeback_latency", "CiM write back latency (cycles)",
+                  0, 200, 10);
 
     // some irregular stats
     InitStat("average_bandwidth", "calculated", "Average bandwidth");
@@ -75,6 +126,12 @@ SimpleStats::SimpleStats(const Config& config, int channel_id)
              "Average read request latency (cycles)");
     InitStat("average_interarrival", "calculated",
              "Average request interarrival latency (cycles)");
+    InitStat("cim_bandwidth_saved", "calculated",
+             "Host bandwidth saved by CiM operations (GB/s)");
+    InitStat("pim_bandwidth", "calculated",
+             "Bandwidth of all-bank PIM compute across banks (GB/s)");
+    InitStat("clone_bandwidth_saved", "calculated",
+             "Host bandwidth saved by RowClone operations (GB/s)");
 }
 
 void SimpleStats::AddValue(const std::string name, const int value) {
@@ -167,6 +224,46 @@ void SimpleStats::Reset() {
     }
 }
 
+void SimpleStats::DiscardEpoch() {
+    for (auto& it : epoch_counters_) {
+        it.second = 0;
+    }
+    for (auto& vec : epoch_vec_counters_) {
+        std::fill(vec.second.begin(), vec.second.end(), 0);
+    }
+    for (auto& it : epoch_histo_counts_) {
+        it.second.clear();
+    }
+}
+
+void SimpleStats::SaveState(CheckpointWriter& ckpt) const {
+    ckpt.Write(counters_);
+    ckpt.Write(epoch_counters_);
+    ckpt.Write(vec_counters_);
+    ckpt.Write(epoch_vec_counters_);
+    ckpt.Write(doubles_);
+    ckpt.Write(vec_doubles_);
+    ckpt.Write(calculated_);
+    ckpt.Write(histo_counts_);
+    ckpt.Write(epoch_histo_counts_);
+    ckpt.Write(histo_bins_);
+    ckpt.Write(epoch_histo_bins_);
+}
+
+void SimpleStats::LoadState(CheckpointReader& ckpt) {
+    LoadStatValues(ckpt, counters_);
+    LoadStatValues(ckpt, epoch_counters_);
+    LoadStatValues(ckpt, vec_counters_);
+    LoadStatValues(ckpt, epoch_vec_counters_);
+    LoadStatValues(ckpt, doubles_);
+    LoadStatValues(ckpt, vec_doubles_);
+    LoadStatValues(ckpt, calculated_);
+    LoadStatValues(ckpt, histo_counts_);
+    LoadStatValues(ckpt, epoch_histo_counts_);
+    LoadStatValues(ckpt, histo_bins_);
+    LoadStatValues(ckpt, epoch_histo_bins_);
+}
+
 void SimpleStats::InitStat(std::string name, std::string stat_type,
                            std::string description) {
     header_descs_.emplace(name, description);
@@ -369,6 +466,14 @@ void SimpleStats::UpdateEpochStats() {
         epoch_counters_["num_ref_cmds"] * config_.ref_energy_inc;
     doubles_["refb_energy"] =
         epoch_counters_["num_refb_cmds"] * config_.refb_energy_inc;
+    doubles_["pim_energy"] =
+        epoch_counters_["num_pim_act_cmds"] * config_.pim_act_energy_inc +
+        epoch_counters_["num_pim_compute_cmds"] *
+            config_.pim_compute_energy_inc +
+        epoch_counters_["num_pim_wb_cmds"] * config_.pim_wb_energy_inc;
+    doubles_["clone_energy"] =
+        epoch_counters_["num_clone_fpm_cmds"] * config_.clone_fpm_energy_inc +
+        epoch_counters_["num_clone_psm_cmds"] * config_.clone_psm_energy_inc;
 
     // vector doubles, update first, then push
     double background_energy = 0.0;
@@ -393,10 +498,18 @@ void SimpleStats::UpdateEpochStats() {
     double total_time = epoch_counters_["num_cycles"] * config_.tCK;
     double avg_bw = total_reqs * config_.request_size_bytes / total_time;
     calculated_["average_bandwidth"] = avg_bw;
+    calculated_["cim_bandwidth_saved"] =
+        epoch_counters_["cim_bytes_saved"] / total_time;
+    calculated_["pim_bandwidth"] = epoch_counters_["num_pim_compute_cmds"] *
+                                   config_.banks * config_.request_size_bytes /
+                                   total_time;
+    calculated_["clone_bandwidth_saved"] =
+        epoch_counters_["clone_bytes_saved"] / total_time;
 
     double total_energy = doubles_["act_energy"] + doubles_["read_energy"] +
                           doubles_["write_energy"] + doubles_["ref_energy"] +
-                          doubles_["refb_energy"] + background_energy;
+                          doubles_["refb_energy"] + doubles_["pim_energy"] +
+                          doubles_["clone_energy"] + background_energy;
     calculated_["total_energy"] = total_energy;
     calculated_["average_power"] = total_energy / epoch_counters_["num_cycles"];
     calculated_["average_read_latency"] =
@@ -429,6 +542,13 @@ void SimpleStats::UpdateFinalStats() {
     doubles_["ref_energy"] = counters_["num_ref_cmds"] * config_.ref_energy_inc;
     doubles_["refb_energy"] =
         counters_["num_refb_cmds"] * config_.refb_energy_inc;
+    doubles_["pim_energy"] =
+        counters_["num_pim_act_cmds"] * config_.pim_act_energy_inc +
+        counters_["num_pim_compute_cmds"] * config_.pim_compute_energy_inc +
+        counters_["num_pim_wb_cmds"] * config_.pim_wb_energy_inc;
+    doubles_["clone_energy"] =
+        counters_["num_clone_fpm_cmds"] * config_.clone_fpm_energy_inc +
+        counters_["num_clone_psm_cmds"] * config_.clone_psm_energy_inc;
 
     // vector doubles, update first, then push
     double background_energy = 0.0;
@@ -454,10 +574,18 @@ void SimpleStats::UpdateFinalStats() {
     double total_time = counters_["num_cycles"] * config_.tCK;
     double avg_bw = total_reqs * config_.request_size_bytes / total_time;
     calculated_["average_bandwidth"] = avg_bw;
+    calculated_["cim_bandwidth_saved"] =
+        counters_["cim_bytes_saved"] / total_time;
+    calculated_["pim_bandwidth"] = counters_["num_pim_compute_cmds"] *
+                                   config_.banks * config_.request_size_bytes /
+                                   total_time;
+    calculated_["clone_bandwidth_saved"] =
+        counters_["clone_bytes_saved"] / total_time;
 
     double total_energy = doubles_["act_energy"] + doubles_["read_energy"] +
                           doubles_["write_energy"] + doubles_["ref_energy"] +
-                          doubles_["refb_energy"] + background_energy;
+                          doubles_["refb_energy"] + doubles_["pim_energy"] +
+                          doubles_["clone_energy"] + background_energy;
     calculated_["total_energy"] = total_energy;
     calculated_["average_power"] = total_energy / counters_["num_cycles"];
     // calculated_["average_read_latency"] = GetHistoAvg("read_latency");
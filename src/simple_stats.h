@@ -6,6 +6,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "checkpoint.h"
 #include "configuration.h"
 #include "json.hpp"
 
@@ -17,6 +18,11 @@ class SimpleStats {
     // incrementing counter
     void Increment(const std::string name) { epoch_counters_[name] += 1; }
 
+    // increment counter by number
+    void IncrementBy(const std::string name, uint64_t num) {
+        epoch_counters_[name] += num;
+    }
+
     // incrementing for vec counter
     void IncrementVec(const std::string name, int pos) {
         epoch_vec_counters_[name][pos] += 1;
@@ -39,6 +45,30 @@ class SimpleStats {
     // Reset (usually after one phase of simulation)
     void Reset();
 
+    // drop whatever was collected in the current epoch
+    void DiscardEpoch();
+
+    double GetCalculated(const std::string& name) const {
+        return calculated_.at(name);
+    }
+
+    // standby and self refresh energy of a rank over the last epoch, or the
+    // whole run after PrintFinalStats
+    double RankBackgroundEnergy(int rank) const {
+        return vec_doubles_.at("act_stb_energy")[rank] +
+               vec_doubles_.at("pre_stb_energy")[rank] +
+               vec_doubles_.at("sref_energy")[rank];
+    }
+
+    // counter of completed operations of Config::cim_ops[op]
+    const std::string& CiMDoneStat(int op) const {
+        return cim_done_stats_[op];
+    }
+
+    void SaveState(CheckpointWriter& ckpt) const;
+
+    void LoadState(CheckpointReader& ckpt);
+
    private:
     using VecStat = std::unordered_map<std::string, std::vector<uint64_t> >;
     using HistoCount = std::unordered_map<int, uint64_t>;
@@ -93,6 +123,8 @@ class SimpleStats {
     VecStat histo_bins_;
     VecStat epoch_histo_bins_;
 
+    std::vector<std::string> cim_done_stats_;
+
     // outputs
     Json j_data_;
     std::vector<std::pair<std::string, std::string> > print_pairs_;
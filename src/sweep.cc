@@ -0,0 +1,390 @@
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "./../ext/headers/args.hxx"
+#include "fmt/format.h"
+#include "json.hpp"
+#include "memory_system.h"
+
+// In-process parameter sweep
+// Takes a base config and a sweep specification, one parameter per line:
+//     section.key = value1, value2, ...
+// and simulates every combination of the listed values on the same trace.
+// The trace is parsed once and shared by all variants, which run on a pool
+// of threads, each with its own MemorySystem. The summary of all variants is
+// merged into a single CSV table.
+
+using namespace dramsim3;
+using Json = nlohmann::json;
+
+namespace {
+
+struct SweepParam {
+    std::string section;
+    std::string key;
+    std::vector<std::string> values;
+};
+
+struct Variant {
+    std::string name;
+    // one value per sweep parameter, same order as the spec
+    std::vector<std::string> values;
+    Json stats;
+};
+
+// stats that go into the merged table, summed over channels except for the
+// read latency which is weighted by the number of reads
+const std::vector<std::string> kSummedStats = {
+    "num_reads_done",   "num_writes_done", "num_read_row_hits",
+    "num_write_row_hits", "num_act_cmds",  "num_ref_cmds",
+    "average_bandwidth", "average_power",  "total_energy"};
+
+std::string Trim(const std::string& str) {
+    auto start = str.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) {
+        return "";
+    }
+    auto end = str.find_last_not_of(" \t\r\n");
+    return str.substr(start, end - start + 1);
+}
+
+std::vector<SweepParam> ParseSweepSpec(const std::string& spec_file) {
+    std::ifstream spec_in(spec_file);
+    if (spec_in.fail()) {
+        std::cerr << "Cannot open sweep spec " << spec_file << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    std::vector<SweepParam> params;
+    std::string line;
+    int line_num = 0;
+    while (std::getline(spec_in, line)) {
+        line_num++;
+        line = Trim(line.substr(0, line.find_first_of("#;")));
+        if (line.empty()) {
+            continue;
+        }
+        auto eq_pos = line.find('=');
+        auto name = Trim(line.substr(0, eq_pos));
+        auto dot_pos = name.find('.');
+        if (eq_pos == std::string::npos || dot_pos == std::string::npos) {
+            std::cerr << spec_file << ":" << line_num
+                      << ": expecting section.key = value1, value2, ..."
+                      << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        SweepParam param;
+        param.section = Trim(name.substr(0, dot_pos));
+        param.key = Trim(name.substr(dot_pos + 1));
+        for (const auto& val : StringSplit(line.substr(eq_pos + 1), ',')) {
+            if (!Trim(val).empty()) {
+                param.values.push_back(Trim(val));
+            }
+        }
+        if (param.values.empty()) {
+            std::cerr << spec_file << ":" << line_num << ": no values for "
+                      << name << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        params.push_back(param);
+    }
+    return params;
+}
+
+std::vector<Variant> ExpandVariants(const std::vector<SweepParam>& params) {
+    std::vector<Variant> variants(1);
+    for (const auto& param : params) {
+        std::vector<Variant> expanded;
+        for (const auto& variant : variants) {
+            for (const auto& val : param.values) {
+                expanded.push_back(variant);
+                expanded.back().values.push_back(val);
+            }
+        }
+        variants.swap(expanded);
+    }
+    for (size_t i = 0; i < variants.size(); i++) {
+        variants[i].name = fmt::format("sweep_{:04d}", i);
+    }
+    return variants;
+}
+
+// rewrite the base ini with the overrides of a variant, keys already in the
+// base config are replaced in place, others are added to their section
+std::string ApplyOverrides(const std::vector<std::string>& base_lines,
+                           const std::vector<SweepParam>& params,
+                           const Variant& variant) {
+    std::vector<std::pair<std::string, std::string>> overrides;
+    for (size_t i = 0; i < params.size(); i++) {
+        overrides.emplace_back(params[i].section + "." + params[i].key,
+                               variant.values[i]);
+    }
+    // every variant gets its own stats files
+    overrides.emplace_back("other.output_prefix", variant.name);
+    std::vector<bool> applied(overrides.size(), false);
+
+    std::string section;
+    std::stringstream ini;
+    auto flush_section = [&]() {
+        for (size_t i = 0; i < overrides.size(); i++) {
+            const auto& name = overrides[i].first;
+            if (!applied[i] && name.substr(0, name.find('.')) == section) {
+                ini << name.substr(name.find('.') + 1) << " = "
+                    << overrides[i].second << std::endl;
+                applied[i] = true;
+            }
+        }
+    };
+    for (const auto& line : base_lines) {
+        auto trimmed = Trim(line);
+        if (!trimmed.empty() && trimmed[0] == '[') {
+            flush_section();
+            section = Trim(trimmed.substr(1, trimmed.find(']') - 1));
+            ini << line << std::endl;
+            continue;
+        }
+        auto eq_pos = trimmed.find('=');
+        if (eq_pos != std::string::npos && trimmed[0] != '#' &&
+            trimmed[0] != ';') {
+            auto name = section + "." + Trim(trimmed.substr(0, eq_pos));
+            bool replaced = false;
+            for (size_t i = 0; i < overrides.size(); i++) {
+                if (overrides[i].first == name) {
+                    ini << Trim(trimmed.substr(0, eq_pos)) << " = "
+                        << overrides[i].second << std::endl;
+                    applied[i] = true;
+                    replaced = true;
+                    break;
+                }
+            }
+            if (replaced) {
+                continue;
+            }
+        }
+        ini << line << std::endl;
+    }
+    flush_section();
+    // sections that do not exist in the base config
+    for (size_t i = 0; i < overrides.size(); i++) {
+        if (!applied[i]) {
+            section = overrides[i].first.substr(0, overrides[i].first.find('.'));
+            ini << std::endl << "[" << section << "]" << std::endl;
+            flush_section();
+        }
+    }
+    return ini.str();
+}
+
+std::vector<Transaction> ParseTrace(const std::string& trace_file) {
+    std::ifstream trace_in(trace_file);
+    if (trace_in.fail()) {
+        std::cerr << "Trace file does not exist" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    std::vector<Transaction> trace;
+    Transaction trans;
+    while (trace_in >> trans) {
+        trace.push_back(trans);
+    }
+    return trace;
+}
+
+// replay the shared trace the same way TraceBasedCPU does
+void RunVariant(const std::string& config_file, const std::string& output_dir,
+                const std::vector<Transaction>& trace, uint64_t cycles) {
+    auto callback = [](uint64_t addr) { return; };
+    MemorySystem* memory_system =
+        new MemorySystem(config_file, output_dir, callback, callback);
+    size_t trace_idx = 0;
+    for (uint64_t clk = 0; clk < cycles; clk++) {
+        memory_system->ClockTick();
+        if (trace_idx < trace.size() && trace[trace_idx].added_cycle <= clk) {
+            Transaction trans = trace[trace_idx];
+            if (memory_system->WillAcceptTransaction(trans)) {
+                memory_system->AddTransaction(trans);
+                trace_idx++;
+            }
+        }
+    }
+    memory_system->PrintStats();
+    delete memory_system;
+}
+
+Json SummarizeStats(const std::string& stats_file) {
+    std::ifstream j_in(stats_file);
+    Json j_summary;
+    if (j_in.fail()) {
+        return j_summary;
+    }
+    Json j_stats;
+    j_in >> j_stats;
+    double num_reads = 0.0, latency_sum = 0.0;
+    for (const auto& stat : kSummedStats) {
+        j_summary[stat] = 0.0;
+    }
+    for (auto it = j_stats.begin(); it != j_stats.end(); ++it) {
+        const auto& j_channel = it.value();
+        for (const auto& stat : kSummedStats) {
+            // analytic backends only report a subset of the stats
+            j_summary[stat] =
+                j_summary[stat].get<double>() + j_channel.value(stat, 0.0);
+        }
+        double reads = j_channel.value("num_reads_done", 0.0);
+        num_reads += reads;
+        latency_sum += reads * j_channel.value("average_read_latency", 0.0);
+        j_summary["num_cycles"] = j_channel["num_cycles"];
+    }
+    j_summary["average_read_latency"] =
+        num_reads > 0 ? latency_sum / num_reads : 0.0;
+    return j_summary;
+}
+
+void WriteTable(std::ostream& out, const std::vector<SweepParam>& params,
+                const std::vector<Variant>& variants) {
+    std::vector<std::string> stat_names = {"num_cycles",
+                                           "average_read_latency"};
+    stat_names.insert(stat_names.end(), kSummedStats.begin(),
+                      kSummedStats.end());
+    out << "variant";
+    for (const auto& param : params) {
+        out << "," << param.section << "." << param.key;
+    }
+    for (const auto& stat : stat_names) {
+        out << "," << stat;
+    }
+    out << std::endl;
+    for (const auto& variant : variants) {
+        out << variant.name;
+        for (const auto& val : variant.values) {
+            out << "," << val;
+        }
+        for (const auto& stat : stat_names) {
+            out << ",";
+            if (variant.stats.find(stat) != variant.stats.end()) {
+                out << variant.stats[stat];
+            }
+        }
+        out << std::endl;
+    }
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+    args::ArgumentParser parser(
+        "DRAMsim3 parameter sweep.",
+        "Example: \n"
+        "./build/dramsim3sweep configs/DDR4_8Gb_x8_3200.ini -s sweep.txt -t "
+        "sample_trace.txt -c 1000000 -o sweep_out -j 8\n"
+        "where sweep.txt holds lines like\n"
+        "system.queue_structure = PER_BANK, PER_RANK\n"
+        "system.trans_queue_size = 16, 32, 64");
+    args::HelpFlag help(parser, "help", "Display the help menu", {'h', "help"});
+    args::ValueFlag<uint64_t> num_cycles_arg(parser, "num_cycles",
+                                             "Number of cycles to simulate",
+                                             {'c', "cycles"}, 100000);
+    args::ValueFlag<std::string> output_dir_arg(
+        parser, "output_dir", "Output directory for configs and stats files",
+        {'o', "output-dir"}, ".");
+    args::ValueFlag<std::string> spec_arg(
+        parser, "sweep_spec", "Sweep specification file", {'s', "sweep"});
+    args::ValueFlag<std::string> trace_file_arg(parser, "trace", "Trace file",
+                                                {'t', "trace"});
+    args::ValueFlag<unsigned> threads_arg(
+        parser, "threads", "Number of worker threads (default: all cores)",
+        {'j', "threads"}, 0);
+    args::Positional<std::string> config_arg(
+        parser, "config", "The base config file name (mandatory)");
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help) {
+        std::cout << parser;
+        return 0;
+    } catch (args::ParseError e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    std::string config_file = args::get(config_arg);
+    if (config_file.empty() || !spec_arg || !trace_file_arg) {
+        std::cerr << parser;
+        return 1;
+    }
+    uint64_t cycles = args::get(num_cycles_arg);
+    std::string output_dir = args::get(output_dir_arg);
+
+    std::ifstream base_in(config_file);
+    if (base_in.fail()) {
+        std::cerr << "Cannot open config " << config_file << std::endl;
+        return 1;
+    }
+    std::vector<std::string> base_lines;
+    std::string line;
+    while (std::getline(base_in, line)) {
+        base_lines.push_back(line);
+    }
+
+    auto params = ParseSweepSpec(args::get(spec_arg));
+    auto variants = ExpandVariants(params);
+    const std::vector<Transaction> trace =
+        ParseTrace(args::get(trace_file_arg));
+
+    std::vector<std::string> variant_configs;
+    for (const auto& variant : variants) {
+        std::string variant_config = output_dir + "/" + variant.name + ".ini";
+        std::ofstream ini_out(variant_config);
+        if (ini_out.fail()) {
+            std::cerr << "Cannot write " << variant_config << std::endl;
+            return 1;
+        }
+        ini_out << ApplyOverrides(base_lines, params, variant);
+        variant_configs.push_back(variant_config);
+    }
+
+    unsigned num_threads = args::get(threads_arg);
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::min<unsigned>(num_threads, variants.size());
+    std::cout << "Running " << variants.size() << " variants on "
+              << num_threads << " threads, " << trace.size()
+              << " requests in trace" << std::endl;
+
+    std::atomic<size_t> next_variant(0);
+    std::mutex print_mutex;
+    auto worker = [&]() {
+        while (true) {
+            size_t idx = next_variant++;
+            if (idx >= variants.size()) {
+                return;
+            }
+            RunVariant(variant_configs[idx], output_dir, trace, cycles);
+            variants[idx].stats = SummarizeStats(output_dir + "/" +
+                                                 variants[idx].name + ".json");
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::cout << variants[idx].name << " done" << std::endl;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < num_threads; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    std::string table_name = output_dir + "/sweep_results.csv";
+    std::ofstream table_out(table_name);
+    WriteTable(table_out, params, variants);
+    WriteTable(std::cout, params, variants);
+    std::cout << "Results written to " << table_name << std::endl;
+    return 0;
+}
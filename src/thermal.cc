@@ -20,8 +20,6 @@ extern "C" double *initialize_Temperature(double W, double Lc, int numP,
 
 namespace dramsim3 {
 
-std::function<Address(const Address &addr)> GetPhyAddress;
-
 ThermalCalculator::ThermalCalculator(const Config &config)
     : config_(config),
       time_iter0(10),
@@ -134,7 +132,7 @@ void ThermalCalculator::SetPhyAddressMapping() {
     if (mapping_string.empty()) {
         // if no location mapping specified, then do not map and use default
         // mapping...
-        GetPhyAddress = [](const Address &addr) { return Address(addr); };
+        get_phy_address_ = [](const Address &addr) { return Address(addr); };
         return;
     }
     std::vector<std::string> bit_fields = StringSplit(mapping_string, ',');
@@ -187,7 +185,7 @@ void ThermalCalculator::SetPhyAddressMapping() {
 
     int column_offset = LogBase2(config_.BL);
 
-    GetPhyAddress = [mapped_pos, column_offset](const Address &addr) {
+    get_phy_address_ = [mapped_pos, column_offset](const Address &addr) {
         uint64_t new_hex = 0;
         // ch - ra - bg - ba - ro - co
         int origin_pos[] = {addr.channel, addr.rank, addr.bankgroup,
@@ -327,7 +325,7 @@ std::pair<std::vector<int>, std::vector<int>> ThermalCalculator::MapToXY(
 
     Address temp_addr = Address(cmd.addr);
     for (int i = 0; i < config_.BL; i++) {
-        Address phy_loc = GetPhyAddress(temp_addr);
+        Address phy_loc = get_phy_address_(temp_addr);
         int col_id = phy_loc.column * config_.device_width;
         int bank_x_offset = bank_x * config_.num_x_grids;
         int bank_y_offset = bank_y * config_.num_y_grids;
@@ -404,7 +402,7 @@ void ThermalCalculator::LocationMappingANDaddEnergy_RF(const int channel,
 
     int z = MapToZ(channel, bank_id);
 
-    Address phy_addr = GetPhyAddress(new_addr);  // actual row after mapping
+    Address phy_addr = get_phy_address_(new_addr);  // actual row after mapping
     // calculate x y z
     int row_id = phy_addr.row;
     int col_id = 0;  // refresh all units
@@ -538,7 +536,7 @@ void ThermalCalculator::UpdateEpoch(uint64_t clk) {
                 int case_id = i * config_.ranks + j;
                 double bg_energy =
                     background_energy_[i][j] / (dimX * dimY * numP);
-                for (int k = 0; k < dimX * dimY * numP; i++) {
+                for (int k = 0; k < dimX * dimY * numP; k++) {
                     cur_Pmap[case_id][k] += bg_energy / 1000 / num_devices;
                 }
             }
@@ -598,8 +596,8 @@ void ThermalCalculator::PrintFinalPT(uint64_t clk) {
                 int case_id = i * config_.ranks + j;
                 double bg_energy =
                     background_energy_[i][j] / (dimX * dimY * numP);
-                for (int k = 0; k < dimX * dimY * numP; i++) {
-                    accu_Pmap[case_id][i] += bg_energy / 1000 / num_devices;
+                for (int k = 0; k < dimX * dimY * numP; k++) {
+                    accu_Pmap[case_id][k] += bg_energy / 1000 / num_devices;
                 }
             }
         }
@@ -645,12 +643,14 @@ void ThermalCalculator::CalcFinalT(int case_id, uint64_t clk) {
 
 double ***ThermalCalculator::InitPowerM(int case_id, uint64_t clk) {
     double ***powerM;
-    // assert in powerM
-    powerM = new double **[dimX + num_dummy];
+    // assert in powerM, the solvers free() it
+    powerM = static_cast<double ***>(
+        malloc((dimX + num_dummy) * sizeof(double **)));
     for (int i = 0; i < dimX + num_dummy; i++) {
-        powerM[i] = new double *[dimY + num_dummy];
+        powerM[i] = static_cast<double **>(
+            malloc((dimY + num_dummy) * sizeof(double *)));
         for (int j = 0; j < dimY + num_dummy; j++) {
-            powerM[i][j] = new double[numP];
+            powerM[i][j] = static_cast<double *>(malloc(numP * sizeof(double)));
         }
     }
     // initialize powerM
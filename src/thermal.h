@@ -14,8 +14,6 @@
 
 namespace dramsim3 {
 
-extern std::function<Address(const Address &addr)> GetPhyAddress;
-
 class ThermalCalculator {
    public:
     ThermalCalculator(const Config &config);
@@ -76,6 +74,8 @@ class ThermalCalculator {
 
 
     const Config &config_;
+    // maps logical address to physical location on the die
+    std::function<Address(const Address &addr)> get_phy_address_;
 
     int time_iter0, time_iter;
     double Tamb;  // The ambient temperature in Kelvin
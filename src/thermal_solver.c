@@ -1,13 +1,28 @@
 /* thermal solver
- * based on superLU
+ * based on superLU, or on conjugate gradient when built with THERMAL_PCG
  * zhiyuan yang
  */
 #include <math.h>
-#include <omp.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#ifdef THERMAL_PCG
+// the few SuperLU helpers used here, -D_LONGINT makes int_t 64 bits
+typedef long long int int_t;
+#define doubleMalloc(n) ((double *)malloc((n) * sizeof(double)))
+#define intMalloc(n) ((int_t *)malloc((n) * sizeof(int_t)))
+#define SUPERLU_FREE(p) free(p)
+#define SUPERLU_ABORT(err_msg)             \
+    {                                      \
+        fprintf(stderr, "%s\n", err_msg); \
+        exit(-1);                          \
+    }
+#else
+#include <omp.h>
 #include "../ext/SuperLU_MT_3.1/SRC/slu_mt_ddefs.h"
+#endif  // THERMAL_PCG
 #include "thermal_config.h"
 
 //#define DEBUG
@@ -420,25 +435,103 @@ double **calculate_Midx_array(double W, double Lc, int numP, int dimX, int dimZ,
     return Midx;
 }
 
-double *steady_thermal_solver(double ***powerM, double W, double Lc, int numP,
-                              int dimX, int dimZ, double **Midx, int count,
-                              double Tamb) {
-    int numLayer = numP * 3;
-    int_t *layerP;
-    // define the active layer array
-    if (!(layerP = intMalloc(numP))) SUPERLU_ABORT("Malloc fails for numP[].");
-    for (int l = 0; l < numP; l++) layerP[l] = l * 3;
+#ifdef THERMAL_PCG
+/* solves G * T = rhs in place by conjugate gradient with a Jacobi
+ * preconditioner, G is symmetric and diagonally dominant; Midx holds G row by
+ * row, T starts from the ambient temperature
+ */
+static void solve_G(double **Midx, int count, int n, double *rhs,
+                    double Tamb) {
+    int *rowp, *col;
+    double *val, *diag, *x, *r, *z, *p, *Ap;
+    if (!(rowp = (int *)malloc((n + 1) * sizeof(int))) ||
+        !(col = (int *)malloc(count * sizeof(int))) ||
+        !(val = doubleMalloc(count)) || !(diag = doubleMalloc(n)) ||
+        !(x = doubleMalloc(n)) || !(r = doubleMalloc(n)) ||
+        !(z = doubleMalloc(n)) || !(p = doubleMalloc(n)) ||
+        !(Ap = doubleMalloc(n)))
+        SUPERLU_ABORT("Malloc fails for the PCG arrays.");
+
+    // compressed rows of G
+    int row = -1;
+    for (int i = 0; i < count; i++) {
+        int r0 = (int)(Midx[i][0] + 0.01);
+        while (row < r0) rowp[++row] = i;
+        col[i] = (int)(Midx[i][1] + 0.01);
+        val[i] = Midx[i][2];
+        if (col[i] == r0) diag[r0] = val[i];
+    }
+    while (row < n) rowp[++row] = count;
 
-    double Wsink = W;
-    double Lsink = Lc;
-    double Hsink = Hhs;
-    double Ksink = Khs;
-    double gridXsink = Wsink / dimX;
-    double gridZsink = Lsink / dimZ;
-    double Rsinky = Hsink / Ksink / gridXsink / gridZsink;  // y direction
-    double Ramb = Rsinky / 2;
+    printf("Solving the %d x %d G matrix by PCG\n", n, n);
+
+    double bnorm = 0.0, rz = 0.0;
+    for (int i = 0; i < n; i++) {
+        x[i] = Tamb;
+        bnorm += rhs[i] * rhs[i];
+    }
+    for (int i = 0; i < n; i++) {
+        double Ax = 0.0;
+        for (int k = rowp[i]; k < rowp[i + 1]; k++) Ax += val[k] * x[col[k]];
+        r[i] = rhs[i] - Ax;
+        z[i] = r[i] / diag[i];
+        p[i] = z[i];
+        rz += r[i] * z[i];
+    }
 
-    // convert the values to the SuperMatrix format
+    // in exact arithmetic CG is done after n iterations
+    const double tol = 1e-12;
+    int iter, max_iter = 4 * n;
+    double rnorm = 0.0;
+    for (iter = 0; iter < max_iter; iter++) {
+        double pAp = 0.0;
+        for (int i = 0; i < n; i++) {
+            double sum = 0.0;
+            for (int k = rowp[i]; k < rowp[i + 1]; k++)
+                sum += val[k] * p[col[k]];
+            Ap[i] = sum;
+            pAp += p[i] * sum;
+        }
+        double alpha = rz / pAp;
+        rnorm = 0.0;
+        for (int i = 0; i < n; i++) {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * Ap[i];
+            rnorm += r[i] * r[i];
+        }
+        if (rnorm <= tol * tol * bnorm) break;
+        double rz_new = 0.0;
+        for (int i = 0; i < n; i++) {
+            z[i] = r[i] / diag[i];
+            rz_new += r[i] * z[i];
+        }
+        double beta = rz_new / rz;
+        rz = rz_new;
+        for (int i = 0; i < n; i++) p[i] = z[i] + beta * p[i];
+    }
+    if (iter == max_iter)
+        printf("WARNING: PCG did not converge, relative residual %.3e\n",
+               sqrt(rnorm / bnorm));
+    else
+        printf("PCG converged in %d iterations\n", iter + 1);
+
+    for (int i = 0; i < n; i++) rhs[i] = x[i];
+    free(rowp);
+    free(col);
+    SUPERLU_FREE(val);
+    SUPERLU_FREE(diag);
+    SUPERLU_FREE(x);
+    SUPERLU_FREE(r);
+    SUPERLU_FREE(z);
+    SUPERLU_FREE(p);
+    SUPERLU_FREE(Ap);
+}
+#else
+/* solves G * T = rhs in place with SuperLU_MT, Midx holds G row by row, G is
+ * symmetric so the rows can be handed over as columns
+ */
+static void solve_G(double **Midx, int count, int n, double *rhs,
+                    double Tamb) {
     SuperMatrix A, L, U, B;
     double *a;
     int_t *asub, *xa;
@@ -446,24 +539,18 @@ double *steady_thermal_solver(double ***powerM, double W, double Lc, int numP,
     int_t *perm_c; /* column permutation vector */
     SCPformat *Lstore;
     NCPformat *Ustore;
-    int_t nrhs, info, m, n, nnz, b;
+    int_t nrhs, info, m, nnz;
     int_t nprocs; /* maximum number of processors to use. */
-    int_t panel_size, relax, maxsup;
+    int_t panel_size;
     int_t permc_spec;
-    trans_t trans;
-    double *rhs;
     superlu_memusage_t superlu_memusage;
 
     nrhs = 1;
-    trans = NOTRANS;
     nprocs = omp_get_max_threads();
-    b = 1;
     panel_size = sp_ienv(1);
-    relax = sp_ienv(2);
-    maxsup = sp_ienv(3);
 
     /* Initialize matrix A. */
-    m = n = dimX * dimZ * (numLayer + 1);
+    m = n;
     nnz = count;
     if (!(a = doubleMalloc(nnz)))
         SUPERLU_ABORT("Malloc fails for a[].");  // I cannot free the space
@@ -486,38 +573,13 @@ double *steady_thermal_solver(double ***powerM, double W, double Lc, int numP,
 
     printf("Using %lld Cores to calculate\n", nprocs);
     printf("Building the sparse matrix ...\n");
-    printf("Dimension of the G matrix is %lld x %lld\n", m, n);
+    printf("Dimension of the G matrix is %lld x %lld\n", m, (int_t)n);
     printf("Number of non-zero entries is %lld\n", nnz);
 
     /* Create matrix A in the format expected by SuperLU. */
     dCreate_CompCol_Matrix(&A, m, n, nnz, a, asub, xa, SLU_NC, SLU_D, SLU_GE);
     // dPrint_CompCol_Matrix("A", &A);
-    /* Create right-hand side matrix B. */
-    if (!(rhs = doubleMalloc(m * nrhs)))
-        SUPERLU_ABORT("Malloc fails for rhs[].");
-
-    // assign values to B
-    for (int i = 0; i < m; i++)  // initialize rhs to 0
-        rhs[i] = 0;
-    for (int i = 0; i < dimX * dimZ; i++) rhs[i] = Tamb / Ramb;
-    for (int l = 0; l < numP; l++)
-        for (int i = 0; i < dimX; i++)
-            for (int j = 0; j < dimZ; j++) {
-                rhs[dimX * dimZ * (layerP[l] + 1) + j * dimX + i] =
-                    powerM[i][j][l];
-                // rhs[dimX*dimZ*(layerP[l]+1) + i*dimZ + j] = powerM[i][j][l];
-                // printf("%.6f\n", powerM[i][j][l]);
-            }
-
-    // free the space
-    for (int i = 0; i < dimX; i++) {
-        for (int j = 0; j < dimZ; j++) {
-            free(powerM[i][j]);
-        }
-        free(powerM[i]);
-    }
-    free(powerM);
-
+    /* Create right-hand side matrix B, solved in place */
     dCreate_Dense_Matrix(&B, m, nrhs, rhs, m, SLU_DN, SLU_D, SLU_GE);
 
     // dPrint_Dense_Matrix("B", &B);
@@ -543,33 +605,6 @@ double *steady_thermal_solver(double ***powerM, double W, double Lc, int numP,
 
     printf("Finish solving the linear equation\n");
 
-    // dPrint_Dense_Matrix("B", &B);
-
-    // extract the Temperature from B
-    DNformat *Astore = (DNformat *)B.Store;
-    // double *Tt; // vector stores the temperature for all grids
-
-    double *Ttp, *Tt;
-    if (!(Tt = (double *)malloc(dimX * dimZ * (numP * 3 + 1) * sizeof(double))))
-        printf("Malloc fails for Tt\n");
-    Ttp = (double *)Astore->nzval;
-    printf("B.nrow is %lld\n", B.nrow);
-    for (int i = 0; i < B.nrow; ++i) {
-        Tt[i] = Ttp[i] - T0;
-        // printf("Tt[%d] = %.2f\n", i, Tt[i]);
-    }
-
-    /*Tt = (double *) Astore->nzval;
-    printf("B.nrow is %d\n", B.nrow);
-    for (i = 0; i < B.nrow; ++i)
-    {
-        Tt[i] = Tt[i] - T0;
-        //printf("%.2f\n", T[i]);
-    }*/
-
-    printf("Finish converting the temperature matrix\n");
-    printf("Free the space...\n");
-
     if (info == 0) {
         // dinf_norm_error(nrhs, &B, xact); /* Inf. norm of the error */
 
@@ -587,9 +622,6 @@ double *steady_thermal_solver(double ***powerM, double W, double Lc, int numP,
     }
 
     /* De-allocate storage */
-    // free the arrays defined by myself
-    SUPERLU_FREE(layerP);
-    SUPERLU_FREE(rhs);
     SUPERLU_FREE(perm_r);
     SUPERLU_FREE(perm_c);
     printf("finish SUPERLU_FREE\n");
@@ -597,8 +629,70 @@ double *steady_thermal_solver(double ***powerM, double W, double Lc, int numP,
     Destroy_SuperMatrix_Store(&B);
     Destroy_SuperNode_SCP(&L);
     Destroy_CompCol_NCP(&U);
-    /* De-allocate other storage */
-    // free(K); free(H); free(layerP); free(Tt);
+}
+#endif  // THERMAL_PCG
+
+double *steady_thermal_solver(double ***powerM, double W, double Lc, int numP,
+                              int dimX, int dimZ, double **Midx, int count,
+                              double Tamb) {
+    int numLayer = numP * 3;
+    int_t *layerP;
+    // define the active layer array
+    if (!(layerP = intMalloc(numP))) SUPERLU_ABORT("Malloc fails for numP[].");
+    for (int l = 0; l < numP; l++) layerP[l] = l * 3;
+
+    double Wsink = W;
+    double Lsink = Lc;
+    double Hsink = Hhs;
+    double Ksink = Khs;
+    double gridXsink = Wsink / dimX;
+    double gridZsink = Lsink / dimZ;
+    double Rsinky = Hsink / Ksink / gridXsink / gridZsink;  // y direction
+    double Ramb = Rsinky / 2;
+
+    int m = dimX * dimZ * (numLayer + 1);
+    double *rhs;
+    if (!(rhs = doubleMalloc(m))) SUPERLU_ABORT("Malloc fails for rhs[].");
+
+    // assign values to B
+    for (int i = 0; i < m; i++)  // initialize rhs to 0
+        rhs[i] = 0;
+    for (int i = 0; i < dimX * dimZ; i++) rhs[i] = Tamb / Ramb;
+    for (int l = 0; l < numP; l++)
+        for (int i = 0; i < dimX; i++)
+            for (int j = 0; j < dimZ; j++) {
+                rhs[dimX * dimZ * (layerP[l] + 1) + j * dimX + i] =
+                    powerM[i][j][l];
+                // rhs[dimX*dimZ*(layerP[l]+1) + i*dimZ + j] = powerM[i][j][l];
+                // printf("%.6f\n", powerM[i][j][l]);
+            }
+
+    // free the space
+    for (int i = 0; i < dimX; i++) {
+        for (int j = 0; j < dimZ; j++) {
+            free(powerM[i][j]);
+        }
+        free(powerM[i]);
+    }
+    free(powerM);
+
+    solve_G(Midx, count, m, rhs, Tamb);
+
+    // extract the Temperature from the solution
+    double *Tt;
+    if (!(Tt = (double *)malloc(m * sizeof(double))))
+        printf("Malloc fails for Tt\n");
+    for (int i = 0; i < m; ++i) {
+        Tt[i] = rhs[i] - T0;
+        // printf("Tt[%d] = %.2f\n", i, Tt[i]);
+    }
+
+    printf("Finish converting the temperature matrix\n");
+    printf("Free the space...\n");
+
+    // free the arrays defined by myself
+    SUPERLU_FREE(layerP);
+    SUPERLU_FREE(rhs);
 
     printf(
         "================= FINISH STEADY TEMPERATURE SOLVER "
@@ -50,6 +50,11 @@ Timing::Timing(const Config& config)
     int activate_to_refresh =
         config.tRC;  // need to precharge before ref, so it's tRC
 
+    // RowClone: FPM restores the source row, activates the destination and
+    // precharges once it is written, PSM moves one column per burst
+    int clone_fpm_to_activate = 2 * config.tRAS + config.tRP;
+    int clone_psm_to_column = std::max(config.burst_cycle, config.tCCD_L);
+
     // TODO: deal with different refresh rate
     int refresh_to_refresh =
         config.tREFI;  // refresh intervals (per rank level)
@@ -262,6 +267,62 @@ Timing::Timing(const Config& config)
             {CommandType::REFRESH, self_refresh_exit},
             {CommandType::REFRESH_BANK, self_refresh_exit},
             {CommandType::SREF_ENTER, self_refresh_exit}};
+
+    // all-bank PIM commands constrain every bank of the rank like their
+    // single bank counterparts (ACTIVATE, READ, WRITE) do in the same bank,
+    // PIM_COMPUTE does not drive the data bus so it has no turnaround
+    same_rank[static_cast<int>(CommandType::PIM_ACTIVATE)] =
+        std::vector<std::pair<CommandType, int> >{
+            {CommandType::ACTIVATE, activate_to_activate},
+            {CommandType::READ, activate_to_read},
+            {CommandType::WRITE, activate_to_write},
+            {CommandType::READ_PRECHARGE, activate_to_read},
+            {CommandType::WRITE_PRECHARGE, activate_to_write},
+            {CommandType::PRECHARGE, activate_to_precharge},
+            {CommandType::REFRESH_BANK, activate_to_refresh}};
+
+    same_rank[static_cast<int>(CommandType::PIM_COMPUTE)] =
+        std::vector<std::pair<CommandType, int> >{
+            {CommandType::READ, read_to_read_l},
+            {CommandType::WRITE, read_to_read_l},
+            {CommandType::READ_PRECHARGE, read_to_read_l},
+            {CommandType::WRITE_PRECHARGE, read_to_read_l},
+            {CommandType::PRECHARGE, read_to_precharge}};
+
+    same_rank[static_cast<int>(CommandType::PIM_WRITEBACK)] =
+        std::vector<std::pair<CommandType, int> >{
+            {CommandType::READ, write_to_read_l},
+            {CommandType::WRITE, write_to_write_l},
+            {CommandType::READ_PRECHARGE, write_to_read_l},
+            {CommandType::WRITE_PRECHARGE, write_to_write_l},
+            {CommandType::PRECHARGE, write_to_precharge}};
+
+    // command CLONE_FPM, leaves the bank precharged
+    same_bank[static_cast<int>(CommandType::CLONE_FPM)] =
+        std::vector<std::pair<CommandType, int> >{
+            {CommandType::ACTIVATE, clone_fpm_to_activate},
+            {CommandType::REFRESH, clone_fpm_to_activate},
+            {CommandType::REFRESH_BANK, clone_fpm_to_activate},
+            {CommandType::SREF_ENTER, clone_fpm_to_activate}};
+    other_banks_same_bankgroup[static_cast<int>(CommandType::CLONE_FPM)] =
+        std::vector<std::pair<CommandType, int> >{
+            {CommandType::ACTIVATE, activate_to_activate_l},
+            {CommandType::REFRESH_BANK, clone_fpm_to_activate}};
+    other_bankgroups_same_rank[static_cast<int>(CommandType::CLONE_FPM)] =
+        std::vector<std::pair<CommandType, int> >{
+            {CommandType::ACTIVATE, activate_to_activate_s},
+            {CommandType::REFRESH_BANK, clone_fpm_to_activate}};
+
+    // command CLONE_PSM, same bank applies to the source and the destination
+    same_rank[static_cast<int>(CommandType::CLONE_PSM)] =
+        std::vector<std::pair<CommandType, int> >{
+            {CommandType::READ, clone_psm_to_column},
+            {CommandType::WRITE, clone_psm_to_column},
+            {CommandType::READ_PRECHARGE, clone_psm_to_column},
+            {CommandType::WRITE_PRECHARGE, clone_psm_to_column}};
+    same_bank[static_cast<int>(CommandType::CLONE_PSM)] =
+        std::vector<std::pair<CommandType, int> >{
+            {CommandType::PRECHARGE, write_to_precharge}};
 }
 
 }  // namespace dramsim3
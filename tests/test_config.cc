@@ -93,3 +93,19 @@ TEST_CASE("Address Mapping", "[config]") {
     }
 }
 
+
+TEST_CASE("Output prefix", "[config]") {
+    SECTION("Live instances get distinct output prefixes") {
+        auto config_a = new dramsim3::Config("configs/HBM1_4Gb_x128.ini", ".");
+        dramsim3::Config config_b("configs/HBM1_4Gb_x128.ini", ".");
+        REQUIRE(config_a->output_prefix != config_b.output_prefix);
+        REQUIRE(config_b.output_prefix == config_a->output_prefix + "_1");
+        REQUIRE(config_b.json_stats_name == config_b.output_prefix + ".json");
+
+        // prefix is free again once its owner is gone
+        std::string prefix_a = config_a->output_prefix;
+        delete config_a;
+        dramsim3::Config config_c("configs/HBM1_4Gb_x128.ini", ".");
+        REQUIRE(config_c.output_prefix == prefix_a);
+    }
+}
@@ -0,0 +1,102 @@
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <random>
+#include <vector>
+#include "catch.hpp"
+#include "cosim.h"
+
+namespace {
+// CPU side, runs in the forked child, returns the exit status
+int RunClient(const std::string& shm_name, uint64_t num_reqs) {
+    dramsim3::CosimClient client;
+    if (!client.Connect(shm_name)) {
+        return 1;
+    }
+    std::mt19937_64 gen(3);
+    std::vector<int> num_done(num_reqs, 0);
+    std::vector<uint64_t> addrs(num_reqs);
+    uint64_t tag = 0, clk = 0, total_done = 0;
+    int status = 0;
+    while (status == 0 && total_done < num_reqs && clk < 200000) {
+        if (tag < num_reqs) {
+            dramsim3::CosimRequest req;
+            req.tag = tag;
+            req.addr = gen() & 0xffffffc0;
+            req.is_write = tag % 3 == 0;
+            req.source_id = 1;
+            req.priority = 0;
+            req.reserved = 0;
+            if (client.SendRequest(req)) {
+                addrs[tag++] = req.addr;
+            }
+        }
+        if (!client.RunUntil(++clk)) {
+            status = 4;
+            break;
+        }
+        dramsim3::CosimCompletion completion;
+        while (client.ReceiveCompletion(completion)) {
+            if (completion.tag >= num_reqs ||
+                completion.addr != addrs[completion.tag] ||
+                completion.is_write != (completion.tag % 3 == 0) ||
+                completion.source_id != 1) {
+                status = 2;
+                break;
+            }
+            num_done[completion.tag]++;
+            total_done++;
+        }
+    }
+    // always let the server go, a failing client must not hang the test
+    client.Shutdown();
+    for (auto done : num_done) {
+        if (status == 0 && done != 1) {
+            status = 3;
+        }
+    }
+    return status;
+}
+}  // namespace
+
+TEST_CASE("Shared memory co-simulation", "[dramsim3][cosim]") {
+    std::string shm_name = "/dramsim3_test_" + std::to_string(getpid());
+    dramsim3::MemorySystem memory("configs/DDR4_8Gb_x8_2400.ini", ".",
+                                  [](uint64_t) {}, [](uint64_t) {});
+    // small rings so that both rings wrap around and fill up
+    dramsim3::CosimServer server(memory, shm_name, 16);
+
+    std::cout.flush();
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+        _exit(RunClient(shm_name, 2000));
+    }
+    server.Serve();
+    int status = -1;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    REQUIRE(server.Cycle() > 0);
+}
+
+TEST_CASE("Co-simulation with a dead server", "[dramsim3][cosim]") {
+    std::string shm_name = "/dramsim3_dead_" + std::to_string(getpid());
+    std::cout.flush();
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+        // leaves the region behind, as a crashed server would
+        dramsim3::MemorySystem memory("configs/DDR4_8Gb_x8_2400.ini", ".",
+                                      [](uint64_t) {}, [](uint64_t) {});
+        new dramsim3::CosimServer(memory, shm_name, 16);
+        _exit(0);
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    dramsim3::CosimClient client;
+    REQUIRE(client.Connect(shm_name));
+    REQUIRE(!client.RunUntil(10));
+    shm_unlink(shm_name.c_str());
+}
@@ -1,6 +1,16 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <vector>
 #include "catch.hpp"
+#include "json.hpp"
 #include "configuration.h"
 #include "dram_system.h"
+#include "memory_system.h"
+#include "test_util.h"
 
 bool call_back_called = false;
 void dummy_call_back(uint64_t addr) {
@@ -30,3 +40,518 @@ TEST_CASE("Jedec DRAMSystem Testing", "[dramsim3]") {
         REQUIRE(clk == tRC);
     }
 }
+
+// random traffic, logs the cycle and address of every completed request
+void RunRandomTraffic(dramsim3::MemorySystem& memory, std::mt19937_64& gen,
+                      uint64_t& clk, uint64_t cycles) {
+    for (uint64_t end = clk + cycles; clk < end; clk++) {
+        memory.ClockTick();
+        uint64_t addr = gen() & 0xffffffc0;
+        bool is_write = gen() % 3 == 0;
+        if (memory.WillAcceptTransaction(addr, is_write)) {
+            memory.AddTransaction(addr, is_write);
+        }
+    }
+}
+
+TEST_CASE("Checkpoint and restore", "[dramsim3][checkpoint]") {
+    std::vector<std::string> configs = {"configs/DDR4_8Gb_x8_2400.ini",
+                                        "configs/HMC_2GB_4Lx16.ini"};
+    for (const auto& config_file : configs) {
+        std::vector<std::pair<uint64_t, uint64_t> > orig_log, restored_log;
+        uint64_t clk = 0;
+        auto orig_cb = [&orig_log, &clk](uint64_t addr) {
+            orig_log.emplace_back(clk, addr);
+        };
+        auto restored_cb = [&restored_log, &clk](uint64_t addr) {
+            restored_log.emplace_back(clk, addr);
+        };
+        std::mt19937_64 gen(42);
+        dramsim3::MemorySystem orig(config_file, ".", orig_cb, orig_cb);
+        RunRandomTraffic(orig, gen, clk, 20000);
+        REQUIRE(orig.SaveCheckpoint("test_checkpoint.bin"));
+
+        std::mt19937_64 restored_gen = gen;
+        uint64_t ckpt_clk = clk;
+        orig_log.clear();
+        RunRandomTraffic(orig, gen, clk, 20000);
+
+        dramsim3::MemorySystem restored(config_file, ".", restored_cb,
+                                        restored_cb);
+        REQUIRE(restored.LoadCheckpoint("test_checkpoint.bin"));
+        clk = ckpt_clk;
+        RunRandomTraffic(restored, restored_gen, clk, 20000);
+
+        REQUIRE(!orig_log.empty());
+        REQUIRE(orig_log == restored_log);
+        std::remove("test_checkpoint.bin");
+    }
+
+    SECTION("Reject checkpoint of a different organization") {
+        dramsim3::MemorySystem ddr4("configs/DDR4_8Gb_x8_2400.ini", ".",
+                                    dummy_call_back, dummy_call_back);
+        dramsim3::MemorySystem hbm("configs/HBM1_4Gb_x128.ini", ".",
+                                   dummy_call_back, dummy_call_back);
+        REQUIRE(ddr4.SaveCheckpoint("test_checkpoint.bin"));
+        REQUIRE(!hbm.LoadCheckpoint("test_checkpoint.bin"));
+        std::remove("test_checkpoint.bin");
+    }
+
+    SECTION("Reject a truncated checkpoint") {
+        dramsim3::MemorySystem orig("configs/DDR4_8Gb_x8_2400.ini", ".",
+                                    dummy_call_back, dummy_call_back);
+        REQUIRE(orig.SaveCheckpoint("test_checkpoint.bin"));
+        std::string data;
+        {
+            std::ifstream in("test_checkpoint.bin", std::ifstream::binary);
+            data.assign(std::istreambuf_iterator<char>(in),
+                        std::istreambuf_iterator<char>());
+        }
+        std::ofstream("test_checkpoint.bin", std::ofstream::binary)
+            << data.substr(0, data.size() / 2);
+        dramsim3::MemorySystem restored("configs/DDR4_8Gb_x8_2400.ini", ".",
+                                        dummy_call_back, dummy_call_back);
+        REQUIRE(!restored.LoadCheckpoint("test_checkpoint.bin"));
+        std::remove("test_checkpoint.bin");
+    }
+}
+
+TEST_CASE("Tagged requests", "[dramsim3][completion]") {
+    call_back_called = false;
+    dramsim3::MemorySystem memory("configs/DDR4_8Gb_x8_2400.ini", ".",
+                                  dummy_call_back, dummy_call_back);
+    std::mt19937_64 gen(7);
+    const uint64_t num_reqs = 500;
+    std::vector<bool> is_write(num_reqs);
+    std::vector<int> num_done(num_reqs, 0);
+    auto check = [&](const dramsim3::Completion& completion) {
+        REQUIRE(completion.tag < num_reqs);
+        REQUIRE(completion.source_id == static_cast<int>(completion.tag % 4));
+        REQUIRE(completion.is_write == is_write[completion.tag]);
+        num_done[completion.tag]++;
+    };
+
+    auto run = [&](bool drain, bool as_transaction) {
+        std::vector<dramsim3::Completion> completions;
+        uint64_t tag = 0;
+        for (int clk = 0; clk < 100000; clk++) {
+            memory.ClockTick();
+            if (drain) {
+                memory.DrainCompletions(completions);
+                for (const auto& completion : completions) {
+                    check(completion);
+                }
+            }
+            uint64_t addr = gen() & 0xffffffc0;
+            if (tag < num_reqs) {
+                is_write[tag] = gen() % 3 == 0;
+                dramsim3::RequestMeta meta(tag % 4, tag % 2);
+                dramsim3::Transaction trans(addr, is_write[tag], tag, meta);
+                if (as_transaction && memory.WillAcceptTransaction(trans)) {
+                    REQUIRE(memory.AddTransaction(trans));
+                    tag++;
+                } else if (!as_transaction &&
+                           memory.WillAcceptTransaction(addr, is_write[tag])) {
+                    memory.AddTransaction(addr, is_write[tag], tag, meta);
+                    tag++;
+                }
+            }
+        }
+        REQUIRE(tag == num_reqs);
+    };
+
+    SECTION("Drained in batches") {
+        run(true, false);
+        for (auto done : num_done) {
+            REQUIRE(done == 1);
+        }
+    }
+
+    SECTION("Delivered to the completion callback") {
+        memory.RegisterCompletionCallback(check);
+        run(false, false);
+        for (auto done : num_done) {
+            REQUIRE(done == 1);
+        }
+        std::vector<dramsim3::Completion> completions;
+        memory.DrainCompletions(completions);
+        REQUIRE(completions.empty());
+    }
+
+    SECTION("Added as trace transactions") {
+        run(true, true);
+        for (auto done : num_done) {
+            REQUIRE(done == 1);
+        }
+    }
+
+    // untagged callbacks are not used for tagged requests
+    REQUIRE(!call_back_called);
+}
+
+TEST_CASE("Analytic backends", "[dramsim3][analytic]") {
+    dramsim3::Config config("configs/DDR4_8Gb_x8_2400.ini", ".");
+    uint64_t clk = 0;
+    std::vector<std::pair<uint64_t, uint64_t> > done;
+    auto cb = [&done, &clk](uint64_t addr) { done.emplace_back(clk, addr); };
+    dramsim3::IdealDRAMSystem ideal(config, ".", cb, cb);
+    dramsim3::BandwidthDRAMSystem bandwidth(config, ".", cb, cb);
+    dramsim3::QueueingDRAMSystem queueing(config, ".", cb, cb);
+    std::vector<dramsim3::BaseDRAMSystem*> systems = {&ideal, &bandwidth,
+                                                       &queueing};
+    const size_t num_reqs = 1000;
+    for (auto sys : systems) {
+        done.clear();
+        std::vector<uint64_t> sent;
+        std::mt19937_64 gen(3);
+        for (clk = 0; clk < 50000; clk++) {
+            sys->ClockTick();
+            uint64_t addr = gen() & 0xffffffc0;
+            if (sent.size() < num_reqs &&
+                sys->WillAcceptTransaction(addr, false)) {
+                sys->AddTransaction(addr, false);
+                sent.push_back(addr);
+            }
+        }
+        // single channel, so everything completes in order
+        REQUIRE(sent.size() == num_reqs);
+        REQUIRE(done.size() == num_reqs);
+        for (size_t i = 0; i < num_reqs; i++) {
+            REQUIRE(done[i].second == sent[i]);
+        }
+        if (sys == &bandwidth) {
+            // one burst per request on the data bus
+            REQUIRE(done.back().first >= num_reqs * config.burst_cycle);
+        }
+    }
+}
+
+TEST_CASE("Analytic bandwidth of sized requests", "[dramsim3][analytic]") {
+    dramsim3::Config config("configs/DDR4_8Gb_x8_2400.ini", ".");
+    auto callback = [](uint64_t addr) {};
+    dramsim3::BandwidthDRAMSystem dramsys(config, ".", callback, callback);
+    dramsim3::Transaction read(0x0, false);
+    read.size = 4 * config.request_size_bytes;
+    dramsys.AddTransaction(read);
+    const int cycles = 1000;
+    for (int clk = 0; clk < cycles; clk++) {
+        dramsys.ClockTick();
+    }
+
+    dramsys.PrintStats();
+    nlohmann::json stats = ReadStats(config);
+    REQUIRE(stats["0"]["num_reads_done"] == 1);
+    // all four bursts count towards the bandwidth
+    REQUIRE(stats["0"]["average_bandwidth"].get<double>() ==
+            Approx(4.0 * config.request_size_bytes / (cycles * config.tCK)));
+}
+
+TEST_CASE("Hybrid fidelity", "[dramsim3][analytic]") {
+    DerivedConfig ini("configs/DDR4_8Gb_x8_2400.ini",
+                      "[system]\nfast_backend = BANDWIDTH\n"
+                      "fidelity_switch_cycles = 30000\n");
+    dramsim3::MemorySystem memory(ini.file(), ".", dummy_call_back,
+                                  dummy_call_back);
+    std::mt19937_64 gen(11);
+    std::vector<int> num_done;
+    std::vector<dramsim3::Completion> completions;
+    auto run = [&](uint64_t cycles, bool issue) {
+        for (uint64_t i = 0; i < cycles; i++) {
+            memory.ClockTick();
+            memory.DrainCompletions(completions);
+            for (const auto& completion : completions) {
+                num_done[completion.tag]++;
+            }
+            uint64_t addr = gen() & 0xffffffc0;
+            bool is_write = gen() % 3 == 0;
+            if (issue && memory.WillAcceptTransaction(addr, is_write)) {
+                memory.AddTransaction(addr, is_write, num_done.size());
+                num_done.push_back(0);
+            }
+        }
+    };
+
+    REQUIRE(!memory.IsDetailed());
+    run(10000, true);
+    memory.SetDetailed(true);
+    run(10000, true);
+    memory.SetDetailed(false);
+    run(5000, true);
+    // the configured switch at cycle 30000 goes back to detailed
+    run(10000, true);
+    REQUIRE(memory.IsDetailed());
+    run(10000, false);
+
+    // requests in flight at each switch finish where they were issued
+    REQUIRE(!num_done.empty());
+    for (auto done : num_done) {
+        REQUIRE(done == 1);
+    }
+}
+
+TEST_CASE("CiM operations", "[dramsim3][cim]") {
+    DerivedConfig ini("configs/DDR4_8Gb_x8_2400.ini",
+                      "[cim]\nops = CIM_MAC\nCIM_MAC.operands = 3\n"
+                      "CIM_MAC.reads = 0, 1, 2\nCIM_MAC.writes = 2\n"
+                      "CIM_MAC.latency = 40\nCIM_MAC.placement = VAULT\n");
+    dramsim3::Config config(ini.file(), ".");
+    REQUIRE(config.cim_ops.back().name == "CIM_MAC");
+
+    std::istringstream trace(
+        "40 CIM_MAC 80 c0 12\n"
+        "100 READ 13\n"
+        "1000 CIM_MAC.V 2000 3000 16 128 14\n");
+    dramsim3::Transaction trans, read, vec;
+    trace >> trans >> read >> vec;
+    REQUIRE(trans.cim_op == dramsim3::CiMOpId("CIM_MAC"));
+    REQUIRE(trans.addr2 == 0x80);
+    REQUIRE(trans.addr3 == 0xc0);
+    REQUIRE(trans.added_cycle == 12);
+    REQUIRE(read.cim_op == 0);
+    REQUIRE(read.is_read);
+    REQUIRE(vec.cim_op == trans.cim_op);
+    REQUIRE(vec.addr3 == 0x3000);
+    REQUIRE(vec.cim_count == 16);
+    REQUIRE(vec.cim_stride == 128);
+    REQUIRE(vec.added_cycle == 14);
+
+    dramsim3::JedecDRAMSystem dramsys(config, ".", dummy_call_back,
+                                      dummy_call_back);
+    REQUIRE(dramsys.WillAcceptTransaction(trans));
+    dramsys.AddTransaction(trans);
+    REQUIRE(dramsys.WillAcceptTransaction(vec));
+    dramsys.AddTransaction(vec);
+    for (int clk = 0; clk < 1000; clk++) {
+        dramsys.ClockTick();
+    }
+    dramsys.PrintStats();
+    nlohmann::json stats = ReadStats(config);
+    // reads, compute, then the write back of the result
+    REQUIRE(stats["0"]["num_cim_mac_done"] == 17);
+    REQUIRE(stats["0"]["num_cim_add_done"] == 0);
+    REQUIRE(stats["0"]["cim_bytes_saved"] ==
+            17 * 4 * config.request_size_bytes);
+    REQUIRE(stats["0"]["cim_compute_latency"]["40"] == 17);
+}
+
+TEST_CASE("All-bank PIM operations", "[dramsim3][pim]") {
+    dramsim3::Config config("configs/HBM1_4Gb_x128.ini", ".");
+    std::istringstream trace("0 PIM_MAC 8 10\n400000 PIM_ADD 4 20\n");
+    dramsim3::Transaction mac, add;
+    trace >> mac >> add;
+    REQUIRE(mac.pim_op == dramsim3::PIMOp::MAC);
+    REQUIRE(mac.cim_count == 8);
+    REQUIRE(add.pim_op == dramsim3::PIMOp::ADD);
+    REQUIRE(add.added_cycle == 20);
+
+    int clk = 0;
+    std::vector<int> done;
+    auto cb = [&done, &clk](uint64_t addr) { done.push_back(clk); };
+    dramsim3::JedecDRAMSystem dramsys(config, ".", cb, cb);
+    REQUIRE(dramsys.WillAcceptTransaction(mac));
+    dramsys.AddTransaction(mac);
+    REQUIRE(dramsys.WillAcceptTransaction(add));
+    dramsys.AddTransaction(add);
+    for (; clk < 2000; clk++) {
+        dramsys.ClockTick();
+    }
+    REQUIRE(done.size() == 2);
+    // one activation, then the columns back to back in every bank
+    int min_mac = config.tRCDRD + 8 * std::max(config.burst_cycle,
+                                               config.tCCD_L);
+    REQUIRE(done[0] >= min_mac);
+    REQUIRE(done[1] > done[0]);
+
+    dramsys.PrintStats();
+    nlohmann::json stats = ReadStats(config);
+    REQUIRE(stats["0"]["num_pim_ops_done"] == 2);
+    REQUIRE(stats["0"]["num_pim_act_cmds"] == 2);
+    REQUIRE(stats["0"]["num_pim_compute_cmds"] == 12);
+    REQUIRE(stats["0"]["num_pim_wb_cmds"] == 1 + 4);
+    // the second row is opened after closing every bank
+    REQUIRE(stats["0"]["num_pre_cmds"] ==
+            config.banks * (1 + stats["0"]["num_ref_cmds"].get<int>()));
+    REQUIRE(stats["0"]["num_read_cmds"] == 0);
+}
+
+TEST_CASE("RowClone bulk copy and initialization", "[dramsim3][rowclone]") {
+    dramsim3::Config config("configs/HBM1_4Gb_x128.ini", ".");
+    auto addr = [&config](int bankgroup, int bank, int row) {
+        return config.ReverseAddressMapping(
+            dramsim3::Address(0, 0, bankgroup, bank, row, 0));
+    };
+    // init, copy within a subarray, copy to another bank, copy within a
+    // bank across subarrays
+    std::ostringstream lines;
+    lines << std::hex << addr(0, 0, 5) << " ROW_INIT " << std::dec << 0
+          << "\n"
+          << std::hex << addr(1, 0, 6) << " ROW_COPY " << addr(1, 0, 5)
+          << std::dec << " 0\n"
+          << std::hex << addr(2, 1, 7) << " ROW_COPY " << addr(3, 2, 7)
+          << std::dec << " 0\n"
+          << std::hex << addr(0, 3, 1 + config.subarray_rows) << " ROW_COPY "
+          << addr(0, 3, 1) << std::dec << " 0\n";
+    std::istringstream trace(lines.str());
+    dramsim3::Transaction ops[4];
+    for (auto &op : ops) {
+        trace >> op;
+        REQUIRE_FALSE(op.is_read);
+        REQUIRE_FALSE(op.is_write);
+    }
+    REQUIRE(ops[0].clone_op == dramsim3::RowCloneOp::INIT);
+    REQUIRE(ops[1].clone_op == dramsim3::RowCloneOp::COPY);
+    REQUIRE(ops[1].addr2 == addr(1, 0, 5));
+
+    int clk = 0;
+    std::vector<int> done;
+    auto cb = [&done, &clk](uint64_t addr) { done.push_back(clk); };
+    dramsim3::JedecDRAMSystem dramsys(config, ".", cb, cb);
+    for (auto &op : ops) {
+        REQUIRE(dramsys.WillAcceptTransaction(op));
+        dramsys.AddTransaction(op);
+    }
+    for (; clk < 4000; clk++) {
+        dramsys.ClockTick();
+    }
+    REQUIRE(done.size() == 4);
+
+    dramsys.PrintStats();
+    nlohmann::json stats = ReadStats(config);
+    int columns = config.co_mask + 1;
+    REQUIRE(stats["0"]["num_row_inits_done"] == 1);
+    REQUIRE(stats["0"]["num_row_copies_done"] == 3);
+    REQUIRE(stats["0"]["num_clone_fpm_cmds"] == 2);
+    // the copy within a bank goes through another bank and back
+    REQUIRE(stats["0"]["num_clone_psm_cmds"] == 3 * columns);
+    REQUIRE(stats["0"]["clone_bytes_saved"] ==
+            7 * columns * config.request_size_bytes);
+    REQUIRE(stats["0"]["num_read_cmds"] == 0);
+    REQUIRE(stats["0"]["num_write_cmds"] == 0);
+}
+
+TEST_CASE("RowClone operations of a rank complete in order",
+          "[dramsim3][rowclone]") {
+    dramsim3::Config config("configs/HBM1_4Gb_x128.ini", ".");
+    auto addr = [&config](int bankgroup, int bank, int row) {
+        return config.ReverseAddressMapping(
+            dramsim3::Address(0, 0, bankgroup, bank, row, 0));
+    };
+    // two inits in different banks, the first one waits for the row a read
+    // opens in its bank to close
+    std::ostringstream lines;
+    lines << std::hex << addr(0, 0, 5) << " ROW_INIT " << std::dec << 0
+          << "\n"
+          << std::hex << addr(3, 3, 9) << " ROW_INIT " << std::dec << 0
+          << "\n";
+    std::istringstream trace(lines.str());
+    dramsim3::Transaction ops[2];
+    for (auto &op : ops) {
+        trace >> op;
+    }
+
+    std::vector<uint64_t> done;
+    auto cb = [&done](uint64_t addr) { done.push_back(addr); };
+    dramsim3::JedecDRAMSystem dramsys(config, ".", cb, cb);
+    uint64_t read_addr = addr(0, 0, 1);
+    dramsys.AddTransaction(read_addr, false);
+    for (int clk = 0; clk < 4; clk++) {
+        dramsys.ClockTick();
+    }
+    for (auto &op : ops) {
+        REQUIRE(dramsys.WillAcceptTransaction(op));
+        dramsys.AddTransaction(op);
+    }
+    for (int clk = 0; clk < 4000; clk++) {
+        dramsys.ClockTick();
+    }
+    RemoveStats(config);
+    REQUIRE(done.size() == 3);
+    done.erase(std::find(done.begin(), done.end(), read_addr));
+    REQUIRE(done[0] == ops[0].addr);
+    REQUIRE(done[1] == ops[1].addr);
+}
+
+TEST_CASE("Sized requests", "[dramsim3][size]") {
+    dramsim3::Config config("configs/DDR4_8Gb_x8_2400.ini", ".");
+    int burst = config.request_size_bytes;
+    std::ostringstream lines;
+    lines << "0x0 READ 0 " << 4 * burst << "\n"
+          << "0x100000 WRITE 0 " << burst / 2 << "\n"
+          << "0x200000 READ 0\n";
+    std::istringstream trace(lines.str());
+    dramsim3::Transaction read, write, plain;
+    trace >> read >> write >> plain;
+    REQUIRE(read.size == 4 * burst);
+    REQUIRE(write.is_write);
+    REQUIRE(write.size == burst / 2);
+    REQUIRE(plain.size == 0);
+
+    int reads = 0, writes = 0;
+    auto read_cb = [&reads](uint64_t addr) { reads++; };
+    auto write_cb = [&writes](uint64_t addr) { writes++; };
+    dramsim3::JedecDRAMSystem dramsys(config, ".", read_cb, write_cb);
+    for (auto *trans : {&read, &write}) {
+        REQUIRE(dramsys.WillAcceptTransaction(*trans));
+        dramsys.AddTransaction(*trans);
+    }
+    for (int clk = 0; clk < 1000; clk++) {
+        dramsys.ClockTick();
+    }
+    // one callback per request
+    REQUIRE(reads == 1);
+    REQUIRE(writes == 1);
+
+    dramsys.PrintStats();
+    nlohmann::json stats = ReadStats(config);
+    // the bursts of the read share one activation
+    REQUIRE(stats["0"]["num_read_cmds"] == 4);
+    REQUIRE(stats["0"]["num_read_row_hits"] == 3);
+    REQUIRE(stats["0"]["num_reads_done"] == 4);
+    REQUIRE(stats["0"]["num_split_requests"] == 1);
+    REQUIRE(stats["0"]["num_masked_writes"] == 1);
+}
+
+TEST_CASE("Sized requests past the end of a row", "[dramsim3][size]") {
+    dramsim3::Config config("configs/DDR4_8Gb_x8_2400.ini", ".");
+    // the second burst of a read from the last column of a row is in the
+    // next bank group
+    dramsim3::Address last = config.AddressMapping(0x300000);
+    last.column = config.co_mask;
+    dramsim3::Transaction read(config.ReverseAddressMapping(last), false);
+    read.size = 2 * config.request_size_bytes;
+    int reads = 0;
+    auto read_cb = [&reads](uint64_t addr) { reads++; };
+    dramsim3::JedecDRAMSystem dramsys(config, ".", read_cb, read_cb);
+    REQUIRE(dramsys.WillAcceptTransaction(read));
+    dramsys.AddTransaction(read);
+    for (int clk = 0; clk < 1000; clk++) {
+        dramsys.ClockTick();
+    }
+    REQUIRE(reads == 1);
+
+    dramsys.PrintStats();
+    nlohmann::json stats = ReadStats(config);
+    REQUIRE(stats["0"]["num_reads_done"] == 2);
+    REQUIRE(stats["0"]["num_act_cmds"] == 2);
+    REQUIRE(stats["0"]["num_read_row_hits"] == 0);
+}
+
+TEST_CASE("Sized requests use every free queue slot", "[dramsim3][size]") {
+    dramsim3::Config config("configs/DDR4_8Gb_x8_2400.ini", ".");
+    auto callback = [](uint64_t addr) {};
+    dramsim3::JedecDRAMSystem dramsys(config, ".", callback, callback);
+    dramsim3::Transaction read(0x0, false), write(0x100000, true);
+    read.size = 2 * config.request_size_bytes;
+    write.size = 2 * config.request_size_bytes;
+    uint64_t addr = 0x200000;
+    for (int i = 0; i < config.trans_queue_size - 2; i++, addr += 0x40) {
+        dramsys.AddTransaction(addr, false);
+    }
+    // the last two read slots take a two-burst read
+    REQUIRE(dramsys.WillAcceptTransaction(read));
+    dramsys.AddTransaction(read);
+    REQUIRE_FALSE(dramsys.WillAcceptTransaction(addr, false));
+    // a full read queue does not hold back writes
+    REQUIRE(dramsys.WillAcceptTransaction(addr, true));
+    REQUIRE(dramsys.WillAcceptTransaction(write));
+}
@@ -1,6 +1,12 @@
+#include <fstream>
+#include <iterator>
+#include <map>
 #include "catch.hpp"
+#include "json.hpp"
 #include "configuration.h"
+#include "hmc.h"
 #include "memory_system.h"
+#include "test_util.h"
 
 bool hmc_called = false;
 
@@ -29,13 +35,276 @@ TEST_CASE("HMC System Testing", "[dramsim3][hmc]") {
 
         // For HMC things are complicated, e.g. for a 64B read request and x2 bandwidth xbar
         // takes 1 cycle from CPU to Link
+        // takes 1 cycle to serialize the 1 flit request on the link
         // takes 1 cycle from Link to Quad
         // takes 1 cycle from Quad to DRAM
         // takes xx cycles for DRAM to finish
         // takes 1 cycle from DRAM to quad
         // takes multiple cycles from quad to CPU
         // (depending on packet size, and contention)
-        int idle_lat = 52;
+        int idle_lat = 53;
         REQUIRE(clk == idle_lat);
     }
 }
+
+// idle latency of one read, in DRAM cycles
+static int ChainedReadLatency(const std::string &topology, int cube) {
+    DerivedConfig ini("configs/HMC_2GB_4Lx16.ini",
+                      "[hmc]\nnum_cubes = 4\nchain_topology = " + topology +
+                          "\n");
+    dramsim3::Config config(ini.file(), ".");
+    bool done = false;
+    auto cb = [&done](uint64_t addr) { done = true; };
+    dramsim3::HMCMemorySystem hmc(config, ".", cb, cb);
+    uint64_t addr = static_cast<uint64_t>(cube)
+                    << (config.shift_bits + config.cube_pos);
+    hmc.AddTransaction(addr, false);
+    int clk = 0;
+    for (; !done && clk < 1000; clk++) {
+        hmc.ClockTick();
+    }
+    return clk;
+}
+
+TEST_CASE("HMC cube chaining", "[dramsim3][hmc]") {
+    int first = ChainedReadLatency("DAISY", 0);
+    REQUIRE(first < 1000);
+    // every pass-through cube adds latency both ways
+    REQUIRE(ChainedReadLatency("DAISY", 1) > first);
+    REQUIRE(ChainedReadLatency("DAISY", 3) > ChainedReadLatency("DAISY", 1));
+    // a star reaches every cube in one hop
+    REQUIRE(ChainedReadLatency("STAR", 3) == ChainedReadLatency("DAISY", 1));
+}
+
+TEST_CASE("HMC link retries and stats", "[dramsim3][hmc]") {
+    DerivedConfig ini("configs/HMC_2GB_4Lx16.ini",
+                      "[hmc]\nlink_error_rate = 0.5\n");
+    dramsim3::Config config(ini.file(), ".");
+    int done = 0;
+    auto cb = [&done](uint64_t addr) { done++; };
+    dramsim3::HMCMemorySystem hmc(config, ".", cb, cb);
+    int sent = 0;
+    for (int clk = 0; clk < 5000; clk++) {
+        if (sent < 64 && hmc.WillAcceptTransaction(sent * 64, false)) {
+            hmc.AddTransaction(sent * 64, false);
+            sent++;
+        }
+        hmc.ClockTick();
+    }
+    REQUIRE(done == 64);
+
+    hmc.PrintStats();
+    nlohmann::json stats = ReadStats(config, "hmc_links.json");
+    int packets = 0, retries = 0;
+    for (auto &link : stats) {
+        packets += link["req_packets"].get<int>();
+        retries += link["req_retries"].get<int>() +
+                   link["resp_retries"].get<int>();
+        REQUIRE(link["req_utilization"].get<double>() > 0.0);
+    }
+    REQUIRE(packets == 64);
+    REQUIRE(retries > 0);
+}
+
+TEST_CASE("HMC refused requests", "[dramsim3][hmc]") {
+    // tokens for one 256 byte write per link, without a tick none come back
+    DerivedConfig ini("configs/HMC_2GB_4Lx16.ini",
+                      "[hmc]\nlink_tokens = 17\n");
+    dramsim3::Config config(ini.file(), ".");
+    auto cb = [](uint64_t addr) {};
+    dramsim3::HMCMemorySystem hmc(config, ".", cb, cb);
+    dramsim3::Transaction write(0, true);
+    write.size = 256;
+    for (int i = 0; i < config.num_links; i++) {
+        REQUIRE(hmc.AddTransaction(write));
+    }
+    for (int i = 0; i < 3; i++) {
+        REQUIRE(!hmc.AddTransaction(write));
+    }
+
+    hmc.PrintStats();
+    nlohmann::json stats = ReadStats(config, "hmc_links.json");
+    // counted once per refused request
+    int stalls = 0;
+    for (auto &link : stats) {
+        stalls += link["stall_no_tokens"].get<int>() +
+                  link["stall_buffer_full"].get<int>();
+    }
+    REQUIRE(stalls == 3);
+}
+
+TEST_CASE("HMC responses wait for their flits", "[dramsim3][hmc]") {
+    // a one bit wide link takes many cycles per flit, every response is
+    // still on the link when it first reaches the head of the link queue
+    DerivedConfig ini("configs/HMC_2GB_4Lx16.ini", "",
+                      {{"link_width = 16", "link_width = 1"}});
+    dramsim3::Config config(ini.file(), ".");
+    std::map<uint64_t, int> calls;
+    auto cb = [&calls](uint64_t addr) { calls[addr]++; };
+    dramsim3::HMCMemorySystem hmc(config, ".", cb, cb);
+    int sent = 0;
+    for (int clk = 0; clk < 20000; clk++) {
+        uint64_t addr = sent * 4096;
+        if (sent < 16 && hmc.WillAcceptTransaction(addr, sent % 2 == 1)) {
+            hmc.AddTransaction(addr, sent % 2 == 1);
+            sent++;
+        }
+        hmc.ClockTick();
+    }
+    REQUIRE(sent == 16);
+    REQUIRE(calls.size() == 16);
+    for (const auto &call : calls) {
+        REQUIRE(call.second == 1);
+    }
+    REQUIRE(hmc.IsIdle());
+}
+
+TEST_CASE("HMC atomics", "[dramsim3][hmc]") {
+    dramsim3::Config config("configs/HMC_2GB_4Lx16.ini", ".");
+    int done = 0;
+    auto cb = [&done](uint64_t addr) { done++; };
+    dramsim3::HMCMemorySystem hmc(config, ".", cb, cb);
+    // counters on one address run one after the other, posted ones on
+    // another address get no response
+    std::vector<dramsim3::Transaction> ops;
+    for (int i = 0; i < 4; i++) {
+        ops.emplace_back(0x100, false);
+        ops.back().atomic_op = dramsim3::AtomicOp::INC8;
+        ops.emplace_back(0x200, false);
+        ops.back().atomic_op = dramsim3::AtomicOp::P_INC8;
+    }
+    ops.emplace_back(0x300, false);
+    ops.back().atomic_op = dramsim3::AtomicOp::CASEQ8;
+    size_t sent = 0;
+    for (int clk = 0; clk < 2000; clk++) {
+        if (sent < ops.size() && hmc.WillAcceptTransaction(ops[sent])) {
+            REQUIRE(hmc.AddTransaction(ops[sent]));
+            sent++;
+        }
+        hmc.ClockTick();
+    }
+    REQUIRE(sent == ops.size());
+    REQUIRE(done == 5);
+    REQUIRE(hmc.IsIdle());
+
+    hmc.PrintStats();
+    nlohmann::json stats = ReadStats(config, "hmc_atomics.json");
+    REQUIRE(stats["returned"].get<int>() == 5);
+    REQUIRE(stats["posted"].get<int>() == 4);
+    REQUIRE(stats["link_flits"].get<int>() <
+            stats["host_rmw_flits"].get<int>());
+    REQUIRE(stats["host_rmw_latency_estimate"].get<double>() >
+            stats["average_latency"].get<double>());
+}
+
+TEST_CASE("HMC atomics hold back their address only", "[dramsim3][hmc]") {
+    dramsim3::Config config("configs/HMC_2GB_4Lx16.ini", ".");
+    std::vector<uint64_t> done;
+    auto cb = [&done](uint64_t addr) { done.push_back(addr); };
+    dramsim3::HMCMemorySystem hmc(config, ".", cb, cb);
+    // the counters after the first wait for the one before them, a read
+    // from another bank of the same vault queued behind them does not
+    uint64_t counter = 0x100;
+    dramsim3::Address other = config.AddressMapping(counter);
+    other.bank = (other.bank + 1) % config.banks_per_group;
+    uint64_t read_addr = config.ReverseAddressMapping(other);
+    std::vector<dramsim3::Transaction> ops(4, {counter, false});
+    for (auto &op : ops) {
+        op.atomic_op = dramsim3::AtomicOp::INC8;
+    }
+    ops.emplace_back(read_addr, false);
+    size_t sent = 0;
+    for (int clk = 0; clk < 2000; clk++) {
+        // the read once the counters wait in the quad
+        if (sent < ops.size() && (sent < 4 || clk >= 8) &&
+            hmc.WillAcceptTransaction(ops[sent])) {
+            REQUIRE(hmc.AddTransaction(ops[sent]));
+            sent++;
+        }
+        hmc.ClockTick();
+    }
+    REQUIRE(done.size() == 5);
+    REQUIRE(done[1] == read_addr);
+}
+
+// addresses and cycles of the callbacks of a random read/write mix
+static std::vector<std::pair<uint64_t, int>> VaultThreadsRun(int threads) {
+    DerivedConfig ini(
+        "configs/HMC_2GB_4Lx16.ini",
+        "[hmc]\nvault_threads = " + std::to_string(threads) + "\n");
+    dramsim3::Config config(ini.file(), ".");
+    std::vector<std::pair<uint64_t, int>> done;
+    int clk = 0;
+    auto cb = [&done, &clk](uint64_t addr) { done.emplace_back(addr, clk); };
+    dramsim3::HMCMemorySystem hmc(config, ".", cb, cb);
+    uint64_t addr = 12345;
+    for (; clk < 3000; clk++) {
+        addr = addr * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t hex_addr = (addr >> 20) & 0x7fffffc0;
+        bool is_write = (addr >> 63) != 0;
+        if (hmc.WillAcceptTransaction(hex_addr, is_write)) {
+            hmc.AddTransaction(hex_addr, is_write);
+        }
+        hmc.ClockTick();
+    }
+    return done;
+}
+
+TEST_CASE("HMC vault threads", "[dramsim3][hmc]") {
+    auto serial = VaultThreadsRun(1);
+    REQUIRE(serial.size() > 100);
+    REQUIRE(VaultThreadsRun(4) == serial);
+}
+
+// callbacks, link and atomic stats of a sparse trace over two chained cubes,
+// the logic runs several cycles per DRAM cycle and the atomic latencies are
+// counted in logic cycles
+static std::vector<std::string> SparseRun(bool skip_idle_logic,
+                                          std::vector<uint64_t> &done) {
+    DerivedConfig ini("configs/HMC_2GB_4Lx16.ini",
+                      std::string("[hmc]\nnum_cubes = 2\nserdes_latency = 3\n"
+                                  "link_error_rate = 0.1\nskip_idle_logic = ") +
+                          (skip_idle_logic ? "true" : "false") + "\n",
+                      {{"link_speed = 10000", "link_speed = 60000"}});
+    dramsim3::Config config(ini.file(), ".");
+    int clk = 0;
+    auto cb = [&done, &clk](uint64_t addr) {
+        done.push_back(addr);
+        done.push_back(clk);
+    };
+    dramsim3::HMCMemorySystem hmc(config, ".", cb, cb);
+    uint64_t addr = 54321;
+    for (; clk < 6000; clk++) {
+        addr = addr * 6364136223846793005ull + 1442695040888963407ull;
+        // a request every 32 cycles on average, and a few in a row
+        if ((addr >> 59) == 0 || clk % 400 < 4) {
+            dramsim3::Transaction trans((addr >> 20) & 0xffffffc0,
+                                        (addr >> 63) != 0);
+            if ((addr >> 56 & 7) == 0) {
+                trans.atomic_op = dramsim3::AtomicOp::INC8;
+            }
+            if (hmc.WillAcceptTransaction(trans)) {
+                hmc.AddTransaction(trans);
+            }
+        }
+        hmc.ClockTick();
+    }
+    hmc.PrintStats();
+    std::vector<std::string> stats;
+    for (auto name : {"hmc_links.json", "hmc_atomics.json"}) {
+        std::string file_name = config.output_prefix + name;
+        std::ifstream file(file_name);
+        stats.emplace_back(std::istreambuf_iterator<char>(file),
+                           std::istreambuf_iterator<char>());
+    }
+    RemoveStats(config);
+    return stats;
+}
+
+TEST_CASE("HMC idle logic cycle skip", "[dramsim3][hmc]") {
+    std::vector<uint64_t> ticked_done, skipped_done;
+    auto ticked = SparseRun(false, ticked_done);
+    REQUIRE(ticked_done.size() > 200);
+    REQUIRE(SparseRun(true, skipped_done) == ticked);
+    REQUIRE(skipped_done == ticked_done);
+}
@@ -0,0 +1,92 @@
+#define CATCH_CONFIG_MAIN
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include "catch.hpp"
+#include "thermal_config.h"
+
+extern "C" double *steady_thermal_solver(double ***powerM, double W, double Lc,
+                                         int numP, int dimX, int dimZ,
+                                         double **Midx, int count,
+                                         double Tamb_);
+extern "C" double **calculate_Midx_array(double W, double Lc, int numP,
+                                         int dimX, int dimZ, int *MidxSize,
+                                         double Tamb_);
+
+TEST_CASE("Steady state thermal solver", "[thermal]") {
+    // a grid small enough for a dense solve of the same G * T = rhs
+    const int numP = 2, dimX = 5, dimZ = 4;
+    const double W = 0.008, Lc = 0.008, Tamb = 313.15;
+    int count = 0;
+    double **Midx =
+        calculate_Midx_array(W, Lc, numP, dimX, dimZ, &count, Tamb);
+    const int n = dimX * dimZ * (numP * 3 + 1);
+    std::vector<double> G(n * n, 0.0), rhs(n, 0.0);
+    for (int k = 0; k < count; k++) {
+        G[static_cast<int>(Midx[k][0] + 0.01) * n +
+          static_cast<int>(Midx[k][1] + 0.01)] = Midx[k][2];
+    }
+
+    // the solver frees the power map, as the thermal calculator does
+    double ***powerM = (double ***)malloc(dimX * sizeof(double **));
+    srand(1);
+    for (int i = 0; i < dimX; i++) {
+        powerM[i] = (double **)malloc(dimZ * sizeof(double *));
+        for (int j = 0; j < dimZ; j++) {
+            powerM[i][j] = (double *)malloc(numP * sizeof(double));
+            for (int l = 0; l < numP; l++) {
+                powerM[i][j][l] = (rand() % 1000) * 1e-5;
+                rhs[dimX * dimZ * (l * 3 + 1) + j * dimX + i] =
+                    powerM[i][j][l];
+            }
+        }
+    }
+    double Ramb = Hhs / Khs / (W / dimX) / (Lc / dimZ) / 2;
+    for (int i = 0; i < dimX * dimZ; i++) {
+        rhs[i] = Tamb / Ramb;
+    }
+    double *T = steady_thermal_solver(powerM, W, Lc, numP, dimX, dimZ, Midx,
+                                      count, Tamb);
+
+    // Gaussian elimination with partial pivoting
+    for (int c = 0; c < n; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < n; r++) {
+            if (std::fabs(G[r * n + c]) > std::fabs(G[pivot * n + c])) {
+                pivot = r;
+            }
+        }
+        for (int k = 0; k < n; k++) {
+            std::swap(G[c * n + k], G[pivot * n + k]);
+        }
+        std::swap(rhs[c], rhs[pivot]);
+        for (int r = c + 1; r < n; r++) {
+            double f = G[r * n + c] / G[c * n + c];
+            for (int k = c; k < n; k++) {
+                G[r * n + k] -= f * G[c * n + k];
+            }
+            rhs[r] -= f * rhs[c];
+        }
+    }
+    for (int r = n - 1; r >= 0; r--) {
+        for (int k = r + 1; k < n; k++) {
+            rhs[r] -= G[r * n + k] * rhs[k];
+        }
+        rhs[r] /= G[r * n + r];
+    }
+
+    // the solver returns degrees Celsius
+    double max_rise = 0.0;
+    for (int i = 0; i < n; i++) {
+        REQUIRE(std::fabs(T[i] - (rhs[i] - T0)) < 1e-6);
+        max_rise = std::fmax(max_rise, T[i] - (Tamb - T0));
+    }
+    REQUIRE(max_rise > 0.0);
+
+    free(T);
+    for (int k = 0; k < count; k++) {
+        free(Midx[k]);
+    }
+    free(Midx);
+}
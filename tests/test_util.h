@@ -0,0 +1,62 @@
+#ifndef __TEST_UTIL_H
+#define __TEST_UTIL_H
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include "json.hpp"
+#include "configuration.h"
+
+// a copy of a base .ini with extra lines appended, removed again when it
+// goes out of scope; keys set twice are joined rather than overridden, so
+// existing keys are changed by replacing their line
+class DerivedConfig {
+   public:
+    DerivedConfig(const std::string &base, const std::string &extra,
+                  const std::map<std::string, std::string> &replace = {})
+        : file_("test_derived_" + std::to_string(Count()) + ".ini") {
+        std::ifstream in(base);
+        std::string text((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+        for (const auto &line : replace) {
+            text.replace(text.find(line.first), line.first.size(),
+                         line.second);
+        }
+        std::ofstream(file_) << text << "\n" << extra;
+    }
+    ~DerivedConfig() { std::remove(file_.c_str()); }
+    const std::string &file() const { return file_; }
+
+   private:
+    static int Count() {
+        static int count = 0;
+        return count++;
+    }
+
+    std::string file_;
+};
+
+// removes every stats file the memory system wrote
+inline void RemoveStats(const dramsim3::Config &config) {
+    std::remove(config.json_stats_name.c_str());
+    std::remove(config.json_epoch_name.c_str());
+    std::remove(config.txt_stats_name.c_str());
+    std::remove((config.output_prefix + "hmc_links.json").c_str());
+    std::remove((config.output_prefix + "hmc_atomics.json").c_str());
+}
+
+// the stats of the last PrintStats, from the json stats or the named file
+// of the output prefix
+inline nlohmann::json ReadStats(const dramsim3::Config &config,
+                                const std::string &name = "") {
+    nlohmann::json stats;
+    std::ifstream(name.empty() ? config.json_stats_name
+                               : config.output_prefix + name) >>
+        stats;
+    RemoveStats(config);
+    return stats;
+}
+
+#endif